@@ -5,6 +5,7 @@
  */
 #define MMAPIO_WIN32_DLL_INTERNAL
 #define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 #include "mmapio.h"
 #include <stdlib.h>
 #include <errno.h>
@@ -26,6 +27,16 @@ struct mmapio_mode_tag {
   char privy;
   /** \brief flag for enabling access from child processes */
   char bequeath;
+  /** \brief flag for exclusive creation of shared memory */
+  char excl;
+  /** \brief flag for following file growth */
+  char follow;
+  /** \brief flag for growing inside a reserved address range */
+  char reserve;
+  /** \brief flag for mapping on first use */
+  char lazy;
+  /** \brief flag for keeping a mapping out of child processes */
+  char dontfork;
 };
 
 /**
@@ -35,6 +46,45 @@ struct mmapio_mode_tag {
  */
 static struct mmapio_mode_tag mmapio_mode_parse(char const* mmode);
 
+/**
+ * \brief Read a monotonic clock for tracing.
+ * \return a time in nanoseconds
+ */
+static mmapio_u64 mmapio_trace_now(void);
+
+/**
+ * \brief Report the start of a traced system call.
+ * \param op a \link mmapio_trace_op \endlink value
+ * \param[out] t0 start time, if hooks are installed
+ */
+static void mmapio_trace_begin(int op, mmapio_u64* t0);
+
+/**
+ * \brief Report the end of a traced system call.
+ * \param op a \link mmapio_trace_op \endlink value
+ * \param t0 start time from \link mmapio_trace_begin \endlink
+ * \param size size involved in the call
+ * \param failed nonzero if the call failed and set `errno`
+ */
+static void mmapio_trace_end(int op, mmapio_u64 t0, size_t size, int failed);
+
+/**
+ * \brief Find the whole pages covering part of a map instance.
+ * \param m map instance
+ * \param off offset from the start of the mapped area
+ * \param[in,out] len length of the part, or zero for the rest of the
+ *   area; receives the length of the page-aligned span
+ * \param[out] p pointer to release afterward
+ * \return the page-aligned start of the span on success, NULL otherwise
+ */
+static unsigned char* mmapio_page_span
+  (struct mmapio_i* m, size_t off, size_t* len, void** p);
+
+/**
+ * \brief Installed trace hooks, or NULL.
+ */
+static struct mmapio_trace const* mmapio_trace_hooks = NULL;
+
 #define MMAPIO_OS_UNIX 1
 #define MMAPIO_OS_WIN32 2
 
@@ -52,13 +102,20 @@ static struct mmapio_mode_tag mmapio_mode_parse(char const* mmode);
 #  endif
 #endif /*MMAPIO_OS*/
 
+#if (defined MMAPIO_USDT)
+#  include <sys/sdt.h>
+#endif /*MMAPIO_USDT*/
+
 #if MMAPIO_OS == MMAPIO_OS_UNIX
 #  include <unistd.h>
+#  include <time.h>
 #if (defined __STDC_VERSION__) && (__STDC_VERSION__ >= 199501L)
 #  include <wchar.h>
-#  include <string.h>
 #endif /*__STDC_VERSION__*/
+#  include <string.h>
+#  include <stdio.h>
 #  include <fcntl.h>
+#  include <sched.h>
 #  include <sys/mman.h>
 #  include <sys/stat.h>
 
@@ -76,6 +133,38 @@ struct mmapio_unix {
   size_t shift;
   /** \brief file descriptor */
   int fd;
+  /** \brief file offset of `ptr` */
+  off_t fulloff;
+  /** \brief mode tag */
+  struct mmapio_mode_tag mt;
+  /** \brief size of reserved address range, or zero if not reserved */
+  size_t cap;
+  /** \brief size requested at open, for lazy mapping */
+  size_t req_sz;
+  /** \brief offset requested at open, for lazy mapping */
+  size_t req_off;
+  /** \brief lazy mapping state */
+  mmapio_u32 volatile state;
+  /** \brief error from a failed lazy mapping */
+  int err;
+  /** \brief temporary file name until published, or NULL */
+  char* pub_tmp;
+  /** \brief destination file name for publishing, or NULL */
+  char* pub_dst;
+};
+
+/**
+ * \brief Lazy mapping states.
+ */
+enum mmapio_unix_state {
+  /** \brief not yet mapped */
+  mmapio_unix_idle = 0,
+  /** \brief mapping in progress */
+  mmapio_unix_busy = 1,
+  /** \brief mapped */
+  mmapio_unix_ready = 2,
+  /** \brief mapping failed */
+  mmapio_unix_failed = 3
 };
 
 /**
@@ -124,6 +213,61 @@ static size_t mmapio_file_size_e(int fd);
 static struct mmapio_i* mmapio_open_rest
   (int fd, struct mmapio_mode_tag const mmode, size_t sz, size_t off);
 
+/**
+ * \brief Map the requested range of a file.
+ * \param mu map instance with file descriptor and mode tag set
+ * \param sz size of range to map
+ * \param off offset from start of file
+ * \return zero on success, -1 otherwise
+ * \note On failure, the file descriptor stays open.
+ */
+static int mmapio_unix_map(struct mmapio_unix* mu, size_t sz, size_t off);
+
+/**
+ * \brief Apply the fork flag of a mode tag to a mapping.
+ * \param mt mode tag
+ * \param p start of the mapping
+ * \param len length of the mapping
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_unix_inherit
+  (struct mmapio_mode_tag const mt, void* p, size_t len);
+
+/**
+ * \brief Flush the directory holding a file to storage.
+ * \param nm name of the file
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_unix_sync_dir(char const* nm);
+
+/**
+ * \brief Map a lazy instance on first use.
+ * \param mu map instance
+ * \return zero if mapped, -1 otherwise
+ */
+static int mmapio_unix_settle(struct mmapio_unix* mu);
+
+/**
+ * \brief Acquire a lock to the space of a lazy instance.
+ * \param m map instance
+ * \return pointer to locked space on success, NULL otherwise
+ */
+static void* mmapio_mmi_acquire_lazy(struct mmapio_i* m);
+
+/**
+ * \brief Check the length of the mapped area of a lazy instance.
+ * \param m map instance
+ * \return the length of the mapped region, or zero if mapping failed
+ */
+static size_t mmapio_mmi_length_lazy(struct mmapio_i const* m);
+
+/**
+ * \brief Convert a `mmapio` mode tag to `shm_open` flags.
+ * \param mt the tag to convert
+ * \return `shm_open` flags on success, -1 otherwise
+ */
+static int mmapio_mode_shm_cvt(struct mmapio_mode_tag const mt);
+
 /**
  * \brief Destructor; closes the file and frees the space.
  * \param m map instance
@@ -150,6 +294,21 @@ static void mmapio_mmi_release(struct mmapio_i* m, void* p);
  * \return the length of the mapped region exposed by this interface
  */
 static size_t mmapio_mmi_length(struct mmapio_i const* m);
+
+/**
+ * \brief Extend a mapping to cover a larger part of its file.
+ * \param mu map instance
+ * \param fullsize new size of the mapping, counted from `ptr`
+ * \return zero on success, nonzero otherwise
+ */
+static int mmapio_unix_grow(struct mmapio_unix* mu, size_t fullsize);
+
+/**
+ * \brief Acquire a lock to the space, after checking for file growth.
+ * \param m map instance
+ * \return pointer to locked space on success, NULL otherwise
+ */
+static void* mmapio_mmi_acquire_follow(struct mmapio_i* m);
 #elif MMAPIO_OS == MMAPIO_OS_WIN32
 #  define WIN32_LEAN_AND_MEAN
 #  include <windows.h>
@@ -265,9 +424,242 @@ static void mmapio_mmi_release(struct mmapio_i* m, void* p);
 static size_t mmapio_mmi_length(struct mmapio_i const* m);
 #endif /*MMAPIO_OS*/
 
+#include "mmapio_atomic.h"
+
+/*
+ * Thread caches need a hook at thread exit to give their blocks back,
+ * so they exist only where the system offers one.
+ */
+#if MMAPIO_OS == MMAPIO_OS_UNIX || MMAPIO_OS == MMAPIO_OS_WIN32
+#  if (defined __STDC_VERSION__) && (__STDC_VERSION__ >= 201112L) \
+  &&  !(defined __STDC_NO_THREADS__)
+#    define MMAPIO_THREAD_LOCAL _Thread_local
+#  elif (defined __GNUC__)
+#    define MMAPIO_THREAD_LOCAL __thread
+#  elif (defined _MSC_VER)
+#    define MMAPIO_THREAD_LOCAL __declspec(thread)
+#  endif /*__STDC_VERSION__*/
+#endif /*MMAPIO_OS*/
+#if (defined MMAPIO_THREAD_LOCAL) && MMAPIO_OS == MMAPIO_OS_UNIX
+#  include <pthread.h>
+#endif /*MMAPIO_THREAD_LOCAL*/
+
+/**
+ * \brief Number of pool size classes, 64 bytes apart.
+ */
+#define MMAPIO_POOL_CLASSES 16u
+
+/**
+ * \brief Most blocks of one class that a thread keeps.
+ */
+#define MMAPIO_POOL_CACHE 16u
+
+/**
+ * \brief Number of tries for the pool lock before yielding.
+ */
+#define MMAPIO_POOL_SPINS 64u
+
+/**
+ * \brief Free lists of the handle pool.
+ * \note Each free block holds the next block's address in its
+ *   first bytes.
+ */
+struct mmapio_pool_list {
+  /** \brief first free block of each class */
+  void* head[MMAPIO_POOL_CLASSES];
+  /** \brief number of free blocks of each class */
+  unsigned int count[MMAPIO_POOL_CLASSES];
+};
+
+/**
+ * \brief Blocks shared by all threads, under `mmapio_pool_spin`.
+ */
+static struct mmapio_pool_list mmapio_pool_shared;
+
+/**
+ * \brief Lock of the shared blocks.
+ */
+static mmapio_u32 volatile mmapio_pool_spin = 0u;
+
+#if (defined MMAPIO_THREAD_LOCAL)
+/**
+ * \brief Blocks cached by the calling thread.
+ */
+static MMAPIO_THREAD_LOCAL struct mmapio_pool_list mmapio_pool_local;
+
+/**
+ * \brief State of the calling thread's cache: zero before first use,
+ *   positive while in use, negative if the thread uses only the shared
+ *   blocks.
+ */
+static MMAPIO_THREAD_LOCAL int mmapio_pool_bound;
+
+/**
+ * \brief State of the exit hook, under `mmapio_pool_spin`: zero
+ *   before first use, positive once made, negative if it failed.
+ */
+static int mmapio_pool_keyed = 0;
+
+#  if MMAPIO_OS == MMAPIO_OS_UNIX
+/**
+ * \brief Key whose destructor runs the exit hook.
+ */
+static pthread_key_t mmapio_pool_key;
+#  else
+/**
+ * \brief Fiber local slot whose callback runs the exit hook.
+ */
+static DWORD mmapio_pool_fls;
+#  endif /*MMAPIO_OS*/
+
+/**
+ * \brief Find the calling thread's cache, setting up its exit hook
+ *   on first use.
+ * \return the cache, or NULL if the thread must use the shared blocks
+ */
+static struct mmapio_pool_list* mmapio_pool_cache(void);
+
+/**
+ * \brief Hand a cache to the shared blocks as its thread exits.
+ * \param list the exiting thread's cache
+ */
+static void mmapio_pool_exit(void* list);
+
+#  if MMAPIO_OS == MMAPIO_OS_WIN32
+/**
+ * \brief Fiber local storage callback for the exit hook.
+ * \param list the exiting thread's cache
+ */
+static VOID WINAPI mmapio_pool_exit_fls(PVOID list);
+#  endif /*MMAPIO_OS*/
+#endif /*MMAPIO_THREAD_LOCAL*/
+
+/**
+ * \brief Take the lock of the shared pool blocks.
+ */
+static void mmapio_pool_lock(void);
+
+/**
+ * \brief Release the lock of the shared pool blocks.
+ */
+static void mmapio_pool_unlock(void);
+
+/**
+ * \brief Move free blocks of one class between lists.
+ * \param dst list to fill
+ * \param src list to drain
+ * \param c class index
+ * \param n most blocks to move
+ * \return the number of blocks moved
+ */
+static unsigned int mmapio_pool_move(struct mmapio_pool_list* dst,
+    struct mmapio_pool_list* src, unsigned int c, unsigned int n);
+
+/**
+ * \brief Take a free block from a list.
+ * \param list list to take from
+ * \param c class index
+ * \return a block, or NULL if the list has none of the class
+ */
+static void* mmapio_pool_pop(struct mmapio_pool_list* list, unsigned int c);
+
+/**
+ * \brief Put a free block on a list.
+ * \param list list to put on
+ * \param c class index
+ * \param p block to put
+ */
+static void mmapio_pool_push
+  (struct mmapio_pool_list* list, unsigned int c, void* p);
+
 /* BEGIN static functions */
+mmapio_u64 mmapio_trace_now(void) {
+#if MMAPIO_OS == MMAPIO_OS_UNIX
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0u;
+  return ((mmapio_u64)ts.tv_sec)*1000000000u + (mmapio_u64)ts.tv_nsec;
+#elif MMAPIO_OS == MMAPIO_OS_WIN32
+  LARGE_INTEGER t;
+  LARGE_INTEGER f;
+  if (!QueryPerformanceCounter(&t) || !QueryPerformanceFrequency(&f)
+  ||  f.QuadPart <= 0)
+  {
+    return 0u;
+  }
+  return (mmapio_u64)(t.QuadPart/f.QuadPart)*1000000000u
+    +    (mmapio_u64)(t.QuadPart%f.QuadPart)*1000000000u
+          /(mmapio_u64)f.QuadPart;
+#else
+  return 0u;
+#endif /*MMAPIO_OS*/
+}
+
+void mmapio_trace_begin(int op, mmapio_u64* t0) {
+  struct mmapio_trace const* const hooks = mmapio_trace_hooks;
+#if (defined MMAPIO_USDT)
+  DTRACE_PROBE1(mmapio, enter, op);
+#endif /*MMAPIO_USDT*/
+  if (hooks != NULL) {
+    if (hooks->before != NULL)
+      hooks->before(hooks, op);
+    *t0 = mmapio_trace_now();
+  }
+  return;
+}
+
+void mmapio_trace_end(int op, mmapio_u64 t0, size_t size, int failed) {
+  struct mmapio_trace const* const hooks = mmapio_trace_hooks;
+#if MMAPIO_OS == MMAPIO_OS_WIN32
+  int const err = failed ? (int)GetLastError() : 0;
+#else
+  int const err = failed ? errno : 0;
+#endif /*MMAPIO_OS*/
+#if (defined MMAPIO_USDT)
+  DTRACE_PROBE3(mmapio, leave, op, size, err);
+#endif /*MMAPIO_USDT*/
+  if (hooks != NULL && hooks->after != NULL) {
+    hooks->after(hooks, op, mmapio_trace_now()-t0, size, err);
+    /* keep the call's error for the caller */
+    if (failed) {
+#if MMAPIO_OS == MMAPIO_OS_WIN32
+      SetLastError((DWORD)err);
+#else
+      errno = err;
+#endif /*MMAPIO_OS*/
+    }
+  }
+  return;
+}
+
+unsigned char* mmapio_page_span
+  (struct mmapio_i* m, size_t off, size_t* len, void** p)
+{
+  size_t const psize = mmapio_page_size();
+  size_t total;
+  size_t addr;
+  size_t span;
+  *p = mmapio_acquire(m);
+  if (*p == NULL)
+    return NULL;
+  total = mmapio_length(m);
+  if (off > total || *len > total-off || psize == 0u) {
+    mmapio_release(m, *p);
+    errno = ERANGE;
+    return NULL;
+  } else if (*len == 0u) {
+    *len = total-off;
+  }
+  addr = (size_t)(((unsigned char*)*p)+off);
+  span = *len + addr%psize;
+  if (span%psize != 0u)
+    span += psize - span%psize;
+  *len = span;
+  return ((unsigned char*)*p)+off-addr%psize;
+}
+
 struct mmapio_mode_tag mmapio_mode_parse(char const* mmode) {
-  struct mmapio_mode_tag out = { 0, 0, 0, 0 };
+  struct mmapio_mode_tag out = { 0, 0, 0, 0, 0, 0, 0, 0, 0 };
   int i;
   for (i = 0; i < 8; ++i) {
     switch (mmode[i]) {
@@ -288,6 +680,21 @@ struct mmapio_mode_tag mmapio_mode_parse(char const* mmode) {
     case mmapio_mode_bequeath:
       out.bequeath = mmapio_mode_bequeath;
       break;
+    case mmapio_mode_exclusive:
+      out.excl = mmapio_mode_exclusive;
+      break;
+    case mmapio_mode_follow:
+      out.follow = mmapio_mode_follow;
+      break;
+    case mmapio_mode_lazy:
+      out.lazy = mmapio_mode_lazy;
+      break;
+    case mmapio_mode_dontfork:
+      out.dontfork = mmapio_mode_dontfork;
+      break;
+    case mmapio_mode_reserve:
+      out.reserve = mmapio_mode_reserve;
+      break;
     }
   }
   return out;
@@ -356,11 +763,26 @@ int mmapio_mode_flag_cvt(int mprivy) {
   return mprivy ? MAP_PRIVATE : MAP_SHARED;
 }
 
+int mmapio_mode_shm_cvt(struct mmapio_mode_tag const mt) {
+  switch (mt.mode) {
+  case mmapio_mode_write:
+    return mt.excl ? (O_RDWR|O_CREAT|O_EXCL) : (O_RDWR|O_CREAT);
+  case mmapio_mode_read:
+    return mt.excl ? -1 : O_RDONLY;
+  default:
+    return -1;
+  }
+}
+
 size_t mmapio_file_size_e(int fd) {
   struct stat fsi;
+  mmapio_u64 t0 = 0u;
   memset(&fsi, 0, sizeof(fsi));
   /* stat pull */{
-    int const res = fstat(fd, &fsi);
+    int res;
+    mmapio_trace_begin(mmapio_trace_stat, &t0);
+    res = fstat(fd, &fsi);
+    mmapio_trace_end(mmapio_trace_stat, t0, (size_t)fsi.st_size, res != 0);
     if (res != 0) {
       return 0u;
     } else return (size_t)(fsi.st_size);
@@ -370,18 +792,21 @@ size_t mmapio_file_size_e(int fd) {
 struct mmapio_i* mmapio_open_rest
   (int fd, struct mmapio_mode_tag const mt, size_t sz, size_t off)
 {
-  struct mmapio_unix *const out = calloc(1, sizeof(struct mmapio_unix));
-  void *ptr;
-  size_t fullsize;
-  size_t fullshift;
-  off_t fulloff;
+  struct mmapio_unix *out;
+  mmapio_u64 t0 = 0u;
+  mmapio_trace_begin(mmapio_trace_alloc, &t0);
+  out = mmapio_pool_alloc(sizeof(struct mmapio_unix));
+  mmapio_trace_end(mmapio_trace_alloc, t0, sizeof(struct mmapio_unix),
+      out == NULL);
   if (out == NULL) {
     close(fd);
     return NULL;
   }
   /* assign the close-on-exec flag */{
-    int const old_flags = fcntl(fd, F_GETFD);
+    int old_flags;
     int bequeath_break = 0;
+    mmapio_trace_begin(mmapio_trace_fcntl, &t0);
+    old_flags = fcntl(fd, F_GETFD);
     if (old_flags < 0) {
       bequeath_break = 1;
     } else if (mt.bequeath) {
@@ -389,23 +814,63 @@ struct mmapio_i* mmapio_open_rest
     } else {
       bequeath_break = (fcntl(fd, F_SETFD, old_flags|FD_CLOEXEC) < 0);
     }
+    mmapio_trace_end(mmapio_trace_fcntl, t0, 0u, bequeath_break);
     if (bequeath_break) {
       close(fd);
-      free(out);
+      mmapio_pool_free(out, sizeof(*out));
       return NULL;
     }
   }
-  if (mt.end) /* fix map size */{
+  /* initialize the interface */{
+    out->ptr = NULL;
+    out->fd = fd;
+    out->mt = mt;
+    out->base.mmi_dtor = &mmapio_mmi_dtor;
+    out->base.mmi_acquire = (mt.follow || mt.reserve)
+      ? &mmapio_mmi_acquire_follow
+      : &mmapio_mmi_acquire;
+    out->base.mmi_release = &mmapio_mmi_release;
+    out->base.mmi_length = &mmapio_mmi_length;
+  }
+  if (mt.lazy) {
+    if (sz == 0 && !(mt.end || mt.follow)) {
+      close(fd);
+      mmapio_pool_free(out, sizeof(*out));
+      errno = ERANGE;
+      return NULL;
+    }
+    out->req_sz = sz;
+    out->req_off = off;
+    out->state = mmapio_unix_idle;
+    out->base.mmi_acquire = &mmapio_mmi_acquire_lazy;
+    out->base.mmi_length = &mmapio_mmi_length_lazy;
+  } else if (mmapio_unix_map(out, sz, off) != 0) {
+    int const err = errno;
+    close(fd);
+    mmapio_pool_free(out, sizeof(*out));
+    errno = err;
+    return NULL;
+  }
+  return (struct mmapio_i*)out;
+}
+
+int mmapio_unix_map(struct mmapio_unix* mu, size_t sz, size_t off) {
+  struct mmapio_mode_tag const mt = mu->mt;
+  int const fd = mu->fd;
+  void *ptr;
+  size_t fullsize;
+  size_t fullshift;
+  off_t fulloff;
+  mmapio_u64 t0 = 0u;
+  if ((mt.end || mt.follow) && !mt.reserve) /* fix map size */{
     size_t const xsz = mmapio_file_size_e(fd);
     if (xsz < off)
       sz = 0 /*to fail*/;
     else sz = xsz-off;
   }
-  if (sz == 0) {
-    close(fd);
-    free(out);
+  if (sz == 0 && !(mt.follow && !mt.reserve)) {
     errno = ERANGE;
-    return NULL;
+    return -1;
   }
   /* fix to page sizes */{
     long const psize = sysconf(_SC_PAGE_SIZE);
@@ -416,43 +881,170 @@ struct mmapio_i* mmapio_open_rest
       fulloff = (off_t)(off-fullshift);
       if (fullshift >= ((~(size_t)0u)-sz)) {
         /* range fix failure */
-        close(fd);
-        free(out);
         errno = ERANGE;
-        return NULL;
+        return -1;
       } else fullsize += fullshift;
     } else {
       fullshift = 0u;
       fulloff = (off_t)off;
     }
   }
-  ptr = mmap(NULL, fullsize, mmapio_mode_prot_cvt(mt.mode),
-       mmapio_mode_flag_cvt(mt.privy), fd, fulloff);
-  if (ptr == MAP_FAILED) {
-    close(fd);
-    free(out);
-    return NULL;
+  if (mt.reserve) {
+    /* reserve the whole range, then map the part the file covers */
+    size_t const xsz = mmapio_file_size_e(fd);
+    size_t cur = (xsz > (size_t)fulloff) ? xsz-(size_t)fulloff : 0u;
+#if (defined MAP_ANONYMOUS)
+    int const anon = MAP_ANONYMOUS;
+#else
+    int const anon = MAP_ANON;
+#endif /*MAP_ANONYMOUS*/
+    void* fixed = NULL;
+    if (cur > fullsize)
+      cur = fullsize;
+    mu->cap = fullsize;
+    mmapio_trace_begin(mmapio_trace_map, &t0);
+    ptr = mmap(NULL, fullsize, PROT_NONE, MAP_PRIVATE|anon, -1, 0);
+    mmapio_trace_end(mmapio_trace_map, t0, fullsize, ptr == MAP_FAILED);
+    if (ptr == MAP_FAILED) {
+      return -1;
+    }
+    if (cur > 0u) {
+      mmapio_trace_begin(mmapio_trace_map, &t0);
+      fixed = mmap(ptr, cur, mmapio_mode_prot_cvt(mt.mode),
+          mmapio_mode_flag_cvt(mt.privy)|MAP_FIXED, fd, fulloff);
+      mmapio_trace_end(mmapio_trace_map, t0, cur, fixed == MAP_FAILED);
+    }
+    if (fixed == MAP_FAILED) {
+      int const err = errno;
+      munmap(ptr, fullsize);
+      errno = err;
+      return -1;
+    }
+    fullsize = (cur > fullshift) ? cur : fullshift;
+  } else if (sz == 0) {
+    /* wait for the followed file to grow */
+    ptr = NULL;
+    fullsize = fullshift;
+  } else {
+    mmapio_trace_begin(mmapio_trace_map, &t0);
+    ptr = mmap(NULL, fullsize, mmapio_mode_prot_cvt(mt.mode),
+         mmapio_mode_flag_cvt(mt.privy), fd, fulloff);
+    mmapio_trace_end(mmapio_trace_map, t0, fullsize, ptr == MAP_FAILED);
+    if (ptr == MAP_FAILED) {
+      return -1;
+    }
   }
-  /* initialize the interface */{
-    out->ptr = ptr;
-    out->len = fullsize;
-    out->fd = fd;
-    out->shift = fullshift;
-    out->base.mmi_dtor = &mmapio_mmi_dtor;
-    out->base.mmi_acquire = &mmapio_mmi_acquire;
-    out->base.mmi_release = &mmapio_mmi_release;
-    out->base.mmi_length = &mmapio_mmi_length;
+  if (ptr != NULL
+  &&  mmapio_unix_inherit(mt, ptr, mu->cap ? mu->cap : fullsize) != 0)
+  {
+    int const err = errno;
+    munmap(ptr, mu->cap ? mu->cap : fullsize);
+    errno = err;
+    return -1;
   }
-  return (struct mmapio_i*)out;
+  mu->ptr = ptr;
+  mu->len = fullsize;
+  mu->shift = fullshift;
+  mu->fulloff = fulloff;
+  return 0;
+}
+
+int mmapio_unix_inherit
+  (struct mmapio_mode_tag const mt, void* p, size_t len)
+{
+  if (mt.dontfork) {
+#if (defined MADV_DONTFORK)
+    if (madvise(p, len, MADV_DONTFORK) != 0)
+      return -1;
+#else
+#  if (defined ENOSYS)
+    errno = ENOSYS;
+#  else
+    errno = EDOM;
+#  endif /*ENOSYS*/
+    return -1;
+#endif /*MADV_DONTFORK*/
+  }
+  return 0;
+}
+
+int mmapio_unix_grow(struct mmapio_unix* mu, size_t fullsize) {
+  void* ptr;
+  mmapio_u64 t0 = 0u;
+  if (mu->cap > 0u) {
+    /* map the new extent in place, from the page holding the old end */
+    long const psize = sysconf(_SC_PAGE_SIZE);
+    size_t const start = (psize > 0)
+      ? (mu->len/(size_t)psize)*(size_t)psize
+      : 0u;
+    if (fullsize > mu->cap)
+      fullsize = mu->cap;
+    if (fullsize <= mu->len)
+      return 0;
+    mmapio_trace_begin(mmapio_trace_map, &t0);
+    ptr = mmap(((unsigned char*)mu->ptr)+start, fullsize-start,
+         mmapio_mode_prot_cvt(mu->mt.mode),
+         mmapio_mode_flag_cvt(mu->mt.privy)|MAP_FIXED,
+         mu->fd, mu->fulloff+(off_t)start);
+    mmapio_trace_end(mmapio_trace_map, t0, fullsize-start,
+        ptr == MAP_FAILED);
+    if (ptr == MAP_FAILED)
+      return -1;
+    mu->len = fullsize;
+    /* new mappings replace the old advice over the reserved range */
+    return mmapio_unix_inherit(mu->mt, mu->ptr, mu->cap);
+  } else if (mu->ptr == NULL) {
+    mmapio_trace_begin(mmapio_trace_map, &t0);
+    ptr = mmap(NULL, fullsize, mmapio_mode_prot_cvt(mu->mt.mode),
+         mmapio_mode_flag_cvt(mu->mt.privy), mu->fd, mu->fulloff);
+    mmapio_trace_end(mmapio_trace_map, t0, fullsize, ptr == MAP_FAILED);
+  } else {
+#if (defined MREMAP_MAYMOVE)
+    /* the kernel moves page table entries, so the prefix stays mapped */
+    mmapio_trace_begin(mmapio_trace_remap, &t0);
+    ptr = mremap(mu->ptr, mu->len, fullsize, MREMAP_MAYMOVE);
+    mmapio_trace_end(mmapio_trace_remap, t0, fullsize, ptr == MAP_FAILED);
+#else
+    mmapio_trace_begin(mmapio_trace_remap, &t0);
+    ptr = mmap(NULL, fullsize, mmapio_mode_prot_cvt(mu->mt.mode),
+         mmapio_mode_flag_cvt(mu->mt.privy), mu->fd, mu->fulloff);
+    if (ptr != MAP_FAILED)
+      munmap(mu->ptr, mu->len);
+    mmapio_trace_end(mmapio_trace_remap, t0, fullsize, ptr == MAP_FAILED);
+#endif /*MREMAP_MAYMOVE*/
+  }
+  if (ptr == MAP_FAILED)
+    return -1;
+  mu->ptr = ptr;
+  mu->len = fullsize;
+  return mmapio_unix_inherit(mu->mt, ptr, fullsize);
 }
 
 void mmapio_mmi_dtor(struct mmapio_i* m) {
   struct mmapio_unix* const mu = (struct mmapio_unix*)m;
-  munmap(mu->ptr, mu->len);
+  mmapio_u64 t0 = 0u;
+  if (mu->ptr != NULL) {
+    size_t const len = mu->cap ? mu->cap : mu->len;
+    int res;
+    mmapio_trace_begin(mmapio_trace_unmap, &t0);
+    res = munmap(mu->ptr, len);
+    mmapio_trace_end(mmapio_trace_unmap, t0, len, res != 0);
+  }
   mu->ptr = NULL;
-  close(mu->fd);
+  if (mu->fd != -1) {
+    int res;
+    mmapio_trace_begin(mmapio_trace_close, &t0);
+    res = close(mu->fd);
+    mmapio_trace_end(mmapio_trace_close, t0, 0u, res != 0);
+  }
   mu->fd = -1;
-  free(mu);
+  if (mu->pub_tmp != NULL) {
+    /* never published, so discard */
+    unlink(mu->pub_tmp);
+  }
+  free(mu->pub_tmp);
+  free(mu->pub_dst);
+  mmapio_pool_free(mu, sizeof(*mu));
   return;
 }
 
@@ -461,6 +1053,18 @@ void* mmapio_mmi_acquire(struct mmapio_i* m) {
   return ((unsigned char*)mu->ptr)+mu->shift;
 }
 
+void* mmapio_mmi_acquire_follow(struct mmapio_i* m) {
+  struct mmapio_unix* const mu = (struct mmapio_unix*)m;
+  size_t const xsz = mmapio_file_size_e(mu->fd);
+  if (xsz > (size_t)mu->fulloff && xsz-(size_t)mu->fulloff > mu->len) {
+    /* on failure, keep serving the old range */
+    mmapio_unix_grow(mu, xsz-(size_t)mu->fulloff);
+  }
+  if (mu->ptr == NULL)
+    return NULL;
+  return ((unsigned char*)mu->ptr)+mu->shift;
+}
+
 void mmapio_mmi_release(struct mmapio_i* m, void* p) {
   return;
 }
@@ -469,6 +1073,81 @@ size_t mmapio_mmi_length(struct mmapio_i const* m) {
   struct mmapio_unix* const mu = (struct mmapio_unix*)m;
   return mu->len-mu->shift;
 }
+
+int mmapio_unix_sync_dir(char const* nm) {
+  char const* const slash = strrchr(nm, '/');
+  size_t const dirlen = (slash == NULL) ? 0u
+    : (slash == nm) ? 1u : (size_t)(slash-nm);
+  char* const dir = (char*)malloc(dirlen+2u);
+  int fd;
+  int res;
+  if (dir == NULL)
+    return -1;
+  if (dirlen == 0u) {
+    dir[0] = '.';
+    dir[1] = 0;
+  } else {
+    memcpy(dir, nm, dirlen);
+    dir[dirlen] = 0;
+  }
+  fd = open(dir, O_RDONLY);
+  free(dir);
+  if (fd == -1)
+    return -1;
+  res = fsync(fd);
+  /* some file systems cannot flush directories */
+  if (res != 0 && errno == EINVAL)
+    res = 0;
+  /* keep the error past the close */{
+    int const err = errno;
+    close(fd);
+    errno = err;
+  }
+  return res;
+}
+
+int mmapio_unix_settle(struct mmapio_unix* mu) {
+  mmapio_u32 state = mmapio_atomic_load32(&mu->state);
+  if (state == mmapio_unix_idle
+  &&  mmapio_atomic_cas32(&mu->state, &state, mmapio_unix_busy))
+  {
+    /* this thread won the race, so it maps */
+    int const res = mmapio_unix_map(mu, mu->req_sz, mu->req_off);
+    if (res != 0) {
+      mu->err = errno;
+      mu->ptr = NULL;
+    }
+    mmapio_atomic_store32(&mu->state,
+        res == 0 ? mmapio_unix_ready : mmapio_unix_failed);
+    return res;
+  }
+  while (state == mmapio_unix_busy) {
+    sched_yield();
+    state = mmapio_atomic_load32(&mu->state);
+  }
+  if (state == mmapio_unix_failed) {
+    errno = mu->err;
+    return -1;
+  }
+  return 0;
+}
+
+void* mmapio_mmi_acquire_lazy(struct mmapio_i* m) {
+  struct mmapio_unix* const mu = (struct mmapio_unix*)m;
+  if (mmapio_unix_settle(mu) != 0)
+    return NULL;
+  if (mu->mt.follow || mu->mt.reserve)
+    return mmapio_mmi_acquire_follow(m);
+  return mmapio_mmi_acquire(m);
+}
+
+size_t mmapio_mmi_length_lazy(struct mmapio_i const* m) {
+  /* the first query maps, even through a const handle */
+  struct mmapio_unix* const mu = (struct mmapio_unix*)m;
+  if (mmapio_unix_settle(mu) != 0)
+    return 0u;
+  return mmapio_mmi_length(m);
+}
 #elif MMAPIO_OS == MMAPIO_OS_WIN32
 DWORD mmapio_mode_rw_cvt(int mmode) {
   switch (mmode) {
@@ -579,7 +1258,12 @@ wchar_t* mmapio_u8towc(unsigned char const* nm) {
 
 size_t mmapio_file_size_e(HANDLE fd) {
   LARGE_INTEGER sz;
-  BOOL res = GetFileSizeEx(fd, &sz);
+  BOOL res;
+  mmapio_u64 t0 = 0u;
+  sz.QuadPart = 0;
+  mmapio_trace_begin(mmapio_trace_stat, &t0);
+  res = GetFileSizeEx(fd, &sz);
+  mmapio_trace_end(mmapio_trace_stat, t0, (size_t)sz.QuadPart, !res);
   if (res) {
 #if (defined ULLONG_MAX)
     return (size_t)sz.QuadPart;
@@ -627,7 +1311,7 @@ struct mmapio_i* mmapio_open_rest
    * https://docs.microsoft.com/en-us/windows/win32/memory/
    *   creating-a-view-within-a-file
    */
-  struct mmapio_win32 *const out = calloc(1, sizeof(struct mmapio_win32));
+  struct mmapio_win32 *out;
   void *ptr;
   size_t fullsize;
   size_t fullshift;
@@ -636,23 +1320,28 @@ struct mmapio_i* mmapio_open_rest
   size_t const size_clamp = mmapio_file_size_e(fd);
   HANDLE fmd;
   SECURITY_ATTRIBUTES cfmsa;
+  mmapio_u64 t0 = 0u;
+  mmapio_trace_begin(mmapio_trace_alloc, &t0);
+  out = mmapio_pool_alloc(sizeof(struct mmapio_win32));
+  mmapio_trace_end(mmapio_trace_alloc, t0, sizeof(struct mmapio_win32),
+      out == NULL);
   if (out == NULL) {
     CloseHandle(fd);
     return NULL;
   }
-  if (mt.end) /* fix map size */{
+  if (mt.end || mt.follow) /* fix map size */{
     size_t const xsz = size_clamp;
     if (xsz < off) {
       /* reject non-ending zero parameter */
       CloseHandle(fd);
-      free(out);
+      mmapio_pool_free(out, sizeof(*out));
       errno = ERANGE;
       return NULL;
     } else sz = xsz-off;
   } else if (sz == 0) {
     /* reject non-ending zero parameter */
     CloseHandle(fd);
-    free(out);
+    mmapio_pool_free(out, sizeof(*out));
 #if (defined EINVAL)
       errno = EINVAL;
 #else
@@ -675,7 +1364,7 @@ struct mmapio_i* mmapio_open_rest
       if (fullshift >= ((~(size_t)0u)-sz)) {
         /* range fix failure */
         CloseHandle(fd);
-        free(out);
+        mmapio_pool_free(out, sizeof(*out));
         errno = ERANGE;
         return NULL;
       } else fullsize += fullshift;
@@ -705,6 +1394,7 @@ struct mmapio_i* mmapio_open_rest
     size_t const fullextent = size_clamp > extended_size+fulloff
         ? extended_size + fulloff
         : size_clamp;
+    mmapio_trace_begin(mmapio_trace_open, &t0);
     fmd = CreateFileMappingA(
         fd, /*hFile*/
         &cfmsa, /*lpFileMappingAttributes*/
@@ -713,13 +1403,15 @@ struct mmapio_i* mmapio_open_rest
         (DWORD)(fullextent&0xFFffFFff), /*dwMaximumSizeLow*/
         NULL /*lpName*/
       );
+    mmapio_trace_end(mmapio_trace_open, t0, fullextent, fmd == NULL);
   }
   if (fmd == NULL) {
     /* file mapping failed */
     CloseHandle(fd);
-    free(out);
+    mmapio_pool_free(out, sizeof(*out));
     return NULL;
   }
+  mmapio_trace_begin(mmapio_trace_map, &t0);
   ptr = MapViewOfFile(
       fmd, /*hFileMappingObject*/
       mmapio_mode_access_cvt(mt), /*dwDesiredAccess*/
@@ -727,10 +1419,11 @@ struct mmapio_i* mmapio_open_rest
       (DWORD)(fulloff&0xFFffFFff), /* dwFileOffsetLow */
       (SIZE_T)(fullsize) /* dwNumberOfBytesToMap */
     );
+  mmapio_trace_end(mmapio_trace_map, t0, fullsize, ptr == NULL);
   if (ptr == NULL) {
     CloseHandle(fmd);
     CloseHandle(fd);
-    free(out);
+    mmapio_pool_free(out, sizeof(*out));
     return NULL;
   }
   /* initialize the interface */{
@@ -749,13 +1442,25 @@ struct mmapio_i* mmapio_open_rest
 
 void mmapio_mmi_dtor(struct mmapio_i* m) {
   struct mmapio_win32* const mu = (struct mmapio_win32*)m;
-  UnmapViewOfFile(mu->ptr);
+  mmapio_u64 t0 = 0u;
+  /* unmap */{
+    BOOL res;
+    mmapio_trace_begin(mmapio_trace_unmap, &t0);
+    res = UnmapViewOfFile(mu->ptr);
+    mmapio_trace_end(mmapio_trace_unmap, t0, mu->len, !res);
+  }
   mu->ptr = NULL;
-  CloseHandle(mu->fmd);
+  /* close */{
+    BOOL res;
+    mmapio_trace_begin(mmapio_trace_close, &t0);
+    res = CloseHandle(mu->fmd);
+    if (mu->fd != NULL)
+      res = CloseHandle(mu->fd) && res;
+    mmapio_trace_end(mmapio_trace_close, t0, 0u, !res);
+  }
   mu->fmd = NULL;
-  CloseHandle(mu->fd);
   mu->fd = NULL;
-  free(mu);
+  mmapio_pool_free(mu, sizeof(*mu));
   return;
 }
 
@@ -773,6 +1478,117 @@ size_t mmapio_mmi_length(struct mmapio_i const* m) {
   return mu->len-mu->shift;
 }
 #endif /*MMAPIO_OS*/
+
+void mmapio_pool_lock(void) {
+  mmapio_u32 expect = 0u;
+  unsigned int tries = 0u;
+  while (!mmapio_atomic_cas32(&mmapio_pool_spin, &expect, 1u)) {
+    /* wait for the holder without writing, then back off */
+    while (mmapio_atomic_load32(&mmapio_pool_spin) != 0u) {
+      tries += 1u;
+      if (tries >= MMAPIO_POOL_SPINS) {
+#if MMAPIO_OS == MMAPIO_OS_UNIX
+        sched_yield();
+#elif MMAPIO_OS == MMAPIO_OS_WIN32
+        SwitchToThread();
+#endif /*MMAPIO_OS*/
+        tries = 0u;
+      }
+    }
+    expect = 0u;
+  }
+  return;
+}
+
+void mmapio_pool_unlock(void) {
+  mmapio_atomic_store32(&mmapio_pool_spin, 0u);
+  return;
+}
+
+unsigned int mmapio_pool_move(struct mmapio_pool_list* dst,
+    struct mmapio_pool_list* src, unsigned int c, unsigned int n)
+{
+  unsigned int i;
+  for (i = 0u; i < n && src->head[c] != NULL; ++i) {
+    void* const p = src->head[c];
+    memcpy(&src->head[c], p, sizeof(void*));
+    memcpy(p, &dst->head[c], sizeof(void*));
+    dst->head[c] = p;
+  }
+  src->count[c] -= i;
+  dst->count[c] += i;
+  return i;
+}
+
+void* mmapio_pool_pop(struct mmapio_pool_list* list, unsigned int c) {
+  void* const p = list->head[c];
+  if (p != NULL) {
+    memcpy(&list->head[c], p, sizeof(void*));
+    list->count[c] -= 1u;
+  }
+  return p;
+}
+
+void mmapio_pool_push
+  (struct mmapio_pool_list* list, unsigned int c, void* p)
+{
+  memcpy(p, &list->head[c], sizeof(void*));
+  list->head[c] = p;
+  list->count[c] += 1u;
+  return;
+}
+
+#if (defined MMAPIO_THREAD_LOCAL)
+struct mmapio_pool_list* mmapio_pool_cache(void) {
+  if (mmapio_pool_bound == 0) {
+    int keyed;
+    mmapio_pool_lock();
+    if (mmapio_pool_keyed == 0) {
+#  if MMAPIO_OS == MMAPIO_OS_UNIX
+      mmapio_pool_keyed =
+        (pthread_key_create(&mmapio_pool_key, &mmapio_pool_exit) == 0)
+        ? 1 : -1;
+#  else
+      mmapio_pool_fls = FlsAlloc(&mmapio_pool_exit_fls);
+      mmapio_pool_keyed = (mmapio_pool_fls != FLS_OUT_OF_INDEXES) ? 1 : -1;
+#  endif /*MMAPIO_OS*/
+    }
+    keyed = mmapio_pool_keyed;
+    mmapio_pool_unlock();
+    /* without a hook, cached blocks would be lost at thread exit */
+#  if MMAPIO_OS == MMAPIO_OS_UNIX
+    mmapio_pool_bound = (keyed > 0
+      &&  pthread_setspecific(mmapio_pool_key, &mmapio_pool_local) == 0)
+      ? 1 : -1;
+#  else
+    mmapio_pool_bound = (keyed > 0
+      &&  FlsSetValue(mmapio_pool_fls, &mmapio_pool_local))
+      ? 1 : -1;
+#  endif /*MMAPIO_OS*/
+  }
+  return (mmapio_pool_bound > 0) ? &mmapio_pool_local : NULL;
+}
+
+void mmapio_pool_exit(void* list) {
+  struct mmapio_pool_list* const local = (struct mmapio_pool_list*)list;
+  unsigned int c;
+  /* any later frees on this thread go to the shared blocks */
+  mmapio_pool_bound = -1;
+  mmapio_pool_lock();
+  for (c = 0u; c < MMAPIO_POOL_CLASSES; ++c)
+    mmapio_pool_move(&mmapio_pool_shared, local, c, local->count[c]);
+  mmapio_pool_unlock();
+  return;
+}
+
+#  if MMAPIO_OS == MMAPIO_OS_WIN32
+VOID WINAPI mmapio_pool_exit_fls(PVOID list) {
+  if (list != NULL)
+    mmapio_pool_exit(list);
+  return;
+}
+#  endif /*MMAPIO_OS*/
+#endif /*MMAPIO_THREAD_LOCAL*/
 /* END   static functions */
 
 /* BEGIN error handling */
@@ -826,6 +1642,343 @@ size_t mmapio_length(struct mmapio_i const* m) {
 }
 /* END   helper functions */
 
+/* BEGIN parallel execution */
+void mmapio_exec_run(struct mmapio_exec const* ex, size_t n,
+    mmapio_task_fn fn, void* arg)
+{
+  if (ex != NULL) {
+    (*ex).run(ex, n, fn, arg);
+  } else {
+    size_t i;
+    for (i = 0; i < n; ++i) {
+      fn(arg, i);
+    }
+  }
+  return;
+}
+/* END   parallel execution */
+
+/* BEGIN handle pool */
+void* mmapio_pool_alloc(size_t sz) {
+  unsigned int const c = (unsigned int)((sz+63u)/64u);
+  struct mmapio_pool_list* list = NULL;
+  void* p;
+  if (sz == 0u || c > MMAPIO_POOL_CLASSES)
+    return calloc(1, sz ? sz : 1u);
+#if (defined MMAPIO_THREAD_LOCAL)
+  list = mmapio_pool_cache();
+#endif /*MMAPIO_THREAD_LOCAL*/
+  if (list != NULL) {
+    if (list->head[c-1u] == NULL) {
+      /* refill half a cache from the shared blocks */
+      mmapio_pool_lock();
+      mmapio_pool_move(list, &mmapio_pool_shared, c-1u,
+          MMAPIO_POOL_CACHE/2u);
+      mmapio_pool_unlock();
+    }
+    p = mmapio_pool_pop(list, c-1u);
+  } else {
+    mmapio_pool_lock();
+    p = mmapio_pool_pop(&mmapio_pool_shared, c-1u);
+    mmapio_pool_unlock();
+  }
+  if (p == NULL)
+    return calloc(1, c*64u);
+  memset(p, 0, c*64u);
+  return p;
+}
+
+void mmapio_pool_free(void* p, size_t sz) {
+  unsigned int const c = (unsigned int)((sz+63u)/64u);
+  struct mmapio_pool_list* list = NULL;
+  if (p == NULL)
+    return;
+  else if (sz == 0u || c > MMAPIO_POOL_CLASSES) {
+    free(p);
+    return;
+  }
+#if (defined MMAPIO_THREAD_LOCAL)
+  list = mmapio_pool_cache();
+#endif /*MMAPIO_THREAD_LOCAL*/
+  if (list != NULL) {
+    mmapio_pool_push(list, c-1u, p);
+    if (list->count[c-1u] > MMAPIO_POOL_CACHE) {
+      /* hand half the cache to other threads */
+      mmapio_pool_lock();
+      mmapio_pool_move(&mmapio_pool_shared, list, c-1u,
+          MMAPIO_POOL_CACHE/2u);
+      mmapio_pool_unlock();
+    }
+  } else {
+    mmapio_pool_lock();
+    mmapio_pool_push(&mmapio_pool_shared, c-1u, p);
+    mmapio_pool_unlock();
+  }
+  return;
+}
+
+void mmapio_pool_trim(void) {
+  struct mmapio_pool_list drop;
+  unsigned int c;
+  memset(&drop, 0, sizeof(drop));
+  mmapio_pool_lock();
+  for (c = 0u; c < MMAPIO_POOL_CLASSES; ++c) {
+    drop.head[c] = mmapio_pool_shared.head[c];
+    mmapio_pool_shared.head[c] = NULL;
+    mmapio_pool_shared.count[c] = 0u;
+  }
+  mmapio_pool_unlock();
+  for (c = 0u; c < MMAPIO_POOL_CLASSES; ++c) {
+#if (defined MMAPIO_THREAD_LOCAL)
+    void* q = mmapio_pool_local.head[c];
+    mmapio_pool_local.head[c] = NULL;
+    mmapio_pool_local.count[c] = 0u;
+    while (q != NULL) {
+      void* const p = q;
+      memcpy(&q, p, sizeof(void*));
+      free(p);
+    }
+#endif /*MMAPIO_THREAD_LOCAL*/
+    while (drop.head[c] != NULL) {
+      void* const p = drop.head[c];
+      memcpy(&drop.head[c], p, sizeof(void*));
+      free(p);
+    }
+  }
+  return;
+}
+/* END   handle pool */
+
+/* BEGIN tracing */
+void mmapio_set_trace(struct mmapio_trace const* t) {
+  mmapio_trace_hooks = t;
+  return;
+}
+
+char const* mmapio_trace_name(int op) {
+  switch (op) {
+  case mmapio_trace_open:  return "open";
+  case mmapio_trace_fcntl: return "fcntl";
+  case mmapio_trace_stat:  return "stat";
+  case mmapio_trace_alloc: return "alloc";
+  case mmapio_trace_map:   return "map";
+  case mmapio_trace_remap: return "remap";
+  case mmapio_trace_unmap: return "unmap";
+  case mmapio_trace_close: return "close";
+  case mmapio_trace_sync:  return "sync";
+  case mmapio_trace_rename: return "rename";
+  default: return "?";
+  }
+}
+/* END   tracing */
+
+/* BEGIN page cache */
+#if MMAPIO_OS == MMAPIO_OS_UNIX
+size_t mmapio_page_size(void) {
+  long const xpsize = sysconf(_SC_PAGE_SIZE);
+  return (xpsize > 0) ? (size_t)xpsize : 4096u;
+}
+
+size_t mmapio_residency
+  (struct mmapio_i* m, size_t off, size_t len, unsigned char* vec)
+{
+  size_t const psize = mmapio_page_size();
+  void* p;
+  unsigned char* const start = mmapio_page_span(m, off, &len, &p);
+  size_t count = 0u;
+  size_t pos;
+  if (start == NULL)
+    return (size_t)-1;
+  for (pos = 0u; pos < len; ) {
+    unsigned char buf[256];
+    size_t const n = (len-pos)/psize < sizeof(buf)
+      ? (len-pos)/psize : sizeof(buf);
+    size_t i;
+    if (mincore((void*)(start+pos), n*psize, (void*)buf) != 0) {
+      int const err = errno;
+      mmapio_release(m, p);
+      errno = err;
+      return (size_t)-1;
+    }
+    for (i = 0u; i < n; ++i) {
+      buf[i] &= 1u;
+      count += buf[i];
+    }
+    if (vec != NULL) {
+      memcpy(vec+pos/psize, buf, n);
+    }
+    pos += n*psize;
+  }
+  mmapio_release(m, p);
+  return count;
+}
+
+int mmapio_advise(struct mmapio_i* m, size_t off, size_t len, int advice) {
+  void* p;
+  unsigned char* const start = mmapio_page_span(m, off, &len, &p);
+  struct mmapio_unix const* mu = NULL;
+  off_t fileoff = 0;
+  int res = 0;
+  if (start == NULL)
+    return -1;
+  if (m->mmi_dtor == &mmapio_mmi_dtor) {
+    /* a file mapping from this library, so the page cache is reachable */
+    mu = (struct mmapio_unix const*)m;
+    if (mu->fd == -1)
+      mu = NULL;
+    else fileoff = mu->fulloff + (off_t)(start-(unsigned char*)mu->ptr);
+  }
+  switch (advice) {
+  case mmapio_advice_normal:
+    res = madvise(start, len, MADV_NORMAL);
+    break;
+  case mmapio_advice_sequential:
+    res = madvise(start, len, MADV_SEQUENTIAL);
+    break;
+  case mmapio_advice_random:
+    res = madvise(start, len, MADV_RANDOM);
+    break;
+  case mmapio_advice_willneed:
+    /* starts readahead in the background */
+    res = madvise(start, len, MADV_WILLNEED);
+#if (defined POSIX_FADV_WILLNEED)
+    if (res == 0 && mu != NULL) {
+      res = posix_fadvise(mu->fd, fileoff, (off_t)len, POSIX_FADV_WILLNEED);
+      if (res != 0) {
+        errno = res;
+        res = -1;
+      }
+    }
+#endif /*POSIX_FADV_WILLNEED*/
+    break;
+  case mmapio_advice_dontneed:
+    res = madvise(start, len, MADV_DONTNEED);
+    break;
+  case mmapio_advice_evict:
+    /* pages still mapped here would stay in the cache */
+    res = madvise(start, len, MADV_DONTNEED);
+    if (res != 0) {
+      break;
+    }
+#if (defined POSIX_FADV_DONTNEED)
+    else if (mu != NULL) {
+      res = posix_fadvise(mu->fd, fileoff, (off_t)len, POSIX_FADV_DONTNEED);
+      if (res != 0) {
+        errno = res;
+        res = -1;
+      }
+      break;
+    }
+#endif /*POSIX_FADV_DONTNEED*/
+#if (defined MADV_PAGEOUT)
+    res = madvise(start, len, MADV_PAGEOUT);
+#else
+#  if (defined ENOSYS)
+    errno = ENOSYS;
+#  else
+    errno = EDOM;
+#  endif /*ENOSYS*/
+    res = -1;
+#endif /*MADV_PAGEOUT*/
+    break;
+  case mmapio_advice_lock:
+    res = mlock(start, len);
+    break;
+  case mmapio_advice_unlock:
+    res = munlock(start, len);
+    break;
+  default:
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    res = -1;
+    break;
+  }
+  /* keep the error past the release */{
+    int const err = errno;
+    mmapio_release(m, p);
+    errno = err;
+  }
+  return res == 0 ? 0 : -1;
+}
+#elif MMAPIO_OS == MMAPIO_OS_WIN32
+size_t mmapio_page_size(void) {
+  SYSTEM_INFO s_info;
+  GetSystemInfo(&s_info);
+  return s_info.dwPageSize;
+}
+
+size_t mmapio_residency
+  (struct mmapio_i* m, size_t off, size_t len, unsigned char* vec)
+{
+  /* not yet available */
+#if (defined ENOSYS)
+  errno = ENOSYS;
+#else
+  errno = EDOM;
+#endif /*ENOSYS*/
+  return (size_t)-1;
+}
+
+int mmapio_advise(struct mmapio_i* m, size_t off, size_t len, int advice) {
+  void* p;
+  unsigned char* const start = mmapio_page_span(m, off, &len, &p);
+  int res = 0;
+  if (start == NULL)
+    return -1;
+  switch (advice) {
+  case mmapio_advice_normal:
+  case mmapio_advice_sequential:
+  case mmapio_advice_random:
+  case mmapio_advice_willneed:
+  case mmapio_advice_dontneed:
+    /* hints without a counterpart here */
+    break;
+  case mmapio_advice_evict:
+    /* unlocking unlocked pages drops them from the working set */
+    if (!VirtualUnlock(start, len) && GetLastError() != ERROR_NOT_LOCKED)
+      res = -1;
+    break;
+  case mmapio_advice_lock:
+    res = VirtualLock(start, len) ? 0 : -1;
+    break;
+  case mmapio_advice_unlock:
+    res = VirtualUnlock(start, len) ? 0 : -1;
+    break;
+  default:
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    res = -1;
+    break;
+  }
+  mmapio_release(m, p);
+  return res;
+}
+#else
+size_t mmapio_page_size(void) {
+  /* no-op */
+  return 0u;
+}
+
+size_t mmapio_residency
+  (struct mmapio_i* m, size_t off, size_t len, unsigned char* vec)
+{
+  /* no-op */
+  return (size_t)-1;
+}
+
+int mmapio_advise(struct mmapio_i* m, size_t off, size_t len, int advice) {
+  /* no-op */
+  return -1;
+}
+#endif /*MMAPIO_OS*/
+/* END   page cache */
+
 /* BEGIN open functions */
 #if MMAPIO_OS == MMAPIO_OS_UNIX
 struct mmapio_i* mmapio_open
@@ -833,7 +1986,10 @@ struct mmapio_i* mmapio_open
 {
   int fd;
   struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
+  mmapio_u64 t0 = 0u;
+  mmapio_trace_begin(mmapio_trace_open, &t0);
   fd = open(nm, mmapio_mode_rw_cvt(mt.mode));
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == -1);
   if (fd == -1) {
     /* can't open file, so */return NULL;
   }
@@ -845,7 +2001,10 @@ struct mmapio_i* mmapio_u8open
 {
   int fd;
   struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
+  mmapio_u64 t0 = 0u;
+  mmapio_trace_begin(mmapio_trace_open, &t0);
   fd = open((char const*)nm, mmapio_mode_rw_cvt(mt.mode));
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == -1);
   if (fd == -1) {
     /* can't open file, so */return NULL;
   }
@@ -858,18 +2017,189 @@ struct mmapio_i* mmapio_wopen
   int fd;
   struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
   char* const mbfn = mmapio_wctomb(nm);
+  mmapio_u64 t0 = 0u;
   if (mbfn == NULL) {
     /* conversion failure, so give up */
     free(mbfn);
     return NULL;
   }
+  mmapio_trace_begin(mmapio_trace_open, &t0);
   fd = open(mbfn, mmapio_mode_rw_cvt(mt.mode));
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == -1);
   free(mbfn);
   if (fd == -1) {
     /* can't open file, so */return NULL;
   }
   return mmapio_open_rest(fd, mt, sz, off);
 }
+
+struct mmapio_i* mmapio_shm_open
+  (char const* nm, char const* mode, size_t sz)
+{
+  int fd;
+  struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
+  int const flags = mmapio_mode_shm_cvt(mt);
+  struct mmapio_i* out;
+  mmapio_u64 t0 = 0u;
+  if (flags == -1) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return NULL;
+  }
+  mmapio_trace_begin(mmapio_trace_open, &t0);
+  fd = shm_open(nm, flags, 0644);
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == -1);
+  if (fd == -1) {
+    /* can't open segment, so */return NULL;
+  }
+  if (mt.mode == mmapio_mode_write && !mt.end
+  &&  mmapio_file_size_e(fd) < sz
+  &&  ftruncate(fd, (off_t)sz) != 0)
+  {
+    int const err = errno;
+    close(fd);
+    if (mt.excl)
+      shm_unlink(nm);
+    errno = err;
+    return NULL;
+  }
+  out = mmapio_open_rest(fd, mt, sz, 0);
+  if (out == NULL && mt.excl) {
+    /* let another publisher try again */
+    int const err = errno;
+    shm_unlink(nm);
+    errno = err;
+  }
+  return out;
+}
+
+int mmapio_shm_unlink(char const* nm) {
+  return shm_unlink(nm);
+}
+
+struct mmapio_i* mmapio_concat_open
+  (char const* const* nms, size_t count, char const* mode)
+{
+  struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
+  struct mmapio_unix* out;
+  int* fds;
+  size_t* sizes;
+  size_t total = 0u;
+  size_t exposed = 0u;
+  size_t i;
+  size_t psize;
+  unsigned char* base;
+  mmapio_u64 t0 = 0u;
+  /* get the page size */{
+    long const xpsize = sysconf(_SC_PAGE_SIZE);
+    psize = (xpsize > 0) ? (size_t)xpsize : 4096u;
+  }
+  if (count == 0u || count > (~(size_t)0u)/sizeof(size_t)) {
+    errno = ERANGE;
+    return NULL;
+  }
+  fds = (int*)calloc(count, sizeof(int));
+  sizes = (size_t*)calloc(count, sizeof(size_t));
+  out = (struct mmapio_unix*)mmapio_pool_alloc(sizeof(struct mmapio_unix));
+  if (fds == NULL || sizes == NULL || out == NULL) {
+    mmapio_pool_free(out, sizeof(*out));
+    free(sizes);
+    free(fds);
+    return NULL;
+  }
+  /* open the files and measure the range */
+  for (i = 0u; i < count; ++i) {
+    mmapio_trace_begin(mmapio_trace_open, &t0);
+    fds[i] = open(nms[i], mmapio_mode_rw_cvt(mt.mode));
+    mmapio_trace_end(mmapio_trace_open, t0, 0u, fds[i] == -1);
+    if (fds[i] == -1)
+      break;
+    sizes[i] = mmapio_file_size_e(fds[i]);
+    if (sizes[i] > 0u) {
+      size_t const padded = ((sizes[i]-1u)/psize + 1u)*psize;
+      if (padded < sizes[i] || padded > (~(size_t)0u) - total) {
+        close(fds[i]);
+        errno = ERANGE;
+        break;
+      }
+      exposed = total + sizes[i];
+      total += padded;
+    }
+  }
+  if (i == count && total == 0u) {
+    errno = ERANGE;
+  } else if (i == count) /* reserve the range, then place the files */{
+#if (defined MAP_ANONYMOUS)
+    int const anon = MAP_ANONYMOUS;
+#else
+    int const anon = MAP_ANON;
+#endif /*MAP_ANONYMOUS*/
+    size_t pos = 0u;
+    mmapio_trace_begin(mmapio_trace_map, &t0);
+    base = (unsigned char*)mmap(NULL, total, PROT_NONE,
+        MAP_PRIVATE|anon, -1, 0);
+    mmapio_trace_end(mmapio_trace_map, t0, total,
+        base == (unsigned char*)MAP_FAILED);
+    if (base == (unsigned char*)MAP_FAILED) {
+      base = NULL;
+    } else for (i = 0u; i < count; ++i) {
+      void* fixed;
+      if (sizes[i] == 0u)
+        continue;
+      mmapio_trace_begin(mmapio_trace_map, &t0);
+      fixed = mmap(base+pos, sizes[i], mmapio_mode_prot_cvt(mt.mode),
+          mmapio_mode_flag_cvt(mt.privy)|MAP_FIXED, fds[i], 0);
+      mmapio_trace_end(mmapio_trace_map, t0, sizes[i], fixed == MAP_FAILED);
+      if (fixed == MAP_FAILED) {
+        int const err = errno;
+        munmap(base, total);
+        base = NULL;
+        errno = err;
+        break;
+      }
+      pos += ((sizes[i]-1u)/psize + 1u)*psize;
+    }
+    /* the mappings keep the files alive */
+    for (i = 0u; i < count; ++i) {
+      close(fds[i]);
+    }
+    free(sizes);
+    free(fds);
+    if (base == NULL) {
+      mmapio_pool_free(out, sizeof(*out));
+      return NULL;
+    }
+    /* initialize the interface */{
+      out->ptr = base;
+      /* unmapping rounds up to whole pages, so this releases `total` */
+      out->len = exposed;
+      out->fd = -1;
+      out->shift = 0u;
+      out->fulloff = 0;
+      out->mt = mt;
+      out->base.mmi_dtor = &mmapio_mmi_dtor;
+      out->base.mmi_acquire = &mmapio_mmi_acquire;
+      out->base.mmi_release = &mmapio_mmi_release;
+      out->base.mmi_length = &mmapio_mmi_length;
+    }
+    return (struct mmapio_i*)out;
+  }
+  /* clean up after failure */{
+    int const err = errno;
+    size_t j;
+    for (j = 0u; j < i; ++j) {
+      close(fds[j]);
+    }
+    mmapio_pool_free(out, sizeof(*out));
+    free(sizes);
+    free(fds);
+    errno = err;
+    return NULL;
+  }
+}
 #elif MMAPIO_OS == MMAPIO_OS_WIN32
 struct mmapio_i* mmapio_open
   (char const* nm, char const* mode, size_t sz, size_t off)
@@ -877,10 +2207,12 @@ struct mmapio_i* mmapio_open
   HANDLE fd;
   struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
   SECURITY_ATTRIBUTES cfsa;
+  mmapio_u64 t0 = 0u;
   memset(&cfsa, 0, sizeof(cfsa));
   cfsa.nLength = sizeof(cfsa);
   cfsa.lpSecurityDescriptor = NULL;
   cfsa.bInheritHandle = (BOOL)(mt.bequeath ? TRUE : FALSE);
+  mmapio_trace_begin(mmapio_trace_open, &t0);
   fd = CreateFileA(
       nm, mmapio_mode_rw_cvt(mt.mode),
       FILE_SHARE_READ|FILE_SHARE_WRITE,
@@ -889,6 +2221,7 @@ struct mmapio_i* mmapio_open
       FILE_ATTRIBUTE_NORMAL,
       NULL
     );
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == INVALID_HANDLE_VALUE);
   if (fd == INVALID_HANDLE_VALUE) {
     /* can't open file, so */return NULL;
   }
@@ -902,6 +2235,7 @@ struct mmapio_i* mmapio_u8open
   struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
   wchar_t* const wcfn = mmapio_u8towc(nm);
   SECURITY_ATTRIBUTES cfsa;
+  mmapio_u64 t0 = 0u;
   memset(&cfsa, 0, sizeof(cfsa));
   cfsa.nLength = sizeof(cfsa);
   cfsa.lpSecurityDescriptor = NULL;
@@ -910,6 +2244,7 @@ struct mmapio_i* mmapio_u8open
     /* conversion failure, so give up */
     return NULL;
   }
+  mmapio_trace_begin(mmapio_trace_open, &t0);
   fd = CreateFileW(
       wcfn, mmapio_mode_rw_cvt(mt.mode),
       FILE_SHARE_READ|FILE_SHARE_WRITE,
@@ -918,6 +2253,7 @@ struct mmapio_i* mmapio_u8open
       FILE_ATTRIBUTE_NORMAL,
       NULL
     );
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == INVALID_HANDLE_VALUE);
   free(wcfn);
   if (fd == INVALID_HANDLE_VALUE) {
     /* can't open file, so */return NULL;
@@ -931,10 +2267,12 @@ struct mmapio_i* mmapio_wopen
   HANDLE fd;
   struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
   SECURITY_ATTRIBUTES cfsa;
+  mmapio_u64 t0 = 0u;
   memset(&cfsa, 0, sizeof(cfsa));
   cfsa.nLength = sizeof(cfsa);
   cfsa.lpSecurityDescriptor = NULL;
   cfsa.bInheritHandle = (BOOL)(mt.bequeath ? TRUE : FALSE);
+  mmapio_trace_begin(mmapio_trace_open, &t0);
   fd = CreateFileW(
       nm, mmapio_mode_rw_cvt(mt.mode),
       FILE_SHARE_READ|FILE_SHARE_WRITE,
@@ -943,11 +2281,112 @@ struct mmapio_i* mmapio_wopen
       FILE_ATTRIBUTE_NORMAL,
       NULL
     );
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == INVALID_HANDLE_VALUE);
   if (fd == INVALID_HANDLE_VALUE) {
     /* can't open file, so */return NULL;
   }
   return mmapio_open_rest(fd, mt, sz, off);
 }
+
+struct mmapio_i* mmapio_shm_open
+  (char const* nm, char const* mode, size_t sz)
+{
+  HANDLE fmd;
+  void* ptr;
+  struct mmapio_mode_tag const mt = mmapio_mode_parse(mode);
+  struct mmapio_win32* out;
+  SECURITY_ATTRIBUTES cfsa;
+  memset(&cfsa, 0, sizeof(cfsa));
+  cfsa.nLength = sizeof(cfsa);
+  cfsa.lpSecurityDescriptor = NULL;
+  cfsa.bInheritHandle = (BOOL)(mt.bequeath ? TRUE : FALSE);
+  if (mt.mode == mmapio_mode_write) {
+    if (sz == 0) {
+#if (defined EINVAL)
+      errno = EINVAL;
+#else
+      errno = EDOM;
+#endif /*EINVAL*/
+      return NULL;
+    }
+    fmd = CreateFileMappingA(
+        INVALID_HANDLE_VALUE, /*hFile*/
+        &cfsa, /*lpFileMappingAttributes*/
+        PAGE_READWRITE, /*flProtect*/
+        (DWORD)((sz>>32)&0xFFffFFff), /*dwMaximumSizeHigh*/
+        (DWORD)(sz&0xFFffFFff), /*dwMaximumSizeLow*/
+        nm /*lpName*/
+      );
+    if (fmd != NULL && mt.excl && GetLastError() == ERROR_ALREADY_EXISTS) {
+      CloseHandle(fmd);
+      errno = EEXIST;
+      return NULL;
+    }
+  } else if (mt.mode == mmapio_mode_read && !mt.excl) {
+    fmd = OpenFileMappingA(FILE_MAP_READ, cfsa.bInheritHandle, nm);
+  } else {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return NULL;
+  }
+  if (fmd == NULL) {
+    /* can't open segment, so */return NULL;
+  }
+  out = mmapio_pool_alloc(sizeof(struct mmapio_win32));
+  if (out == NULL) {
+    CloseHandle(fmd);
+    return NULL;
+  }
+  ptr = MapViewOfFile(fmd, mmapio_mode_access_cvt(mt), 0, 0,
+      (SIZE_T)(mt.end ? 0 : sz));
+  if (ptr == NULL) {
+    CloseHandle(fmd);
+    mmapio_pool_free(out, sizeof(*out));
+    return NULL;
+  }
+  if (mt.end) /* fix map size */{
+    MEMORY_BASIC_INFORMATION mbi;
+    if (VirtualQuery(ptr, &mbi, sizeof(mbi)) == 0) {
+      UnmapViewOfFile(ptr);
+      CloseHandle(fmd);
+      mmapio_pool_free(out, sizeof(*out));
+      return NULL;
+    }
+    sz = (size_t)mbi.RegionSize;
+  }
+  /* initialize the interface */{
+    out->ptr = ptr;
+    out->len = sz;
+    out->fd = NULL;
+    out->fmd = fmd;
+    out->shift = 0;
+    out->base.mmi_dtor = &mmapio_mmi_dtor;
+    out->base.mmi_acquire = &mmapio_mmi_acquire;
+    out->base.mmi_release = &mmapio_mmi_release;
+    out->base.mmi_length = &mmapio_mmi_length;
+  }
+  return (struct mmapio_i*)out;
+}
+
+int mmapio_shm_unlink(char const* nm) {
+  /* named mappings vanish with their last handle */
+  return 0;
+}
+
+struct mmapio_i* mmapio_concat_open
+  (char const* const* nms, size_t count, char const* mode)
+{
+  /* not yet available */
+#if (defined ENOSYS)
+  errno = ENOSYS;
+#else
+  errno = EDOM;
+#endif /*ENOSYS*/
+  return NULL;
+}
 #else
 struct mmapio_i* mmapio_open
   (char const* nm, char const* mode, size_t sz, size_t off)
@@ -969,6 +2408,242 @@ struct mmapio_i* mmapio_wopen
   /* no-op */
   return NULL;
 }
+
+struct mmapio_i* mmapio_shm_open
+  (char const* nm, char const* mode, size_t sz)
+{
+  /* no-op */
+  return NULL;
+}
+
+int mmapio_shm_unlink(char const* nm) {
+  /* no-op */
+  return -1;
+}
+
+struct mmapio_i* mmapio_concat_open
+  (char const* const* nms, size_t count, char const* mode)
+{
+  /* no-op */
+  return NULL;
+}
 #endif /*MMAPIO_OS*/
 /* END   open functions */
 
+/* BEGIN publish functions */
+#if MMAPIO_OS == MMAPIO_OS_UNIX
+struct mmapio_i* mmapio_publish_open(char const* nm, size_t sz) {
+  /* an empty version maps nothing, like a followed empty file */
+  struct mmapio_mode_tag const mt = mmapio_mode_parse(sz ? "w" : "wf");
+  size_t const nmlen = strlen(nm);
+  char* const tmp = (char*)malloc(nmlen+8u);
+  char* const dst = (char*)malloc(nmlen+1u);
+  struct mmapio_unix* out;
+  int fd;
+  mmapio_u64 t0 = 0u;
+  if (tmp == NULL || dst == NULL) {
+    free(dst);
+    free(tmp);
+    return NULL;
+  }
+  memcpy(dst, nm, nmlen+1u);
+  memcpy(tmp, nm, nmlen);
+  memcpy(tmp+nmlen, ".XXXXXX", 8u);
+  /* same directory, so the rename stays on one file system */
+  mmapio_trace_begin(mmapio_trace_open, &t0);
+  fd = mkstemp(tmp);
+  mmapio_trace_end(mmapio_trace_open, t0, 0u, fd == -1);
+  if (fd == -1) {
+    free(dst);
+    free(tmp);
+    return NULL;
+  }
+  /* reserve the blocks up front */{
+    int res = 0;
+    if (fchmod(fd, 0644) != 0)
+      res = errno;
+    if (res == 0 && sz > 0u) {
+      res = posix_fallocate(fd, 0, (off_t)sz);
+      if (res == EINVAL || res == EOPNOTSUPP)
+        res = (ftruncate(fd, (off_t)sz) == 0) ? 0 : errno;
+    }
+    if (res != 0) {
+      close(fd);
+      unlink(tmp);
+      free(dst);
+      free(tmp);
+      errno = res;
+      return NULL;
+    }
+  }
+  out = (struct mmapio_unix*)mmapio_open_rest(fd, mt, sz, 0);
+  if (out == NULL) {
+    int const err = errno;
+    unlink(tmp);
+    free(dst);
+    free(tmp);
+    errno = err;
+    return NULL;
+  }
+  out->pub_tmp = tmp;
+  out->pub_dst = dst;
+  return (struct mmapio_i*)out;
+}
+
+int mmapio_publish_commit(struct mmapio_i* m, size_t len) {
+  struct mmapio_unix* const mu = (struct mmapio_unix*)m;
+  mmapio_u64 t0 = 0u;
+  int res;
+  if (m->mmi_dtor != &mmapio_mmi_dtor || mu->pub_tmp == NULL) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  /* flush the pages, then the file */
+  mmapio_trace_begin(mmapio_trace_sync, &t0);
+  res = (mu->ptr != NULL) ? msync(mu->ptr, mu->len, MS_SYNC) : 0;
+  if (res == 0 && len > 0u && len != mu->len-mu->shift) {
+    res = ftruncate(mu->fd, (off_t)len);
+    if (res == 0 && len < mu->len-mu->shift) {
+      /* unmap the whole pages now past the end of the file */
+      long const psize = sysconf(_SC_PAGE_SIZE);
+      size_t const end = len+mu->shift;
+      size_t const keep = (psize > 0)
+        ? ((end+(size_t)psize-1u)/(size_t)psize)*(size_t)psize
+        : mu->len;
+      if (keep < mu->len)
+        munmap((unsigned char*)mu->ptr+keep, mu->len-keep);
+      mu->len = end;
+    }
+  }
+  if (res == 0)
+    res = fsync(mu->fd);
+  mmapio_trace_end(mmapio_trace_sync, t0, mu->len, res != 0);
+  if (res != 0)
+    return -1;
+  mmapio_trace_begin(mmapio_trace_rename, &t0);
+  res = rename(mu->pub_tmp, mu->pub_dst);
+  mmapio_trace_end(mmapio_trace_rename, t0, 0u, res != 0);
+  if (res != 0)
+    return -1;
+  free(mu->pub_tmp);
+  mu->pub_tmp = NULL;
+  /* make the rename itself durable */
+  mmapio_trace_begin(mmapio_trace_sync, &t0);
+  res = mmapio_unix_sync_dir(mu->pub_dst);
+  mmapio_trace_end(mmapio_trace_sync, t0, 0u, res != 0);
+  return res;
+}
+#elif MMAPIO_OS == MMAPIO_OS_WIN32
+struct mmapio_i* mmapio_publish_open(char const* nm, size_t sz) {
+  /* not yet available */
+#if (defined ENOSYS)
+  errno = ENOSYS;
+#else
+  errno = EDOM;
+#endif /*ENOSYS*/
+  return NULL;
+}
+
+int mmapio_publish_commit(struct mmapio_i* m, size_t len) {
+  /* not yet available */
+#if (defined ENOSYS)
+  errno = ENOSYS;
+#else
+  errno = EDOM;
+#endif /*ENOSYS*/
+  return -1;
+}
+#else
+struct mmapio_i* mmapio_publish_open(char const* nm, size_t sz) {
+  /* no-op */
+  return NULL;
+}
+
+int mmapio_publish_commit(struct mmapio_i* m, size_t len) {
+  /* no-op */
+  return -1;
+}
+#endif /*MMAPIO_OS*/
+/* END   publish functions */
+
+/* BEGIN growth functions */
+#if MMAPIO_OS == MMAPIO_OS_UNIX
+int mmapio_extend(struct mmapio_i* m, size_t len) {
+  struct mmapio_unix* const mu = (struct mmapio_unix*)m;
+  size_t xsz;
+  size_t end;
+  int res;
+  if (m == NULL || m->mmi_dtor != &mmapio_mmi_dtor || mu->fd == -1
+  ||  mu->mt.mode != mmapio_mode_write
+  ||  !(mu->mt.follow || mu->mt.reserve))
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (mu->mt.lazy && mmapio_unix_settle(mu) != 0)
+    return -1;
+  if (len <= mu->len-mu->shift)
+    return 0;
+  if ((mu->cap > 0u && len > mu->cap-mu->shift)
+  ||  len > (~(size_t)0u)-mu->shift-(size_t)mu->fulloff)
+  {
+    errno = ERANGE;
+    return -1;
+  }
+  end = (size_t)mu->fulloff+mu->shift+len;
+  xsz = mmapio_file_size_e(mu->fd);
+  if (end > xsz) {
+    res = posix_fallocate(mu->fd, (off_t)xsz, (off_t)(end-xsz));
+    if (res == EINVAL || res == EOPNOTSUPP)
+      res = (ftruncate(mu->fd, (off_t)end) == 0) ? 0 : errno;
+    if (res != 0) {
+      errno = res;
+      return -1;
+    }
+  }
+  return mmapio_unix_grow(mu, mu->shift+len);
+}
+
+size_t mmapio_capacity(struct mmapio_i const* m) {
+  struct mmapio_unix const* const mu = (struct mmapio_unix const*)m;
+  if (m == NULL || m->mmi_dtor != &mmapio_mmi_dtor || !mu->mt.reserve)
+    return 0u;
+  /* a lazy instance reserves its range on first use */
+  return (mu->cap > 0u) ? mu->cap-mu->shift : mu->req_sz;
+}
+#elif MMAPIO_OS == MMAPIO_OS_WIN32
+int mmapio_extend(struct mmapio_i* m, size_t len) {
+  /* not yet available */
+#if (defined ENOSYS)
+  errno = ENOSYS;
+#else
+  errno = EDOM;
+#endif /*ENOSYS*/
+  return -1;
+}
+
+size_t mmapio_capacity(struct mmapio_i const* m) {
+  /* not yet available */
+  return 0u;
+}
+#else
+int mmapio_extend(struct mmapio_i* m, size_t len) {
+  /* no-op */
+  return -1;
+}
+
+size_t mmapio_capacity(struct mmapio_i const* m) {
+  /* no-op */
+  return 0u;
+}
+#endif /*MMAPIO_OS*/
+/* END   growth functions */
+
@@ -7,6 +7,7 @@
 #define hg_MMapIO_mmapIo_H_
 
 #include <stddef.h>
+#include <limits.h>
 
 #ifdef MMAPIO_WIN32_DLL
 #  ifdef MMAPIO_WIN32_DLL_INTERNAL
@@ -18,6 +19,31 @@
 #  define MMAPIO_API
 #endif /*MMAPIO_WIN32_DLL*/
 
+/* BEGIN fixed-width integers */
+#if (defined __STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+#  include <stdint.h>
+typedef uint16_t mmapio_u16;
+typedef uint32_t mmapio_u32;
+typedef uint64_t mmapio_u64;
+#elif (defined _MSC_VER)
+typedef unsigned __int16 mmapio_u16;
+typedef unsigned __int32 mmapio_u32;
+typedef unsigned __int64 mmapio_u64;
+#else
+typedef unsigned short int mmapio_u16;
+#  if UINT_MAX == 0xFFFFFFFFu
+typedef unsigned int mmapio_u32;
+#  else
+typedef unsigned long int mmapio_u32;
+#  endif /*UINT_MAX*/
+#  if ULONG_MAX > 0xFFFFFFFFu
+typedef unsigned long int mmapio_u64;
+#  else
+__extension__ typedef unsigned long long int mmapio_u64;
+#  endif /*ULONG_MAX*/
+#endif /*__STDC_VERSION__*/
+/* END   fixed-width integers */
+
 #ifdef __cplusplus
 extern "C" {
 #endif /*__cplusplus*/
@@ -64,7 +90,67 @@ enum mmapio_mode {
    *   to return. Otherwise, the file descriptor of the mapped file
    *   may leak.
    */
-  mmapio_mode_bequeath = 0x71
+  mmapio_mode_bequeath = 0x71,
+
+  /**
+   * \brief Create a shared memory segment, failing if it exists.
+   * \note Only \link mmapio_shm_open \endlink accepts this flag,
+   *   together with 'w'.
+   */
+  mmapio_mode_exclusive = 0x78,
+
+  /**
+   * \brief Map until end of file, and follow the file as it grows.
+   * \note Each call to \link mmapio_acquire \endlink checks the file
+   *   size and extends the mapping over any new bytes. The returned
+   *   pointer may move when the mapping grows, so keep offsets rather
+   *   than pointers across calls. \link mmapio_length \endlink reports
+   *   the length seen by the latest acquire.
+   * \note A followed file may start out empty. Until it holds bytes
+   *   past the requested offset, acquire returns NULL.
+   * \note Handles in follow mode are not safe for concurrent use.
+   *   Truncating a followed file is not supported.
+   * \note On Windows, follow mode behaves like 'e'.
+   */
+  mmapio_mode_follow = 0x66,
+
+  /**
+   * \brief Reserve address space up front, so the mapping can grow
+   *   with its file without moving.
+   * \note With this flag, the size parameter of the open functions
+   *   gives the capacity: the largest length the mapping may reach.
+   *   The open functions reserve that much address space, and map
+   *   the part that the file covers. Like follow mode, each call to
+   *   \link mmapio_acquire \endlink then maps any new file bytes,
+   *   up to the capacity. The pointer returned by acquire never
+   *   changes, so mapped data structures may hold raw pointers.
+   * \note Bytes past the end of the file remain inaccessible until
+   *   the file grows to cover them.
+   * \note On Windows, this flag is ignored.
+   */
+  mmapio_mode_reserve = 0x76,
+
+  /**
+   * \brief Defer mapping until first use.
+   * \note The open functions only open the file and check the mode.
+   *   The first call to \link mmapio_acquire \endlink or
+   *   \link mmapio_length \endlink maps the file, exactly once, even
+   *   when several threads make that first call at the same time.
+   *   Errors that 'e' or the offset would cause at open time show up
+   *   then instead: acquire returns NULL and length returns zero.
+   * \note On Windows, this flag is ignored.
+   */
+  mmapio_mode_lazy = 0x6C,
+
+  /**
+   * \brief Keep the mapping out of child processes.
+   * \note After `fork`, the child has no mapping at this address, so
+   *   the fork copies no page tables for it. Unlike the absence of
+   *   'q', which only closes the file descriptor across `exec`, this
+   *   flag acts on the mapping itself.
+   * \note On Windows, this flag is ignored.
+   */
+  mmapio_mode_dontfork = 0x64
 };
 
 /**
@@ -164,13 +250,233 @@ MMAPIO_API
 size_t mmapio_length(struct mmapio_i const* m);
 /* END   helper functions */
 
+/* BEGIN parallel execution */
+/**
+ * \brief Task callback for parallel loops.
+ * \param arg task context
+ * \param i index of the task
+ */
+typedef void (*mmapio_task_fn)(void* arg, size_t i);
+
+/**
+ * \brief Executor for parallel loops, supplied by the caller.
+ * \note The library starts no threads of its own. Modules that can
+ *   split their work accept an executor, and the caller decides how
+ *   to run the pieces (thread pool, OpenMP, and so on).
+ */
+struct mmapio_exec {
+  /**
+   * \brief Run all tasks of a loop, then return.
+   * \param ex this executor
+   * \param n number of tasks
+   * \param fn task callback, to call once for each index in `[0, n)`
+   * \param arg task context to pass to `fn`
+   */
+  void (*run)(struct mmapio_exec const* ex, size_t n,
+      mmapio_task_fn fn, void* arg);
+};
+
+/**
+ * \brief Helper function runs a parallel loop.
+ * \param ex executor, or NULL to run the tasks in order on the
+ *   calling thread
+ * \param n number of tasks
+ * \param fn task callback
+ * \param arg task context
+ */
+MMAPIO_API
+void mmapio_exec_run(struct mmapio_exec const* ex, size_t n,
+    mmapio_task_fn fn, void* arg);
+/* END   parallel execution */
+
+/* BEGIN handle pool */
+/**
+ * \brief Allocate a small zeroed block from the handle pool.
+ * \param sz number of bytes needed
+ * \return a pointer to the block, or NULL on failure
+ * \note Blocks up to 1 KiB come from a cache kept by the calling
+ *   thread, refilled in batches from a cache shared by all threads,
+ *   so opening and closing maps in a steady state makes no calls to
+ *   the allocator. Larger blocks come from `calloc`.
+ * \note When a thread exits, its cache moves to the shared cache.
+ *   Where the system offers no hook at thread exit, every thread
+ *   uses the shared cache.
+ * \note Map handles, reload handles and the block views of
+ *   compressed containers come from here.
+ */
+MMAPIO_API
+void* mmapio_pool_alloc(size_t sz);
+
+/**
+ * \brief Return a block to the handle pool.
+ * \param p block from \link mmapio_pool_alloc \endlink, or NULL
+ * \param sz size passed to \link mmapio_pool_alloc \endlink for
+ *   the block
+ * \note Any thread may free a block. A thread cache that grows past
+ *   its limit hands half of its blocks to the shared cache.
+ */
+MMAPIO_API
+void mmapio_pool_free(void* p, size_t sz);
+
+/**
+ * \brief Give the pool's free blocks back to the allocator.
+ * \note Frees the calling thread's cache and the shared cache,
+ *   including the caches of threads that have exited. Calling this is
+ *   optional; it only returns memory sooner.
+ */
+MMAPIO_API
+void mmapio_pool_trim(void);
+/* END   handle pool */
+
+/* BEGIN page cache */
+/**
+ * \brief Access advice for \link mmapio_advise \endlink.
+ */
+enum mmapio_advice {
+  /** \brief default readahead */
+  mmapio_advice_normal = 0,
+  /** \brief aggressive readahead, early reclaim */
+  mmapio_advice_sequential = 1,
+  /** \brief no readahead */
+  mmapio_advice_random = 2,
+  /** \brief start reading the range in the background */
+  mmapio_advice_willneed = 3,
+  /**
+   * \brief drop the range from this mapping; private changes are lost
+   */
+  mmapio_advice_dontneed = 4,
+  /** \brief drop the range from this mapping and the page cache */
+  mmapio_advice_evict = 5,
+  /** \brief keep the range in memory */
+  mmapio_advice_lock = 6,
+  /** \brief undo \link mmapio_advice_lock \endlink */
+  mmapio_advice_unlock = 7
+};
+
+/**
+ * \brief Check the size of a memory page.
+ * \return a page size in bytes, or zero if unavailable
+ */
+MMAPIO_API
+size_t mmapio_page_size(void);
+
+/**
+ * \brief Check which pages of a map instance are in memory.
+ * \param m map instance
+ * \param off offset from the start of the mapped area
+ * \param len length to check, or zero for the rest of the area
+ * \param[out] vec one byte per page touching the range, set to 1 if
+ *   resident and 0 otherwise; needs at least
+ *   `len/mmapio_page_size()+2` bytes; may be NULL
+ * \return the number of resident pages on success, `(size_t)-1`
+ *   otherwise
+ * \note Not available on Win32.
+ */
+MMAPIO_API
+size_t mmapio_residency
+  (struct mmapio_i* m, size_t off, size_t len, unsigned char* vec);
+
+/**
+ * \brief Give the system advice about part of a map instance.
+ * \param m map instance
+ * \param off offset from the start of the mapped area
+ * \param len length of the part, or zero for the rest of the area
+ * \param advice a \link mmapio_advice \endlink value
+ * \return zero on success, -1 otherwise
+ * \note The range grows to whole pages. Eviction reaches the page
+ *   cache for files opened with \link mmapio_open \endlink and
+ *   similar; on Win32, it only trims the working set. Win32 accepts
+ *   the readahead hints without acting on them.
+ */
+MMAPIO_API
+int mmapio_advise(struct mmapio_i* m, size_t off, size_t len, int advice);
+/* END   page cache */
+
+/* BEGIN tracing */
+/**
+ * \brief System calls reported to trace hooks.
+ */
+enum mmapio_trace_op {
+  /** \brief opening a file, segment, or mapping object */
+  mmapio_trace_open = 1,
+  /** \brief adjusting descriptor flags */
+  mmapio_trace_fcntl = 2,
+  /** \brief checking a file's size */
+  mmapio_trace_stat = 3,
+  /** \brief allocating a map instance */
+  mmapio_trace_alloc = 4,
+  /** \brief mapping or reserving a range */
+  mmapio_trace_map = 5,
+  /** \brief resizing an existing mapping */
+  mmapio_trace_remap = 6,
+  /** \brief unmapping a range */
+  mmapio_trace_unmap = 7,
+  /** \brief closing a file descriptor or handle */
+  mmapio_trace_close = 8,
+  /** \brief flushing a mapping, file, or directory to storage */
+  mmapio_trace_sync = 9,
+  /** \brief renaming a file into place */
+  mmapio_trace_rename = 10
+};
+
+/**
+ * \brief Trace hooks, supplied by the caller.
+ * \note Embed this structure in a larger one to carry context into
+ *   the hooks. Either hook may be NULL.
+ */
+struct mmapio_trace {
+  /**
+   * \brief Called before a system call.
+   * \param t these hooks
+   * \param op a \link mmapio_trace_op \endlink value
+   */
+  void (*before)(struct mmapio_trace const* t, int op);
+  /**
+   * \brief Called after a system call.
+   * \param t these hooks
+   * \param op a \link mmapio_trace_op \endlink value
+   * \param ns time spent in the call, in nanoseconds
+   * \param size number of bytes involved, or zero
+   * \param err zero on success; otherwise the `errno` value, or the
+   *   `GetLastError` value on Win32
+   */
+  void (*after)(struct mmapio_trace const* t, int op,
+      mmapio_u64 ns, size_t size, int err);
+};
+
+/**
+ * \brief Install trace hooks for the whole library.
+ * \param t hooks to install, or NULL to remove the current hooks;
+ *   must outlive their installation
+ * \note Install hooks before opening any maps; the hooks are not
+ *   synchronized with calls already running. When no hooks are
+ *   installed, the library reads no clocks.
+ * \note Builds configured with `MMAPIO_USDT` also fire the static
+ *   probes `mmapio:enter(op)` and `mmapio:leave(op, size, err)`.
+ */
+MMAPIO_API
+void mmapio_set_trace(struct mmapio_trace const* t);
+
+/**
+ * \brief Name a traced system call.
+ * \param op a \link mmapio_trace_op \endlink value
+ * \return a short name, or "?" for unknown values
+ */
+MMAPIO_API
+char const* mmapio_trace_name(int op);
+/* END   tracing */
+
 /* BEGIN open functions */
 /**
  * \brief Open a file using a narrow character name.
  * \param nm name of file to map
  * \param mode one of 'r' (for readonly) or 'w' (writeable),
  *   optionally followed by 'e' to extend map to end of file,
- *   optionally followed by 'p' to make write changes private
+ *   optionally followed by 'p' to make write changes private,
+ *   optionally followed by 'f' to follow the file as it grows,
+ *   optionally followed by 'v' to grow in place up to `sz` bytes,
+ *   optionally followed by 'l' to map on first use,
+ *   optionally followed by 'd' to keep the map out of child processes
  * \param sz size in bytes of region to map
  * \param off file offset of region to map
  * \return an interface on success, `NULL` otherwise
@@ -186,7 +492,11 @@ struct mmapio_i* mmapio_open
  * \param nm name of file to map
  * \brief mode one of 'r' (for readonly) or 'w' (writeable),
  *   optionally followed by 'e' to extend map to end of file,
- *   optionally followed by 'p' to make write changes private
+ *   optionally followed by 'p' to make write changes private,
+ *   optionally followed by 'f' to follow the file as it grows,
+ *   optionally followed by 'v' to grow in place up to `sz` bytes,
+ *   optionally followed by 'l' to map on first use,
+ *   optionally followed by 'd' to keep the map out of child processes
  * \param sz size in bytes of region to map
  * \param off file offset of region to map
  * \return an interface on success, `NULL` otherwise
@@ -203,7 +513,11 @@ struct mmapio_i* mmapio_u8open
  * \param nm name of file to map
  * \brief mode one of 'r' (for readonly) or 'w' (writeable),
  *   optionally followed by 'e' to extend map to end of file,
- *   optionally followed by 'p' to make write changes private
+ *   optionally followed by 'p' to make write changes private,
+ *   optionally followed by 'f' to follow the file as it grows,
+ *   optionally followed by 'v' to grow in place up to `sz` bytes,
+ *   optionally followed by 'l' to map on first use,
+ *   optionally followed by 'd' to keep the map out of child processes
  * \param sz size in bytes of region to map
  * \param off file offset of region to map
  * \return an interface on success, `NULL` otherwise
@@ -215,8 +529,127 @@ struct mmapio_i* mmapio_u8open
 MMAPIO_API
 struct mmapio_i* mmapio_wopen
   (wchar_t const* nm, char const* mode, size_t sz, size_t off);
+
+/**
+ * \brief Open a named shared memory segment.
+ * \param nm name of the segment, starting with a slash on Unix
+ *   (for example, "/lookup-table")
+ * \param mode one of 'r' (for readonly) or 'w' (writeable),
+ *   optionally followed by 'x' with 'w' to fail if the segment exists,
+ *   optionally followed by 'e' to map the segment's current size
+ * \param sz size in bytes of region to map; with 'w', the segment
+ *   grows to at least this size
+ * \return an interface on success, `NULL` otherwise
+ * \note With 'wx', exactly one process succeeds in creating the
+ *   segment. Other processes get `EEXIST` and should open the
+ *   segment with 'r' instead. Readers should wait for a ready flag
+ *   written by the publisher before trusting the segment's contents.
+ * \note On Unix, this function uses `shm_open`. The segment persists
+ *   until \link mmapio_shm_unlink \endlink removes it.
+ * \note On Windows, this function uses a named file mapping backed by
+ *   the paging file. The segment vanishes when its last handle closes.
+ */
+MMAPIO_API
+struct mmapio_i* mmapio_shm_open
+  (char const* nm, char const* mode, size_t sz);
+
+/**
+ * \brief Remove a named shared memory segment.
+ * \param nm name of the segment
+ * \return zero on success, nonzero otherwise
+ * \note Existing mappings of the segment remain valid.
+ */
+MMAPIO_API
+int mmapio_shm_unlink(char const* nm);
+
+/**
+ * \brief Map several files as one contiguous range.
+ * \param nms array of file names
+ * \param count number of file names
+ * \param mode one of 'r' (for readonly) or 'w' (writeable),
+ *   optionally followed by 'p' to make write changes private
+ * \return an interface on success, `NULL` otherwise
+ * \note Each whole file starts on a page boundary, right after the
+ *   pages of the file before it. The bytes between the end of one
+ *   file and the next page boundary read as zero. Empty files take
+ *   no space. The length of the interface ends with the last byte of
+ *   the last non-empty file.
+ * \note On Unix, this function reserves the whole range, then places
+ *   each file with `MAP_FIXED`. On Windows, this function is not yet
+ *   available and fails with `ENOSYS`.
+ */
+MMAPIO_API
+struct mmapio_i* mmapio_concat_open
+  (char const* const* nms, size_t count, char const* mode);
 /* END   open functions */
 
+/* BEGIN publish functions */
+/**
+ * \brief Start writing a new version of a file.
+ * \param nm name of the file to replace
+ * \param sz size in bytes to preallocate and map, or zero for an
+ *   empty file
+ * \return a writeable interface on success, `NULL` otherwise
+ * \note The interface maps a new temporary file in the same directory
+ *   as `nm`. Readers of `nm` keep seeing the old version until
+ *   \link mmapio_publish_commit \endlink. Closing the interface
+ *   without a commit removes the temporary file.
+ * \note On Windows, this function is not yet available and fails
+ *   with `ENOSYS`.
+ */
+MMAPIO_API
+struct mmapio_i* mmapio_publish_open(char const* nm, size_t sz);
+
+/**
+ * \brief Put a new version of a file in place.
+ * \param m interface from \link mmapio_publish_open \endlink
+ * \param len final size of the file, or zero to keep the
+ *   preallocated size
+ * \return zero on success, -1 otherwise
+ * \note This function flushes the mapping and the file to storage,
+ *   renames the file over the old version in one step, then flushes
+ *   the directory. Readers that open the file afterward see the whole
+ *   new version; readers that opened it before keep the old one.
+ * \note After a commit, the interface stays open on the published
+ *   file; bytes past `len` are no longer accessible. On failure
+ *   before the rename, the old version stays in place.
+ */
+MMAPIO_API
+int mmapio_publish_commit(struct mmapio_i* m, size_t len);
+/* END   publish functions */
+
+/* BEGIN growth functions */
+/**
+ * \brief Grow a file so that its mapping covers more bytes.
+ * \param m writeable interface opened with 'f' or 'v'
+ * \param len smallest length the interface should reach
+ * \return zero on success, -1 otherwise
+ * \note The file grows with `posix_fallocate` where the file system
+ *   supports it, so later writes to the new bytes do not fail for
+ *   lack of space. Then the mapping extends over the new bytes. With
+ *   'v', the mapping extends in place, and a length past the
+ *   capacity fails with `ERANGE`.
+ * \note Like \link mmapio_acquire \endlink on these interfaces, this
+ *   function is not safe to call from two threads at once.
+ * \note On Windows, this function is not yet available and fails
+ *   with `ENOSYS`.
+ */
+MMAPIO_API
+int mmapio_extend(struct mmapio_i* m, size_t len);
+
+/**
+ * \brief Check how far a mapping can grow without moving.
+ * \param m map instance
+ * \return the capacity given at open for an interface opened with
+ *   'v', or zero for any other interface
+ * \note Only an interface with a capacity keeps its address as it
+ *   grows; with 'f' alone, \link mmapio_extend \endlink may move the
+ *   mapping.
+ */
+MMAPIO_API
+size_t mmapio_capacity(struct mmapio_i const* m);
+/* END   growth functions */
+
 #ifdef __cplusplus
 };
 #endif /*__cplusplus*/
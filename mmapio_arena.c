@@ -0,0 +1,292 @@
+/*
+ * \file mmapio_arena.c
+ * \brief Persistent allocation of offset-addressed blocks in a file
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_arena.h"
+#include "mmapio_atomic.h"
+#include <string.h>
+#include <errno.h>
+
+/**
+ * \brief Arena file signature ("MMAR" in little-endian order).
+ */
+#define MMAPIO_ARENA_MAGIC 0x52414D4Du
+
+/**
+ * \brief Arena file format version.
+ */
+#define MMAPIO_ARENA_VERSION 1u
+
+/**
+ * \brief Size of the arena header; the first block starts here.
+ */
+#define MMAPIO_ARENA_HEADER 1024u
+
+/**
+ * \brief Header offset of the bump offset.
+ */
+#define MMAPIO_ARENA_TOP 16u
+
+/**
+ * \brief Header offset of the root offset.
+ */
+#define MMAPIO_ARENA_ROOT 24u
+
+/**
+ * \brief Header offset of the free list heads.
+ */
+#define MMAPIO_ARENA_HEADS 64u
+
+/**
+ * \brief Least number of bytes the file grows by.
+ */
+#define MMAPIO_ARENA_STEP ((mmapio_u64)1u<<20)
+
+/**
+ * \brief Bit position of the tag in a free list head.
+ * \note A head holds a block offset divided by 16 in its low bits,
+ *   and a counter above them. The counter changes with every push and
+ *   pop, so a compare-and-swap fails if the head was popped and
+ *   pushed back in between.
+ */
+#define MMAPIO_ARENA_TAG 44u
+
+/**
+ * \brief Mask of the offset bits in a free list head.
+ */
+#define MMAPIO_ARENA_OFFS ((((mmapio_u64)1u)<<MMAPIO_ARENA_TAG)-1u)
+
+/* BEGIN static functions */
+/**
+ * \brief Find a header word.
+ * \param a arena view
+ * \param off header offset
+ * \return a pointer to the word
+ */
+static mmapio_u64 volatile* mmapio_arena_word
+  (struct mmapio_arena const* a, size_t off);
+
+/**
+ * \brief Find the size class for a size.
+ * \param size number of bytes
+ * \return a class index, or \link MMAPIO_ARENA_CLASSES \endlink if
+ *   the size is too large
+ */
+static unsigned int mmapio_arena_class(size_t size);
+
+/**
+ * \brief Compute the block size of a class.
+ * \param c class index
+ * \return a size in bytes
+ */
+static mmapio_u64 mmapio_arena_class_size(unsigned int c);
+
+/**
+ * \brief Grow the file to cover an end offset.
+ * \param a arena view
+ * \param need end offset to cover
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_arena_grow(struct mmapio_arena* a, mmapio_u64 need);
+
+mmapio_u64 volatile* mmapio_arena_word
+  (struct mmapio_arena const* a, size_t off)
+{
+  return (mmapio_u64 volatile*)(a->base + off);
+}
+
+unsigned int mmapio_arena_class(size_t size) {
+  size_t n;
+  unsigned int b = 5u;
+  if (size <= 16u)
+    return 0u;
+  else if (size <= 32u)
+    return 1u;
+  n = size-1u;
+  while (b < sizeof(size_t)*8u-1u && (n>>b) > 1u)
+    b += 1u;
+  if (b >= 36u)
+    return MMAPIO_ARENA_CLASSES;
+  /* two classes per doubling: one and a half times, then twice */
+  if (n < ((size_t)3u<<(b-1u)))
+    return 2u*(b-4u);
+  else return 2u*b-7u;
+}
+
+mmapio_u64 mmapio_arena_class_size(unsigned int c) {
+  if (c == 0u)
+    return 16u;
+  else if (c & 1u)
+    return ((mmapio_u64)16u)<<((c+1u)/2u);
+  else return ((mmapio_u64)24u)<<(c/2u);
+}
+
+int mmapio_arena_grow(struct mmapio_arena* a, mmapio_u64 need) {
+  mmapio_u32 expect = 0u;
+  int res = 0;
+  while (!mmapio_atomic_cas32(&a->grow, &expect, 1u))
+    expect = 0u;
+  if (mmapio_atomic_load64(&a->len) < need) {
+    /* grow by a quarter or a step, whichever is more */
+    mmapio_u64 const len = mmapio_atomic_load64(&a->len);
+    mmapio_u64 target = len + ((len/4u > MMAPIO_ARENA_STEP)
+      ? len/4u : MMAPIO_ARENA_STEP);
+    if (target < need)
+      target = need;
+    target += (MMAPIO_ARENA_STEP - target%MMAPIO_ARENA_STEP)
+      % MMAPIO_ARENA_STEP;
+    if (need != (mmapio_u64)(size_t)need) {
+      errno = ENOMEM;
+      res = -1;
+    } else if (target != (mmapio_u64)(size_t)target
+        ||  mmapio_extend(a->m, (size_t)target) != 0)
+    {
+      /* near the capacity, take just what is needed */
+      res = mmapio_extend(a->m, (size_t)need);
+      if (res != 0 && errno == ERANGE)
+        errno = ENOMEM;
+    }
+    if (res == 0)
+      mmapio_atomic_store64(&a->len, (mmapio_u64)mmapio_length(a->m));
+  }
+  mmapio_atomic_store32(&a->grow, 0u);
+  return res;
+}
+/* END   static functions */
+
+/* BEGIN arenas */
+int mmapio_arena_open(struct mmapio_arena* a, struct mmapio_i* m) {
+  unsigned char* p;
+  size_t len;
+  mmapio_u32 magic;
+  /* growth must not move the mapping under other threads */
+  if (a == NULL || m == NULL || mmapio_capacity(m) == 0u) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (mmapio_length(m) < MMAPIO_ARENA_HEADER
+  &&  mmapio_extend(m, MMAPIO_ARENA_HEADER) != 0)
+  {
+    return -1;
+  }
+  p = (unsigned char*)mmapio_acquire(m);
+  if (p == NULL)
+    return -1;
+  len = mmapio_length(m);
+  a->base = p;
+  a->m = m;
+  a->len = (mmapio_u64)len;
+  a->grow = 0u;
+  magic = mmapio_atomic_load32((mmapio_u32 volatile*)p);
+  if (magic == 0u) {
+    /* a new arena; the signature goes in last */
+    memset(p, 0, MMAPIO_ARENA_HEADER);
+    *(mmapio_u32 volatile*)(p+4) = MMAPIO_ARENA_VERSION;
+    mmapio_atomic_store64(mmapio_arena_word(a, MMAPIO_ARENA_TOP),
+        MMAPIO_ARENA_HEADER);
+    mmapio_atomic_store32((mmapio_u32 volatile*)p, MMAPIO_ARENA_MAGIC);
+  } else if (magic != MMAPIO_ARENA_MAGIC
+      ||  *(mmapio_u32 volatile*)(p+4) != MMAPIO_ARENA_VERSION
+      ||  *mmapio_arena_word(a, MMAPIO_ARENA_TOP) < MMAPIO_ARENA_HEADER
+      ||  *mmapio_arena_word(a, MMAPIO_ARENA_TOP) > (mmapio_u64)len)
+  {
+    mmapio_release(m, p);
+    a->base = NULL;
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  return 0;
+}
+
+void mmapio_arena_close(struct mmapio_arena* a) {
+  if (a->base != NULL)
+    mmapio_release(a->m, a->base);
+  a->base = NULL;
+  return;
+}
+
+mmapio_u64 mmapio_arena_alloc(struct mmapio_arena* a, size_t size) {
+  unsigned int const c = mmapio_arena_class(size);
+  mmapio_u64 volatile* head;
+  mmapio_u64 volatile* top;
+  mmapio_u64 h;
+  mmapio_u64 t;
+  mmapio_u64 block;
+  if (c >= MMAPIO_ARENA_CLASSES) {
+    errno = ENOMEM;
+    return 0u;
+  }
+  /* pop the class's free list */
+  head = mmapio_arena_word(a, MMAPIO_ARENA_HEADS + c*8u);
+  h = mmapio_atomic_load64(head);
+  while ((h & MMAPIO_ARENA_OFFS) != 0u) {
+    mmapio_u64 const off = (h & MMAPIO_ARENA_OFFS)<<4;
+    mmapio_u64 const next = mmapio_atomic_load64
+      (mmapio_arena_word(a, (size_t)off));
+    mmapio_u64 const nh = (((h>>MMAPIO_ARENA_TAG)+1u)<<MMAPIO_ARENA_TAG)
+      | ((next>>4) & MMAPIO_ARENA_OFFS);
+    if (mmapio_atomic_cas64(head, &h, nh))
+      return off;
+  }
+  /* else bump, growing the file first if needed */
+  block = mmapio_arena_class_size(c);
+  top = mmapio_arena_word(a, MMAPIO_ARENA_TOP);
+  t = mmapio_atomic_load64(top);
+  for (;;) {
+    mmapio_u64 const end = t + block;
+    if (end < t || end > (MMAPIO_ARENA_OFFS<<4)) {
+      errno = ENOMEM;
+      return 0u;
+    }
+    if (end > mmapio_atomic_load64(&a->len) && mmapio_arena_grow(a, end) != 0)
+      return 0u;
+    if (mmapio_atomic_cas64(top, &t, end))
+      return t;
+  }
+}
+
+void mmapio_arena_free(struct mmapio_arena* a, mmapio_u64 off, size_t size) {
+  unsigned int const c = mmapio_arena_class(size);
+  mmapio_u64 volatile* head;
+  mmapio_u64 h;
+  mmapio_u64 nh;
+  if (off == 0u || c >= MMAPIO_ARENA_CLASSES)
+    return;
+  head = mmapio_arena_word(a, MMAPIO_ARENA_HEADS + c*8u);
+  h = mmapio_atomic_load64(head);
+  do {
+    mmapio_atomic_store64(mmapio_arena_word(a, (size_t)off),
+        (h & MMAPIO_ARENA_OFFS)<<4);
+    nh = (((h>>MMAPIO_ARENA_TAG)+1u)<<MMAPIO_ARENA_TAG) | (off>>4);
+  } while (!mmapio_atomic_cas64(head, &h, nh));
+  return;
+}
+
+void* mmapio_arena_ptr(struct mmapio_arena const* a, mmapio_u64 off) {
+  return (off != 0u) ? a->base + (size_t)off : NULL;
+}
+
+mmapio_u64 mmapio_arena_off(struct mmapio_arena const* a, void const* p) {
+  return (p != NULL)
+    ? (mmapio_u64)((unsigned char const*)p - a->base) : 0u;
+}
+
+mmapio_u64 mmapio_arena_root(struct mmapio_arena const* a) {
+  return mmapio_atomic_load64(mmapio_arena_word(a, MMAPIO_ARENA_ROOT));
+}
+
+void mmapio_arena_set_root(struct mmapio_arena* a, mmapio_u64 off) {
+  mmapio_atomic_store64(mmapio_arena_word(a, MMAPIO_ARENA_ROOT), off);
+  return;
+}
+/* END   arenas */
@@ -0,0 +1,139 @@
+/*
+ * \file mmapio_arena.h
+ * \brief Persistent allocation of offset-addressed blocks in a file
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Arena_H_
+#define hg_MMapIO_mmapIo_Arena_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Number of size classes.
+ * \note Class sizes run 16, 32, 48, 64, 96, 128, and so on, two per
+ *   doubling, up to 64 GiB.
+ */
+#define MMAPIO_ARENA_CLASSES 64
+
+/**
+ * \brief Arena view of a map instance.
+ * \note The file starts with a header that holds the bump offset, a
+ *   root offset and one free list per size class. Blocks are named by
+ *   their offset from the start of the file, so structures built from
+ *   offsets stay valid wherever the file maps next time. Offset zero
+ *   lies inside the header and serves as a null offset.
+ * \note Header words are kept in host byte order, so an arena file
+ *   only reopens on hosts of the same byte order.
+ */
+struct mmapio_arena {
+  /** \brief start of the arena, acquired from `m` */
+  unsigned char* base;
+  /** \brief map instance that holds the arena */
+  struct mmapio_i* m;
+  /** \brief mapped length, updated as the file grows */
+  mmapio_u64 volatile len;
+  /** \brief lock held while the file grows */
+  mmapio_u32 volatile grow;
+};
+
+/* BEGIN arenas */
+/**
+ * \brief Start an arena view.
+ * \param a view to start
+ * \param m map instance opened with "wv"; the size given at open is
+ *   the most the arena may grow to; must stay open while the view is
+ *   in use
+ * \return zero on success, -1 otherwise
+ * \note A map instance without 'v' fails with `EINVAL`, since it
+ *   might move as the file grows.
+ * \note An empty or zero-filled file becomes a new arena. A file
+ *   holding an arena reopens as is, with its blocks, free lists and
+ *   root intact.
+ */
+MMAPIO_API
+int mmapio_arena_open(struct mmapio_arena* a, struct mmapio_i* m);
+
+/**
+ * \brief End an arena view.
+ * \param a view to end
+ * \note The map instance stays open.
+ */
+MMAPIO_API
+void mmapio_arena_close(struct mmapio_arena* a);
+
+/**
+ * \brief Allocate a block.
+ * \param a arena view
+ * \param size number of bytes needed
+ * \return the offset of a block aligned to 16 bytes, or zero on
+ *   failure
+ * \note A block comes from its size class's free list, or else from
+ *   the bump region, which grows the file in steps as needed. Both
+ *   paths use compare-and-swap, so threads allocate without locks;
+ *   only a thread that grows the file waits for others doing the
+ *   same. Nothing here calls `malloc`.
+ * \note New bump blocks read as zero. Reused blocks hold whatever
+ *   was last written to them.
+ */
+MMAPIO_API
+mmapio_u64 mmapio_arena_alloc(struct mmapio_arena* a, size_t size);
+
+/**
+ * \brief Free a block.
+ * \param a arena view
+ * \param off offset of the block, or zero to do nothing
+ * \param size size passed to \link mmapio_arena_alloc \endlink for
+ *   the block
+ */
+MMAPIO_API
+void mmapio_arena_free(struct mmapio_arena* a, mmapio_u64 off, size_t size);
+
+/**
+ * \brief Turn an offset into a pointer.
+ * \param a arena view
+ * \param off offset from \link mmapio_arena_alloc \endlink, or zero
+ * \return a pointer to the block, or NULL for a zero offset
+ * \note The pointer stays valid while the view is open, even as the
+ *   file grows, because the arena's mapping grows in place. Store
+ *   offsets, not pointers, inside the arena.
+ */
+MMAPIO_API
+void* mmapio_arena_ptr(struct mmapio_arena const* a, mmapio_u64 off);
+
+/**
+ * \brief Turn a pointer into an offset.
+ * \param a arena view
+ * \param p pointer into the arena, or NULL
+ * \return the offset of `p`, or zero for NULL
+ */
+MMAPIO_API
+mmapio_u64 mmapio_arena_off(struct mmapio_arena const* a, void const* p);
+
+/**
+ * \brief Read the root offset.
+ * \param a arena view
+ * \return the offset last stored with \link mmapio_arena_set_root
+ *   \endlink, or zero
+ * \note The root lets a reopened arena find its top-level structure.
+ */
+MMAPIO_API
+mmapio_u64 mmapio_arena_root(struct mmapio_arena const* a);
+
+/**
+ * \brief Store the root offset.
+ * \param a arena view
+ * \param off offset of the top-level structure
+ */
+MMAPIO_API
+void mmapio_arena_set_root(struct mmapio_arena* a, mmapio_u64 off);
+/* END   arenas */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Arena_H_*/
@@ -0,0 +1,220 @@
+/*
+ * \file mmapio_atomic.h
+ * \brief Atomic operations for internal use by `mmapio` modules
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Atomic_H_
+#define hg_MMapIO_mmapIo_Atomic_H_
+
+#include "mmapio.h"
+
+#ifndef MMAPIO_INLINE
+#  if (defined __STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+#    define MMAPIO_INLINE static inline
+#  elif (defined __GNUC__)
+#    define MMAPIO_INLINE static __inline__
+#  elif (defined _MSC_VER)
+#    define MMAPIO_INLINE static __inline
+#  else
+#    define MMAPIO_INLINE static
+#  endif /*__STDC_VERSION__*/
+#endif /*MMAPIO_INLINE*/
+
+/*
+ * Operations order memory as acquire loads, release stores, and
+ * acquire-release read-modify-write; `mmapio_atomic_fence` is a full
+ * barrier. Without compiler support the operations degrade to
+ * volatile accesses, which suit single-threaded use only.
+ */
+#if (defined __GNUC__) && (defined __ATOMIC_ACQUIRE)
+#  define MMAPIO_ATOMIC_GNUC 1
+#elif (defined _MSC_VER)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif /*WIN32_LEAN_AND_MEAN*/
+#  include <windows.h>
+#  define MMAPIO_ATOMIC_WIN32 1
+#endif /*__GNUC__*/
+
+#if (defined _WIN32)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif /*WIN32_LEAN_AND_MEAN*/
+#  include <windows.h>
+#elif (defined __unix__) || (defined(__APPLE__)&&defined(__MACH__))
+#  include <sched.h>
+#  define MMAPIO_ATOMIC_SCHED 1
+#endif /*_WIN32*/
+
+MMAPIO_INLINE mmapio_u32 mmapio_atomic_load32(mmapio_u32 volatile* p) {
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  return (mmapio_u32)InterlockedCompareExchange((LONG volatile*)p, 0, 0);
+#else
+  return *p;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE void mmapio_atomic_store32
+  (mmapio_u32 volatile* p, mmapio_u32 v)
+{
+#if (defined MMAPIO_ATOMIC_GNUC)
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  InterlockedExchange((LONG volatile*)p, (LONG)v);
+#else
+  *p = v;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE int mmapio_atomic_cas32
+  (mmapio_u32 volatile* p, mmapio_u32* expect, mmapio_u32 v)
+{
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_compare_exchange_n(p, expect, v, 0,
+      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  mmapio_u32 const old = (mmapio_u32)InterlockedCompareExchange(
+      (LONG volatile*)p, (LONG)v, (LONG)*expect);
+  if (old == *expect)
+    return 1;
+  *expect = old;
+  return 0;
+#else
+  if (*p == *expect) {
+    *p = v;
+    return 1;
+  }
+  *expect = *p;
+  return 0;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE mmapio_u32 mmapio_atomic_add32
+  (mmapio_u32 volatile* p, mmapio_u32 v)
+{
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  return (mmapio_u32)InterlockedExchangeAdd((LONG volatile*)p, (LONG)v);
+#else
+  mmapio_u32 const old = *p;
+  *p = old+v;
+  return old;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE mmapio_u32 mmapio_atomic_or32
+  (mmapio_u32 volatile* p, mmapio_u32 v)
+{
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_fetch_or(p, v, __ATOMIC_ACQ_REL);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  return (mmapio_u32)InterlockedOr((LONG volatile*)p, (LONG)v);
+#else
+  mmapio_u32 const old = *p;
+  *p = old|v;
+  return old;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE mmapio_u64 mmapio_atomic_load64(mmapio_u64 volatile* p) {
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  return (mmapio_u64)InterlockedCompareExchange64(
+      (LONGLONG volatile*)p, 0, 0);
+#else
+  return *p;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE void mmapio_atomic_store64
+  (mmapio_u64 volatile* p, mmapio_u64 v)
+{
+#if (defined MMAPIO_ATOMIC_GNUC)
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  InterlockedExchange64((LONGLONG volatile*)p, (LONGLONG)v);
+#else
+  *p = v;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE int mmapio_atomic_cas64
+  (mmapio_u64 volatile* p, mmapio_u64* expect, mmapio_u64 v)
+{
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_compare_exchange_n(p, expect, v, 0,
+      __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  mmapio_u64 const old = (mmapio_u64)InterlockedCompareExchange64(
+      (LONGLONG volatile*)p, (LONGLONG)v, (LONGLONG)*expect);
+  if (old == *expect)
+    return 1;
+  *expect = old;
+  return 0;
+#else
+  if (*p == *expect) {
+    *p = v;
+    return 1;
+  }
+  *expect = *p;
+  return 0;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE mmapio_u64 mmapio_atomic_add64
+  (mmapio_u64 volatile* p, mmapio_u64 v)
+{
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_fetch_add(p, v, __ATOMIC_ACQ_REL);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  return (mmapio_u64)InterlockedExchangeAdd64(
+      (LONGLONG volatile*)p, (LONGLONG)v);
+#else
+  mmapio_u64 const old = *p;
+  *p = old+v;
+  return old;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE void* mmapio_atomic_loadp(void* volatile* p) {
+#if (defined MMAPIO_ATOMIC_GNUC)
+  return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  return InterlockedCompareExchangePointer(p, NULL, NULL);
+#else
+  return *p;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE void mmapio_atomic_storep(void* volatile* p, void* v) {
+#if (defined MMAPIO_ATOMIC_GNUC)
+  __atomic_store_n(p, v, __ATOMIC_RELEASE);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  InterlockedExchangePointer(p, v);
+#else
+  *p = v;
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+MMAPIO_INLINE void mmapio_atomic_fence(void) {
+#if (defined MMAPIO_ATOMIC_GNUC)
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+#elif (defined MMAPIO_ATOMIC_WIN32)
+  MemoryBarrier();
+#endif /*MMAPIO_ATOMIC_GNUC*/
+}
+
+/* lets other threads run while waiting on one of them */
+MMAPIO_INLINE void mmapio_atomic_yield(void) {
+#if (defined _WIN32)
+  SwitchToThread();
+#elif (defined MMAPIO_ATOMIC_SCHED)
+  sched_yield();
+#endif /*_WIN32*/
+}
+
+#endif /*hg_MMapIO_mmapIo_Atomic_H_*/
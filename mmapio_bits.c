@@ -0,0 +1,656 @@
+/*
+ * \file mmapio_bits.c
+ * \brief Bitsets over mapped files, with rank and select
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_bits.h"
+#include "mmapio_endian.h"
+#include "mmapio_atomic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if (defined __AVX512F__) && (defined __AVX512VPOPCNTDQ__)
+#  include <immintrin.h>
+#  define MMAPIO_BITS_AVX512 1
+#elif (defined __AVX2__)
+#  include <immintrin.h>
+#  define MMAPIO_BITS_AVX2 1
+#elif (defined __SSE2__) || (defined _M_X64) \
+  ||  ((defined _M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define MMAPIO_BITS_SSE2 1
+#endif /*__AVX512F__*/
+#if (defined __BMI2__)
+#  include <immintrin.h>
+#  define MMAPIO_BITS_BMI2 1
+#endif /*__BMI2__*/
+#if (defined _MSC_VER)
+#  include <intrin.h>
+#endif /*_MSC_VER*/
+
+/**
+ * \brief Rank directory signature ("MMRK" in little-endian order).
+ */
+#define MMAPIO_BITS_MAGIC 0x4B524D4Du
+
+/**
+ * \brief Rank directory format version.
+ */
+#define MMAPIO_BITS_VERSION 1u
+
+/**
+ * \brief Size of the rank directory header.
+ */
+#define MMAPIO_BITS_HEADER 16u
+
+/**
+ * \brief Number of bits covered by each rank directory entry.
+ */
+#define MMAPIO_BITS_BLOCK 512u
+
+/**
+ * \brief Number of bytes each parallel task works on.
+ */
+#define MMAPIO_BITS_CHUNK ((size_t)1u<<20)
+
+/**
+ * \brief Context for parallel bitset tasks.
+ */
+struct mmapio_bits_task {
+  /** \brief output bits, or rank directory entries */
+  unsigned char* dst;
+  /** \brief first input bits */
+  unsigned char const* x;
+  /** \brief second input bits */
+  unsigned char const* y;
+  /** \brief number of bytes to process */
+  size_t nbytes;
+  /** \brief number of bits in the bitsets */
+  mmapio_u64 nbits;
+  /** \brief a \link mmapio_bits_op \endlink value */
+  int op;
+  /** \brief nonzero to count the output bits */
+  int want_count;
+  /** \brief running count of set bits */
+  mmapio_u64 volatile total;
+  /** \brief count of set bits in each chunk, for directory building */
+  mmapio_u64* chunk_totals;
+};
+
+/* BEGIN static functions */
+/**
+ * \brief Count the set bits of a word.
+ * \param x word
+ * \return a bit count
+ */
+static unsigned int mmapio_bits_popcount64(mmapio_u64 x);
+
+/**
+ * \brief Count the set bits of a byte range.
+ * \param p start of the range
+ * \param n number of bytes
+ * \return a bit count
+ */
+static mmapio_u64 mmapio_bits_popcnt(unsigned char const* p, size_t n);
+
+/**
+ * \brief Count the set bits among the first bits of a range.
+ * \param p start of the range
+ * \param nbits number of bits to count
+ * \return a bit count
+ */
+static mmapio_u64 mmapio_bits_head(unsigned char const* p, mmapio_u64 nbits);
+
+/**
+ * \brief Combine two byte ranges.
+ * \param dst output bytes; may equal either input
+ * \param x first input
+ * \param y second input
+ * \param n number of bytes
+ * \param op a \link mmapio_bits_op \endlink value
+ */
+static void mmapio_bits_apply(unsigned char* dst, unsigned char const* x,
+    unsigned char const* y, size_t n, int op);
+
+/**
+ * \brief Combine two words.
+ * \param x first input
+ * \param y second input
+ * \param op a \link mmapio_bits_op \endlink value
+ * \return the combined word
+ */
+static mmapio_u64 mmapio_bits_apply64(mmapio_u64 x, mmapio_u64 y, int op);
+
+/**
+ * \brief Load a word of a bitset, padding past the end with zeros.
+ * \param b bitset view
+ * \param off byte offset of the word
+ * \return the word
+ */
+static mmapio_u64 mmapio_bits_word(struct mmapio_bits const* b, size_t off);
+
+/**
+ * \brief Find a set bit of a word by its rank.
+ * \param w word with more than `r` set bits
+ * \param r rank of the bit
+ * \return a bit index
+ */
+static unsigned int mmapio_bits_select64(mmapio_u64 w, unsigned int r);
+
+/**
+ * \brief Find the bit that has a given rank from a byte offset on.
+ * \param b bitset view
+ * \param off byte offset to start from; a multiple of 8
+ * \param k rank of the bit, counting from the offset
+ * \return a bit position, or `b->nbits` if there are too few set bits
+ */
+static mmapio_u64 mmapio_bits_scan
+  (struct mmapio_bits const* b, size_t off, mmapio_u64 k);
+
+/**
+ * \brief Get the byte length of a bitset.
+ * \param nbits number of bits
+ * \return a byte count
+ */
+static size_t mmapio_bits_nbytes(mmapio_u64 nbits);
+
+/**
+ * \brief Count the set bits of one chunk.
+ * \param arg task context
+ * \param i chunk index
+ */
+static void mmapio_bits_count_one(void* arg, size_t i);
+
+/**
+ * \brief Combine one chunk.
+ * \param arg task context
+ * \param i chunk index
+ */
+static void mmapio_bits_combine_one(void* arg, size_t i);
+
+/**
+ * \brief Fill the directory entries of one chunk, counting from the
+ *   chunk's start.
+ * \param arg task context
+ * \param i chunk index
+ */
+static void mmapio_bits_dir_one(void* arg, size_t i);
+
+/**
+ * \brief Add the counts of earlier chunks to the entries of a chunk.
+ * \param arg task context
+ * \param i chunk index
+ */
+static void mmapio_bits_dir_fix_one(void* arg, size_t i);
+
+unsigned int mmapio_bits_popcount64(mmapio_u64 x) {
+#if (defined __GNUC__)
+  return (unsigned int)__builtin_popcountll(x);
+#elif (defined _MSC_VER) && (defined _M_X64)
+  return (unsigned int)__popcnt64(x);
+#else
+  mmapio_u64 const all = ~(mmapio_u64)0u;
+  x = x - ((x>>1) & (all/3u));
+  x = (x & (all/5u)) + ((x>>2) & (all/5u));
+  x = (x + (x>>4)) & (all/17u);
+  return (unsigned int)((x * (all/255u))>>56);
+#endif /*__GNUC__*/
+}
+
+mmapio_u64 mmapio_bits_popcnt(unsigned char const* p, size_t n) {
+  mmapio_u64 total = 0u;
+  size_t i = 0u;
+#if (defined MMAPIO_BITS_AVX512)
+  __m512i acc = _mm512_setzero_si512();
+  for (; i+64u <= n; i += 64u) {
+    __m512i const v = _mm512_loadu_si512((void const*)(p+i));
+    acc = _mm512_add_epi64(acc, _mm512_popcnt_epi64(v));
+  }
+  total = (mmapio_u64)_mm512_reduce_add_epi64(acc);
+#elif (defined MMAPIO_BITS_AVX2)
+  /* count nibbles by table lookup, then sum bytes into 64-bit lanes */
+  __m256i const table = _mm256_setr_epi8(
+      0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4,
+      0,1,1,2,1,2,2,3,1,2,2,3,2,3,3,4);
+  __m256i const low = _mm256_set1_epi8(0x0F);
+  __m256i acc = _mm256_setzero_si256();
+  for (; i+32u <= n; i += 32u) {
+    __m256i const v = _mm256_loadu_si256((__m256i const*)(p+i));
+    __m256i const lo = _mm256_and_si256(v, low);
+    __m256i const hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+    __m256i const c = _mm256_add_epi8(
+        _mm256_shuffle_epi8(table, lo), _mm256_shuffle_epi8(table, hi));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(c, _mm256_setzero_si256()));
+  }
+  total = (mmapio_u64)_mm256_extract_epi64(acc, 0)
+    + (mmapio_u64)_mm256_extract_epi64(acc, 1)
+    + (mmapio_u64)_mm256_extract_epi64(acc, 2)
+    + (mmapio_u64)_mm256_extract_epi64(acc, 3);
+#endif /*MMAPIO_BITS_AVX512*/
+  for (; i+8u <= n; i += 8u) {
+    mmapio_u64 w;
+    memcpy(&w, p+i, 8u);
+    total += mmapio_bits_popcount64(w);
+  }
+  for (; i < n; ++i)
+    total += mmapio_bits_popcount64(p[i]);
+  return total;
+}
+
+mmapio_u64 mmapio_bits_head(unsigned char const* p, mmapio_u64 nbits) {
+  size_t const full = (size_t)(nbits/8u);
+  unsigned int const rest = (unsigned int)(nbits%8u);
+  mmapio_u64 total = mmapio_bits_popcnt(p, full);
+  if (rest > 0u)
+    total += mmapio_bits_popcount64(p[full] & ((1u<<rest)-1u));
+  return total;
+}
+
+mmapio_u64 mmapio_bits_apply64(mmapio_u64 x, mmapio_u64 y, int op) {
+  switch (op) {
+  case mmapio_bits_and:    return x & y;
+  case mmapio_bits_or:     return x | y;
+  case mmapio_bits_andnot: return x & ~y;
+  default:                 return x ^ y;
+  }
+}
+
+void mmapio_bits_apply(unsigned char* dst, unsigned char const* x,
+    unsigned char const* y, size_t n, int op)
+{
+  size_t i = 0u;
+#if (defined MMAPIO_BITS_AVX512)
+  for (; i+64u <= n; i += 64u) {
+    __m512i const a = _mm512_loadu_si512((void const*)(x+i));
+    __m512i const c = _mm512_loadu_si512((void const*)(y+i));
+    __m512i v;
+    switch (op) {
+    case mmapio_bits_and:    v = _mm512_and_si512(a, c); break;
+    case mmapio_bits_or:     v = _mm512_or_si512(a, c); break;
+    case mmapio_bits_andnot: v = _mm512_andnot_si512(c, a); break;
+    default:                 v = _mm512_xor_si512(a, c); break;
+    }
+    _mm512_storeu_si512((void*)(dst+i), v);
+  }
+#elif (defined MMAPIO_BITS_AVX2)
+  for (; i+32u <= n; i += 32u) {
+    __m256i const a = _mm256_loadu_si256((__m256i const*)(x+i));
+    __m256i const c = _mm256_loadu_si256((__m256i const*)(y+i));
+    __m256i v;
+    switch (op) {
+    case mmapio_bits_and:    v = _mm256_and_si256(a, c); break;
+    case mmapio_bits_or:     v = _mm256_or_si256(a, c); break;
+    case mmapio_bits_andnot: v = _mm256_andnot_si256(c, a); break;
+    default:                 v = _mm256_xor_si256(a, c); break;
+    }
+    _mm256_storeu_si256((__m256i*)(dst+i), v);
+  }
+#elif (defined MMAPIO_BITS_SSE2)
+  for (; i+16u <= n; i += 16u) {
+    __m128i const a = _mm_loadu_si128((__m128i const*)(x+i));
+    __m128i const c = _mm_loadu_si128((__m128i const*)(y+i));
+    __m128i v;
+    switch (op) {
+    case mmapio_bits_and:    v = _mm_and_si128(a, c); break;
+    case mmapio_bits_or:     v = _mm_or_si128(a, c); break;
+    case mmapio_bits_andnot: v = _mm_andnot_si128(c, a); break;
+    default:                 v = _mm_xor_si128(a, c); break;
+    }
+    _mm_storeu_si128((__m128i*)(dst+i), v);
+  }
+#endif /*MMAPIO_BITS_AVX512*/
+  for (; i+8u <= n; i += 8u) {
+    mmapio_u64 a, c;
+    memcpy(&a, x+i, 8u);
+    memcpy(&c, y+i, 8u);
+    a = mmapio_bits_apply64(a, c, op);
+    memcpy(dst+i, &a, 8u);
+  }
+  for (; i < n; ++i)
+    dst[i] = (unsigned char)mmapio_bits_apply64(x[i], y[i], op);
+  return;
+}
+
+size_t mmapio_bits_nbytes(mmapio_u64 nbits) {
+  return (size_t)(nbits/8u) + (nbits%8u ? 1u : 0u);
+}
+
+mmapio_u64 mmapio_bits_word(struct mmapio_bits const* b, size_t off) {
+  size_t const nbytes = mmapio_bits_nbytes(b->nbits);
+  if (off + 8u <= nbytes)
+    return mmapio_load_u64le(b->p + off);
+  else {
+    unsigned char pad[8] = {0,0,0,0,0,0,0,0};
+    if (off < nbytes)
+      memcpy(pad, b->p + off, nbytes - off);
+    return mmapio_load_u64le(pad);
+  }
+}
+
+unsigned int mmapio_bits_select64(mmapio_u64 w, unsigned int r) {
+#if (defined MMAPIO_BITS_BMI2)
+  /* deposit a single bit at the position of the r-th set bit */
+  mmapio_u64 const bit = _pdep_u64((mmapio_u64)1u<<r, w);
+#  if (defined __GNUC__)
+  return (unsigned int)__builtin_ctzll(bit);
+#  else
+  return (unsigned int)_tzcnt_u64(bit);
+#  endif /*__GNUC__*/
+#else
+  unsigned int i;
+  for (i = 0u; i < r; ++i)
+    w &= w-1u;
+  for (i = 0u; !((w>>i)&1u); ++i)
+    continue;
+  return i;
+#endif /*MMAPIO_BITS_BMI2*/
+}
+
+mmapio_u64 mmapio_bits_scan
+  (struct mmapio_bits const* b, size_t off, mmapio_u64 k)
+{
+  size_t const nbytes = mmapio_bits_nbytes(b->nbits);
+  /* skip whole blocks first, then single words */
+  while (off + 64u <= nbytes) {
+    mmapio_u64 const c = mmapio_bits_popcnt(b->p + off, 64u);
+    if (c > k)
+      break;
+    k -= c;
+    off += 64u;
+  }
+  for (; off < nbytes; off += 8u) {
+    mmapio_u64 const w = mmapio_bits_word(b, off);
+    unsigned int const c = mmapio_bits_popcount64(w);
+    if (c > k) {
+      mmapio_u64 const pos = (mmapio_u64)off*8u
+        + mmapio_bits_select64(w, (unsigned int)k);
+      return pos < b->nbits ? pos : b->nbits;
+    }
+    k -= c;
+  }
+  return b->nbits;
+}
+
+void mmapio_bits_count_one(void* arg, size_t i) {
+  struct mmapio_bits_task* const t = (struct mmapio_bits_task*)arg;
+  size_t const start = i*MMAPIO_BITS_CHUNK;
+  size_t const n = (t->nbytes - start < MMAPIO_BITS_CHUNK)
+    ? t->nbytes - start : MMAPIO_BITS_CHUNK;
+  (void)mmapio_atomic_add64(&t->total, mmapio_bits_popcnt(t->x+start, n));
+  return;
+}
+
+void mmapio_bits_combine_one(void* arg, size_t i) {
+  struct mmapio_bits_task* const t = (struct mmapio_bits_task*)arg;
+  size_t const start = i*MMAPIO_BITS_CHUNK;
+  size_t const n = (t->nbytes - start < MMAPIO_BITS_CHUNK)
+    ? t->nbytes - start : MMAPIO_BITS_CHUNK;
+  size_t const full = (size_t)(t->nbits/8u);
+  size_t j;
+  mmapio_u64 total = 0u;
+  /* count each piece while it is still in cache */
+  for (j = 0u; j < n; j += 4096u) {
+    size_t const m = (n - j < 4096u) ? n - j : 4096u;
+    mmapio_bits_apply(t->dst+start+j, t->x+start+j, t->y+start+j, m, t->op);
+    if (t->want_count && start+j < full) {
+      total += mmapio_bits_popcnt(t->dst+start+j,
+          (full - (start+j) < m) ? full - (start+j) : m);
+    }
+  }
+  if (total > 0u)
+    (void)mmapio_atomic_add64(&t->total, total);
+  return;
+}
+
+void mmapio_bits_dir_one(void* arg, size_t i) {
+  struct mmapio_bits_task* const t = (struct mmapio_bits_task*)arg;
+  size_t const per = MMAPIO_BITS_CHUNK / (MMAPIO_BITS_BLOCK/8u);
+  size_t const nblocks = (size_t)(t->nbits/MMAPIO_BITS_BLOCK)
+    + (t->nbits%MMAPIO_BITS_BLOCK ? 1u : 0u);
+  size_t const first = i*per;
+  size_t const last = (nblocks - first < per) ? nblocks : first+per;
+  size_t j;
+  mmapio_u64 running = 0u;
+  for (j = first; j < last; ++j) {
+    mmapio_u64 const at = (mmapio_u64)j*MMAPIO_BITS_BLOCK;
+    mmapio_u64 const bits = (t->nbits - at < MMAPIO_BITS_BLOCK)
+      ? t->nbits - at : MMAPIO_BITS_BLOCK;
+    mmapio_store_u64le(t->dst + MMAPIO_BITS_HEADER + j*8u, running);
+    running += mmapio_bits_head(t->x + j*(MMAPIO_BITS_BLOCK/8u), bits);
+  }
+  t->chunk_totals[i] = running;
+  return;
+}
+
+void mmapio_bits_dir_fix_one(void* arg, size_t i) {
+  struct mmapio_bits_task* const t = (struct mmapio_bits_task*)arg;
+  size_t const per = MMAPIO_BITS_CHUNK / (MMAPIO_BITS_BLOCK/8u);
+  size_t const nblocks = (size_t)(t->nbits/MMAPIO_BITS_BLOCK)
+    + (t->nbits%MMAPIO_BITS_BLOCK ? 1u : 0u);
+  size_t const first = i*per;
+  size_t const last = (nblocks - first < per) ? nblocks : first+per;
+  mmapio_u64 const base = t->chunk_totals[i];
+  size_t j;
+  if (base == 0u)
+    return;
+  for (j = first; j < last; ++j) {
+    unsigned char* const e = t->dst + MMAPIO_BITS_HEADER + j*8u;
+    mmapio_store_u64le(e, mmapio_load_u64le(e) + base);
+  }
+  return;
+}
+/* END   static functions */
+
+/* BEGIN bitsets */
+int mmapio_bits_open
+  (struct mmapio_bits* b, struct mmapio_i* m, mmapio_u64 nbits)
+{
+  void* p;
+  size_t len;
+  if (b == NULL || m == NULL) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  p = mmapio_acquire(m);
+  if (p == NULL)
+    return -1;
+  len = mmapio_length(m);
+  if (nbits == 0u)
+    nbits = (mmapio_u64)len*8u;
+  else if (nbits/8u > len || (nbits/8u == len && nbits%8u)) {
+    mmapio_release(m, p);
+    errno = ERANGE;
+    return -1;
+  }
+  b->p = (unsigned char*)p;
+  b->nbits = nbits;
+  b->m = m;
+  b->dir = NULL;
+  return 0;
+}
+
+void mmapio_bits_close(struct mmapio_bits* b) {
+  if (b->p != NULL)
+    mmapio_release(b->m, b->p);
+  b->p = NULL;
+  b->dir = NULL;
+  return;
+}
+
+int mmapio_bits_get(struct mmapio_bits const* b, mmapio_u64 i) {
+  return (b->p[i/8u]>>(i%8u))&1;
+}
+
+void mmapio_bits_put(struct mmapio_bits* b, mmapio_u64 i, int v) {
+  unsigned char const bit = (unsigned char)(1u<<(i%8u));
+  if (v)
+    b->p[i/8u] |= bit;
+  else b->p[i/8u] &= (unsigned char)~bit;
+  return;
+}
+
+mmapio_u64 mmapio_bits_count
+  (struct mmapio_bits const* b, struct mmapio_exec const* ex)
+{
+  struct mmapio_bits_task t;
+  size_t const full = (size_t)(b->nbits/8u);
+  unsigned int const rest = (unsigned int)(b->nbits%8u);
+  memset(&t, 0, sizeof(t));
+  t.x = b->p;
+  t.nbytes = full;
+  t.total = 0u;
+  mmapio_exec_run(ex,
+      full/MMAPIO_BITS_CHUNK + (full%MMAPIO_BITS_CHUNK ? 1u : 0u),
+      &mmapio_bits_count_one, &t);
+  if (rest > 0u)
+    t.total += mmapio_bits_popcount64(b->p[full] & ((1u<<rest)-1u));
+  return t.total;
+}
+
+int mmapio_bits_combine(struct mmapio_bits* dst,
+    struct mmapio_bits const* x, struct mmapio_bits const* y, int op,
+    struct mmapio_exec const* ex, mmapio_u64* count)
+{
+  struct mmapio_bits_task t;
+  size_t full;
+  unsigned int rest;
+  if (dst == NULL || x == NULL || y == NULL
+  ||  dst->nbits != x->nbits || dst->nbits != y->nbits
+  ||  op < mmapio_bits_and || op > mmapio_bits_xor)
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  memset(&t, 0, sizeof(t));
+  t.dst = dst->p;
+  t.x = x->p;
+  t.y = y->p;
+  t.nbytes = mmapio_bits_nbytes(dst->nbits);
+  t.nbits = dst->nbits;
+  t.op = op;
+  t.want_count = (count != NULL);
+  t.total = 0u;
+  mmapio_exec_run(ex,
+      t.nbytes/MMAPIO_BITS_CHUNK + (t.nbytes%MMAPIO_BITS_CHUNK ? 1u : 0u),
+      &mmapio_bits_combine_one, &t);
+  if (count != NULL) {
+    full = (size_t)(t.nbits/8u);
+    rest = (unsigned int)(t.nbits%8u);
+    if (rest > 0u)
+      t.total += mmapio_bits_popcount64(dst->p[full] & ((1u<<rest)-1u));
+    *count = t.total;
+  }
+  return 0;
+}
+
+mmapio_u64 mmapio_bits_rank(struct mmapio_bits const* b, mmapio_u64 i) {
+  if (i > b->nbits)
+    i = b->nbits;
+  if (b->dir != NULL) {
+    mmapio_u64 const blk = i/MMAPIO_BITS_BLOCK;
+    return mmapio_load_u64le(b->dir + MMAPIO_BITS_HEADER + blk*8u)
+      + mmapio_bits_head(b->p + blk*(MMAPIO_BITS_BLOCK/8u),
+          i%MMAPIO_BITS_BLOCK);
+  } else return mmapio_bits_head(b->p, i);
+}
+
+mmapio_u64 mmapio_bits_select(struct mmapio_bits const* b, mmapio_u64 k) {
+  if (b->dir != NULL) {
+    unsigned char const* const e = b->dir + MMAPIO_BITS_HEADER;
+    size_t const nblocks = (size_t)(b->nbits/MMAPIO_BITS_BLOCK)
+      + (b->nbits%MMAPIO_BITS_BLOCK ? 1u : 0u);
+    size_t lo = 0u;
+    size_t hi = nblocks;
+    if (k >= mmapio_load_u64le(e + nblocks*8u))
+      return b->nbits;
+    /* last block whose entry is at most k */
+    while (hi - lo > 1u) {
+      size_t const mid = lo + (hi-lo)/2u;
+      if (mmapio_load_u64le(e + mid*8u) <= k)
+        lo = mid;
+      else hi = mid;
+    }
+    return mmapio_bits_scan(b, lo*(MMAPIO_BITS_BLOCK/8u),
+        k - mmapio_load_u64le(e + lo*8u));
+  } else return mmapio_bits_scan(b, 0u, k);
+}
+/* END   bitsets */
+
+/* BEGIN rank directory */
+size_t mmapio_bits_dir_size(mmapio_u64 nbits) {
+  mmapio_u64 const nblocks = nbits/MMAPIO_BITS_BLOCK
+    + (nbits%MMAPIO_BITS_BLOCK ? 1u : 0u);
+  return (size_t)(MMAPIO_BITS_HEADER + (nblocks+1u)*8u);
+}
+
+size_t mmapio_bits_dir_build(void* dst, size_t dstlen,
+    struct mmapio_bits const* b, struct mmapio_exec const* ex)
+{
+  struct mmapio_bits_task t;
+  size_t const size = mmapio_bits_dir_size(b->nbits);
+  size_t const nblocks = (size - MMAPIO_BITS_HEADER)/8u - 1u;
+  size_t const per = MMAPIO_BITS_CHUNK / (MMAPIO_BITS_BLOCK/8u);
+  size_t const chunks = nblocks/per + (nblocks%per ? 1u : 0u);
+  size_t i;
+  mmapio_u64 running = 0u;
+  if (dst == NULL || dstlen < size) {
+    errno = ERANGE;
+    return 0u;
+  }
+  memset(&t, 0, sizeof(t));
+  t.dst = (unsigned char*)dst;
+  t.x = b->p;
+  t.nbits = b->nbits;
+  t.chunk_totals = (mmapio_u64*)malloc(
+      (chunks ? chunks : 1u)*sizeof(mmapio_u64));
+  if (t.chunk_totals == NULL) {
+    errno = ENOMEM;
+    return 0u;
+  }
+  mmapio_exec_run(ex, chunks, &mmapio_bits_dir_one, &t);
+  /* turn chunk totals into chunk offsets */
+  for (i = 0u; i < chunks; ++i) {
+    mmapio_u64 const c = t.chunk_totals[i];
+    t.chunk_totals[i] = running;
+    running += c;
+  }
+  mmapio_exec_run(ex, chunks, &mmapio_bits_dir_fix_one, &t);
+  free(t.chunk_totals);
+  mmapio_store_u32le(t.dst, MMAPIO_BITS_MAGIC);
+  mmapio_store_u32le(t.dst + 4u, MMAPIO_BITS_VERSION);
+  mmapio_store_u64le(t.dst + 8u, b->nbits);
+  mmapio_store_u64le(t.dst + MMAPIO_BITS_HEADER + nblocks*8u, running);
+  return size;
+}
+
+int mmapio_bits_dir_attach
+  (struct mmapio_bits* b, void const* dir, size_t len)
+{
+  unsigned char const* const d = (unsigned char const*)dir;
+  if (d == NULL || len < MMAPIO_BITS_HEADER
+  ||  len < mmapio_bits_dir_size(b->nbits)
+  ||  mmapio_load_u32le(d) != MMAPIO_BITS_MAGIC
+  ||  mmapio_load_u32le(d + 4u) != MMAPIO_BITS_VERSION
+  ||  mmapio_load_u64le(d + 8u) != b->nbits)
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  b->dir = d;
+  return 0;
+}
+/* END   rank directory */
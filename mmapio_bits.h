@@ -0,0 +1,181 @@
+/*
+ * \file mmapio_bits.h
+ * \brief Bitsets over mapped files, with rank and select
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Bits_H_
+#define hg_MMapIO_mmapIo_Bits_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Operations for \link mmapio_bits_combine \endlink.
+ */
+enum mmapio_bits_op {
+  /** \brief bits set in both inputs */
+  mmapio_bits_and = 0,
+  /** \brief bits set in either input */
+  mmapio_bits_or = 1,
+  /** \brief bits set in the first input but not the second */
+  mmapio_bits_andnot = 2,
+  /** \brief bits set in exactly one input */
+  mmapio_bits_xor = 3
+};
+
+/**
+ * \brief Bitset view of a map instance.
+ * \note Bit `i` is bit `i%8` of byte `i/8`, so the bitset reads the
+ *   same as an array of little-endian 64-bit words. The view works on
+ *   the mapping in place; it copies nothing.
+ */
+struct mmapio_bits {
+  /** \brief start of the bits, acquired from `m` */
+  unsigned char* p;
+  /** \brief number of bits */
+  mmapio_u64 nbits;
+  /** \brief map instance that holds the bits */
+  struct mmapio_i* m;
+  /** \brief rank directory, or NULL */
+  unsigned char const* dir;
+};
+
+/* BEGIN bitsets */
+/**
+ * \brief Start a bitset view.
+ * \param b view to start
+ * \param m map instance holding the bits; must stay open while the
+ *   view is in use
+ * \param nbits number of bits, or zero for the whole mapping
+ * \return zero on success, -1 otherwise
+ */
+MMAPIO_API
+int mmapio_bits_open
+  (struct mmapio_bits* b, struct mmapio_i* m, mmapio_u64 nbits);
+
+/**
+ * \brief End a bitset view.
+ * \param b view to end
+ * \note The map instance stays open.
+ */
+MMAPIO_API
+void mmapio_bits_close(struct mmapio_bits* b);
+
+/**
+ * \brief Read a bit.
+ * \param b bitset view
+ * \param i bit index, less than `b->nbits`
+ * \return 1 if the bit is set, 0 otherwise
+ */
+MMAPIO_API
+int mmapio_bits_get(struct mmapio_bits const* b, mmapio_u64 i);
+
+/**
+ * \brief Write a bit.
+ * \param b bitset view over a writeable mapping
+ * \param i bit index, less than `b->nbits`
+ * \param v nonzero to set the bit, zero to clear it
+ * \note Writing makes an attached rank directory stale.
+ */
+MMAPIO_API
+void mmapio_bits_put(struct mmapio_bits* b, mmapio_u64 i, int v);
+
+/**
+ * \brief Count the set bits.
+ * \param b bitset view
+ * \param ex executor for counting in parallel, or NULL
+ * \return the number of set bits
+ * \note The count uses AVX-512 `VPOPCNTQ` or an AVX2 nibble lookup
+ *   when the compiler targets them.
+ */
+MMAPIO_API
+mmapio_u64 mmapio_bits_count
+  (struct mmapio_bits const* b, struct mmapio_exec const* ex);
+
+/**
+ * \brief Combine two bitsets into a third.
+ * \param dst view over a writeable mapping; may be the same view as
+ *   `x` or `y`
+ * \param x first input
+ * \param y second input
+ * \param op a \link mmapio_bits_op \endlink value
+ * \param ex executor for combining in parallel, or NULL
+ * \param[out] count number of set bits in the result; may be NULL
+ * \return zero on success, -1 otherwise
+ * \note All three bitsets must have the same number of bits.
+ */
+MMAPIO_API
+int mmapio_bits_combine(struct mmapio_bits* dst,
+    struct mmapio_bits const* x, struct mmapio_bits const* y, int op,
+    struct mmapio_exec const* ex, mmapio_u64* count);
+
+/**
+ * \brief Count the set bits before a position.
+ * \param b bitset view
+ * \param i bit position, at most `b->nbits`
+ * \return the number of set bits in `[0, i)`
+ * \note With a rank directory attached, this reads one directory entry
+ *   and at most 64 bytes of bits. Otherwise it counts from the start.
+ */
+MMAPIO_API
+mmapio_u64 mmapio_bits_rank(struct mmapio_bits const* b, mmapio_u64 i);
+
+/**
+ * \brief Find a set bit by its rank.
+ * \param b bitset view
+ * \param k rank of the bit, counting from zero
+ * \return the position of the set bit with `k` set bits before it, or
+ *   `b->nbits` if there are too few set bits
+ * \note With a rank directory attached, this searches the directory,
+ *   then at most 64 bytes of bits. Otherwise it scans from the start.
+ */
+MMAPIO_API
+mmapio_u64 mmapio_bits_select(struct mmapio_bits const* b, mmapio_u64 k);
+/* END   bitsets */
+
+/* BEGIN rank directory */
+/**
+ * \brief Compute the size of a rank directory.
+ * \param nbits number of bits in the bitset
+ * \return a size in bytes
+ * \note The directory holds one 64-bit count for every 512 bits, an
+ *   overhead of one eighth.
+ */
+MMAPIO_API
+size_t mmapio_bits_dir_size(mmapio_u64 nbits);
+
+/**
+ * \brief Build a rank directory for a bitset.
+ * \param dst output space of at least \link mmapio_bits_dir_size
+ *   \endlink bytes, such as a sidecar file mapped with 'w'
+ * \param dstlen length of the output space
+ * \param b bitset view
+ * \param ex executor for counting in parallel, or NULL
+ * \return the directory size on success, zero otherwise
+ */
+MMAPIO_API
+size_t mmapio_bits_dir_build(void* dst, size_t dstlen,
+    struct mmapio_bits const* b, struct mmapio_exec const* ex);
+
+/**
+ * \brief Attach a rank directory to a bitset view.
+ * \param b bitset view
+ * \param dir directory, such as a mapped sidecar file; must stay
+ *   mapped while attached
+ * \param len length of the directory
+ * \return zero on success, -1 if the directory does not match
+ *   the bitset
+ */
+MMAPIO_API
+int mmapio_bits_dir_attach
+  (struct mmapio_bits* b, void const* dir, size_t len);
+/* END   rank directory */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Bits_H_*/
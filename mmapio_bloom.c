@@ -0,0 +1,341 @@
+/*
+ * \file mmapio_bloom.c
+ * \brief Persistent blocked Bloom filters in mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_bloom.h"
+#include "mmapio_hash.h"
+#include "mmapio_endian.h"
+#include "mmapio_atomic.h"
+#include <string.h>
+#include <errno.h>
+
+#if (defined __AVX2__)
+#  include <immintrin.h>
+#  define MMAPIO_BLOOM_AVX2 1
+#endif /*__AVX2__*/
+
+/**
+ * \brief Filter file signature ("MMBF" in little-endian order).
+ */
+#define MMAPIO_BLOOM_MAGIC 0x46424D4Du
+
+/**
+ * \brief Filter file format version.
+ */
+#define MMAPIO_BLOOM_VERSION 1u
+
+/**
+ * \brief Size of the filter header, and of each block.
+ */
+#define MMAPIO_BLOOM_LINE 64u
+
+/**
+ * \brief Number of fixed-size keys each parallel task adds.
+ */
+#define MMAPIO_BLOOM_BATCH 65536u
+
+/**
+ * \brief Number of bytes of line keys each parallel task adds.
+ */
+#define MMAPIO_BLOOM_CHUNK ((size_t)1u<<20)
+
+/**
+ * \brief Odd multipliers that spread one hash over the bits of a key.
+ */
+static mmapio_u32 const mmapio_bloom_salt[MMAPIO_BLOOM_MAX_K] = {
+  0x47B6137Bu, 0x44974D91u, 0x8824AD5Bu, 0xA2B7289Du,
+  0x705495C7u, 0x2DF1424Bu, 0x9EFC4947u, 0x5C6BFB31u,
+  0x9E3779B1u, 0x85EBCA77u, 0xC2B2AE3Du, 0x27D4EB2Fu,
+  0x165667B1u, 0xD3A2646Du, 0xFD7046C5u, 0xB55A4F09u
+};
+
+/**
+ * \brief Position of a key in a filter.
+ */
+struct mmapio_bloom_probe {
+  /** \brief start of the key's block */
+  unsigned char* block;
+  /** \brief hash bits that pick the bit within each word */
+  mmapio_u32 x;
+  /** \brief hash bits that pick the words */
+  mmapio_u32 y;
+};
+
+/**
+ * \brief Context for parallel key tasks.
+ */
+struct mmapio_bloom_task {
+  /** \brief filter to fill */
+  struct mmapio_bloom* f;
+  /** \brief key file */
+  unsigned char const* keys;
+  /** \brief length of the key file */
+  size_t len;
+  /** \brief size of each fixed-size key, or zero for line keys */
+  size_t key_size;
+  /** \brief number of keys added */
+  mmapio_u64 volatile total;
+};
+
+/* BEGIN static functions */
+/**
+ * \brief Locate a key in a filter.
+ * \param f filter view
+ * \param key key bytes
+ * \param len key length
+ * \return the key's position
+ */
+static struct mmapio_bloom_probe mmapio_bloom_locate
+  (struct mmapio_bloom const* f, void const* key, size_t len);
+
+/**
+ * \brief Add fixed-size keys of one batch.
+ * \param arg task context
+ * \param i batch index
+ */
+static void mmapio_bloom_fixed_one(void* arg, size_t i);
+
+/**
+ * \brief Add line keys of one chunk.
+ * \param arg task context
+ * \param i chunk index
+ * \note A chunk adds the lines that start inside it.
+ */
+static void mmapio_bloom_lines_one(void* arg, size_t i);
+
+struct mmapio_bloom_probe mmapio_bloom_locate
+  (struct mmapio_bloom const* f, void const* key, size_t len)
+{
+  struct mmapio_bloom_probe out;
+  mmapio_u64 const h = mmapio_hash64(key, len, f->seed);
+  mmapio_u64 blk;
+  if (f->nblocks <= ((mmapio_u64)1u<<32)) {
+    /* multiply-shift maps the top half of the hash onto the blocks */
+    blk = ((h>>32) * f->nblocks)>>32;
+  } else blk = h % f->nblocks;
+  out.block = f->blocks + (size_t)blk*MMAPIO_BLOOM_LINE;
+  out.x = (mmapio_u32)(h & 0xFFFFFFFFu);
+  out.y = (mmapio_u32)((h * ((mmapio_u64)0x9E3779B9u<<32 | 0x7F4A7C15u))
+    >>32);
+  return out;
+}
+
+void mmapio_bloom_fixed_one(void* arg, size_t i) {
+  struct mmapio_bloom_task* const t = (struct mmapio_bloom_task*)arg;
+  size_t const count = t->len / t->key_size;
+  size_t const first = i*MMAPIO_BLOOM_BATCH;
+  size_t const last = (count - first < MMAPIO_BLOOM_BATCH)
+    ? count : first + MMAPIO_BLOOM_BATCH;
+  size_t j;
+  for (j = first; j < last; ++j)
+    mmapio_bloom_add(t->f, t->keys + j*t->key_size, t->key_size);
+  (void)mmapio_atomic_add64(&t->total, (mmapio_u64)(last-first));
+  return;
+}
+
+void mmapio_bloom_lines_one(void* arg, size_t i) {
+  struct mmapio_bloom_task* const t = (struct mmapio_bloom_task*)arg;
+  size_t const begin = i*MMAPIO_BLOOM_CHUNK;
+  size_t const end = (t->len - begin < MMAPIO_BLOOM_CHUNK)
+    ? t->len : begin + MMAPIO_BLOOM_CHUNK;
+  size_t pos = begin;
+  mmapio_u64 added = 0u;
+  if (i > 0u) {
+    /* skip the line that started in the previous chunk */
+    unsigned char const* const nl = (unsigned char const*)memchr(
+        t->keys + begin - 1u, '\n', t->len - begin + 1u);
+    pos = (nl != NULL) ? (size_t)(nl - t->keys) + 1u : t->len;
+  }
+  while (pos < end) {
+    unsigned char const* const nl = (unsigned char const*)memchr(
+        t->keys + pos, '\n', t->len - pos);
+    size_t const stop = (nl != NULL) ? (size_t)(nl - t->keys) : t->len;
+    size_t n = stop - pos;
+    if (n > 0u && t->keys[pos+n-1u] == '\r')
+      n -= 1u;
+    if (n > 0u) {
+      mmapio_bloom_add(t->f, t->keys + pos, n);
+      added += 1u;
+    }
+    pos = stop + 1u;
+  }
+  if (added > 0u)
+    (void)mmapio_atomic_add64(&t->total, added);
+  return;
+}
+/* END   static functions */
+
+/* BEGIN Bloom filters */
+size_t mmapio_bloom_size(mmapio_u64 nbits) {
+  mmapio_u64 const nblocks = nbits/512u + (nbits%512u ? 1u : 0u);
+  mmapio_u64 const size = (nblocks ? nblocks : 1u)*MMAPIO_BLOOM_LINE
+    + MMAPIO_BLOOM_LINE;
+  if (size != (mmapio_u64)(size_t)size)
+    return 0u;
+  return (size_t)size;
+}
+
+int mmapio_bloom_format(struct mmapio_i* m, unsigned int k, mmapio_u64 seed)
+{
+  unsigned char* p;
+  size_t len;
+  if (m == NULL || k < 1u || k > MMAPIO_BLOOM_MAX_K) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  p = (unsigned char*)mmapio_acquire(m);
+  if (p == NULL)
+    return -1;
+  len = mmapio_length(m);
+  if (len < 2u*MMAPIO_BLOOM_LINE) {
+    mmapio_release(m, p);
+    errno = ERANGE;
+    return -1;
+  }
+  len -= len%MMAPIO_BLOOM_LINE;
+  memset(p, 0, len);
+  mmapio_store_u32le(p, MMAPIO_BLOOM_MAGIC);
+  mmapio_store_u32le(p+4, MMAPIO_BLOOM_VERSION);
+  mmapio_store_u32le(p+8, k);
+  mmapio_store_u64le(p+16, (mmapio_u64)(len/MMAPIO_BLOOM_LINE - 1u));
+  mmapio_store_u64le(p+24, seed);
+  mmapio_release(m, p);
+  return 0;
+}
+
+int mmapio_bloom_open(struct mmapio_bloom* f, struct mmapio_i* m) {
+  unsigned char* p;
+  size_t len;
+  mmapio_u64 nblocks;
+  unsigned int k;
+  if (f == NULL || m == NULL) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  p = (unsigned char*)mmapio_acquire(m);
+  if (p == NULL)
+    return -1;
+  len = mmapio_length(m);
+  nblocks = (len >= MMAPIO_BLOOM_LINE) ? mmapio_load_u64le(p+16) : 0u;
+  k = (len >= MMAPIO_BLOOM_LINE) ? mmapio_load_u32le(p+8) : 0u;
+  if (len < 2u*MMAPIO_BLOOM_LINE
+  ||  mmapio_load_u32le(p) != MMAPIO_BLOOM_MAGIC
+  ||  mmapio_load_u32le(p+4) != MMAPIO_BLOOM_VERSION
+  ||  k < 1u || k > MMAPIO_BLOOM_MAX_K
+  ||  nblocks < 1u || nblocks > (len/MMAPIO_BLOOM_LINE) - 1u)
+  {
+    mmapio_release(m, p);
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  f->blocks = p + MMAPIO_BLOOM_LINE;
+  f->nblocks = nblocks;
+  f->k = k;
+  f->seed = mmapio_load_u64le(p+24);
+  f->base = p;
+  f->m = m;
+  return 0;
+}
+
+void mmapio_bloom_close(struct mmapio_bloom* f) {
+  if (f->base != NULL)
+    mmapio_release(f->m, f->base);
+  f->base = NULL;
+  f->blocks = NULL;
+  return;
+}
+
+void mmapio_bloom_add(struct mmapio_bloom* f, void const* key, size_t len) {
+  struct mmapio_bloom_probe const q = mmapio_bloom_locate(f, key, len);
+  unsigned int j;
+  for (j = 0u; j < f->k; ++j) {
+    mmapio_u32 const s = mmapio_bloom_salt[j];
+    unsigned int const w = (unsigned int)((q.y * s)>>28);
+    mmapio_u32 bit = (mmapio_u32)1u<<((q.x * s)>>27);
+    if (MMAPIO_ENDIAN == 2)
+      bit = mmapio_swap_u32(bit);
+    (void)mmapio_atomic_or32((mmapio_u32 volatile*)(q.block + w*4u), bit);
+  }
+  return;
+}
+
+int mmapio_bloom_test
+  (struct mmapio_bloom const* f, void const* key, size_t len)
+{
+  struct mmapio_bloom_probe const q = mmapio_bloom_locate(f, key, len);
+#if (defined MMAPIO_BLOOM_AVX2)
+  __m256i const x = _mm256_set1_epi32((int)q.x);
+  __m256i const y = _mm256_set1_epi32((int)q.y);
+  __m256i const one = _mm256_set1_epi32(1);
+  unsigned int j;
+  for (j = 0u; j < f->k; j += 8u) {
+    __m256i const s = _mm256_loadu_si256(
+        (__m256i const*)(mmapio_bloom_salt+j));
+    __m256i const w = _mm256_srli_epi32(_mm256_mullo_epi32(y, s), 28);
+    __m256i const bit = _mm256_sllv_epi32(one,
+        _mm256_srli_epi32(_mm256_mullo_epi32(x, s), 27));
+    __m256i const words = _mm256_i32gather_epi32(
+        (int const*)q.block, w, 4);
+    __m256i const hit = _mm256_cmpeq_epi32(
+        _mm256_and_si256(words, bit), bit);
+    unsigned int const lanes = (f->k - j >= 8u) ? 0xFFu
+      : (1u<<(f->k - j)) - 1u;
+    if (((unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(hit)) & lanes)
+        != lanes)
+    {
+      return 0;
+    }
+  }
+  return 1;
+#else
+  unsigned int j;
+  mmapio_u32 miss = 0u;
+  for (j = 0u; j < f->k; ++j) {
+    mmapio_u32 const s = mmapio_bloom_salt[j];
+    unsigned int const w = (unsigned int)((q.y * s)>>28);
+    mmapio_u32 const bit = (mmapio_u32)1u<<((q.x * s)>>27);
+    miss |= bit & ~mmapio_load_u32le(q.block + w*4u);
+  }
+  return miss == 0u;
+#endif /*MMAPIO_BLOOM_AVX2*/
+}
+
+mmapio_u64 mmapio_bloom_add_keys(struct mmapio_bloom* f,
+    void const* keys, size_t len, size_t key_size,
+    struct mmapio_exec const* ex)
+{
+  struct mmapio_bloom_task t;
+  t.f = f;
+  t.keys = (unsigned char const*)keys;
+  t.len = len;
+  t.key_size = key_size;
+  t.total = 0u;
+  if (keys == NULL || len == 0u)
+    return 0u;
+  if (key_size > 0u) {
+    size_t const count = len / key_size;
+    mmapio_exec_run(ex,
+        count/MMAPIO_BLOOM_BATCH + (count%MMAPIO_BLOOM_BATCH ? 1u : 0u),
+        &mmapio_bloom_fixed_one, &t);
+  } else {
+    mmapio_exec_run(ex,
+        len/MMAPIO_BLOOM_CHUNK + (len%MMAPIO_BLOOM_CHUNK ? 1u : 0u),
+        &mmapio_bloom_lines_one, &t);
+  }
+  return t.total;
+}
+/* END   Bloom filters */
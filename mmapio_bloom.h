@@ -0,0 +1,130 @@
+/*
+ * \file mmapio_bloom.h
+ * \brief Persistent blocked Bloom filters in mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Bloom_H_
+#define hg_MMapIO_mmapIo_Bloom_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Largest number of bits each key sets.
+ */
+#define MMAPIO_BLOOM_MAX_K 16
+
+/**
+ * \brief Bloom filter view of a map instance.
+ * \note The file holds a 64-byte header (signature, version, `k`,
+ *   block count and seed), then blocks of 512 bits. Each key hashes to
+ *   one block and sets `k` bits inside it, so a probe touches a single
+ *   cache line. Opening a filter only checks the header, so a
+ *   read-only open costs about as much as the mapping itself.
+ */
+struct mmapio_bloom {
+  /** \brief start of the first block, acquired from `m` */
+  unsigned char* blocks;
+  /** \brief number of 64-byte blocks */
+  mmapio_u64 nblocks;
+  /** \brief bits set per key */
+  unsigned int k;
+  /** \brief hash seed */
+  mmapio_u64 seed;
+  /** \brief start of the mapping */
+  void* base;
+  /** \brief map instance that holds the filter */
+  struct mmapio_i* m;
+};
+
+/* BEGIN Bloom filters */
+/**
+ * \brief Compute the file size of a filter.
+ * \param nbits number of filter bits; rounded up to whole blocks
+ * \return a size in bytes, or zero if too large
+ * \note About ten bits per key with `k` of 7 gives a false positive
+ *   rate near one percent.
+ */
+MMAPIO_API
+size_t mmapio_bloom_size(mmapio_u64 nbits);
+
+/**
+ * \brief Write an empty filter.
+ * \param m writeable map instance of at least
+ *   \link mmapio_bloom_size \endlink bytes; the filter takes the
+ *   whole blocks that fit
+ * \param k bits set per key, from 1 to \link MMAPIO_BLOOM_MAX_K
+ *   \endlink
+ * \param seed hash seed
+ * \return zero on success, -1 otherwise
+ */
+MMAPIO_API
+int mmapio_bloom_format(struct mmapio_i* m, unsigned int k, mmapio_u64 seed);
+
+/**
+ * \brief Start a filter view.
+ * \param f view to start
+ * \param m map instance holding a filter, such as a file opened
+ *   with "re"; must stay open while the view is in use
+ * \return zero on success, -1 if the header does not describe a filter
+ */
+MMAPIO_API
+int mmapio_bloom_open(struct mmapio_bloom* f, struct mmapio_i* m);
+
+/**
+ * \brief End a filter view.
+ * \param f view to end
+ * \note The map instance stays open.
+ */
+MMAPIO_API
+void mmapio_bloom_close(struct mmapio_bloom* f);
+
+/**
+ * \brief Add a key to a filter.
+ * \param f view over a writeable mapping
+ * \param key key bytes
+ * \param len key length
+ * \note Bits are set with atomic OR, so several threads may add keys
+ *   at once.
+ */
+MMAPIO_API
+void mmapio_bloom_add(struct mmapio_bloom* f, void const* key, size_t len);
+
+/**
+ * \brief Check whether a filter may hold a key.
+ * \param f filter view
+ * \param key key bytes
+ * \param len key length
+ * \return 1 if the key may have been added, 0 if it surely was not
+ * \note With AVX2, the probe computes and checks eight bit positions
+ *   at a time with a single gather.
+ */
+MMAPIO_API
+int mmapio_bloom_test
+  (struct mmapio_bloom const* f, void const* key, size_t len);
+
+/**
+ * \brief Add every key of a key file.
+ * \param f view over a writeable mapping
+ * \param keys key file, such as a mapping opened with "re"
+ * \param len length of the key file
+ * \param key_size size of each fixed-size key, or zero for keys one
+ *   per line; line keys lose their "\n" or "\r\n", and empty lines
+ *   are skipped
+ * \param ex executor for adding keys in parallel, or NULL
+ * \return the number of keys added
+ */
+MMAPIO_API
+mmapio_u64 mmapio_bloom_add_keys(struct mmapio_bloom* f,
+    void const* keys, size_t len, size_t key_size,
+    struct mmapio_exec const* ex);
+/* END   Bloom filters */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Bloom_H_*/
@@ -0,0 +1,489 @@
+/*
+ * \file mmapio_cdc.c
+ * \brief Content-defined chunking of mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_cdc.h"
+#include "mmapio_hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * \brief Default average chunk size.
+ */
+#define MMAPIO_CDC_AVG 8192u
+
+/**
+ * \brief Default segment size.
+ */
+#define MMAPIO_CDC_SEGMENT ((size_t)16u<<20)
+
+/**
+ * \brief Number of segments chunked per parallel round.
+ */
+#define MMAPIO_CDC_WAVE 64u
+
+/**
+ * \brief Number of chunks hashed before calling back.
+ */
+#define MMAPIO_CDC_BATCH 1024u
+
+/**
+ * \brief Number of chunks each hash task digests.
+ */
+#define MMAPIO_CDC_PER_TASK 16u
+
+/**
+ * \brief Gear table: one random 32-bit word per byte value.
+ */
+static mmapio_u32 const mmapio_cdc_gear[256] = {
+  0x445BE538u, 0xA267828Du, 0x1E300E7Bu, 0x3EC7A9D9u,
+  0x76A9EAFEu, 0xA5711B9Au, 0x679E9239u, 0xA326B7ABu,
+  0xBF7F9EE3u, 0xA13BDC43u, 0x8D73D6F0u, 0xB7A21F95u,
+  0xD56CD0E9u, 0x1FF9F290u, 0x93C21773u, 0x734C23F7u,
+  0xF6F7D915u, 0xAF758F53u, 0x20AD5070u, 0x3E09682Fu,
+  0x0F010B05u, 0x8858071Du, 0xB0CD6B5Du, 0x95B7D903u,
+  0x64523B3Du, 0x6325C930u, 0xEA5178CCu, 0xD462A61Au,
+  0xF76BF3DAu, 0x41B5F9B3u, 0x0349B0B7u, 0x57E6589Au,
+  0xAB593B28u, 0x2DDADD4Cu, 0x68453FB4u, 0x99B39CB2u,
+  0x7D98CA7Eu, 0x9E2C8E0Fu, 0x98021A2Eu, 0x36437B1Cu,
+  0x6BE57CCEu, 0x5ECA48A6u, 0xC5D9BF76u, 0x6631D1EFu,
+  0x9DDAE2CDu, 0x60398E23u, 0x07F7F4EDu, 0x3CCD3BDBu,
+  0x671599A3u, 0xAA108AC4u, 0x6042251Eu, 0xC5ECED2Fu,
+  0x0191A09Au, 0x6CF1C01Bu, 0x242678DDu, 0x26FAF2A5u,
+  0x36395F2Cu, 0x06D62220u, 0xDF6C954Bu, 0x8E64744Bu,
+  0xCE6912B1u, 0x2474E14Fu, 0x76258D83u, 0x4493742Fu,
+  0x4EBE0DE4u, 0x1E839006u, 0xE4F31D45u, 0x13E37671u,
+  0xD2115B98u, 0xF438B517u, 0x9CF5D8F3u, 0xB82060FFu,
+  0x170FD541u, 0xFF3871AAu, 0xDD2800A4u, 0x36780AE3u,
+  0x04F0BE83u, 0x66E5E99Du, 0x9AFB48CDu, 0x092C6898u,
+  0x7D58D632u, 0x55B57507u, 0x5455845Bu, 0x5ED1A9A9u,
+  0xF1E077A8u, 0xA1359187u, 0x5EC16B99u, 0x86A4C94Eu,
+  0xA82D8D21u, 0x84451363u, 0x4C29703Du, 0x49AB7958u,
+  0x836EA895u, 0xA925A827u, 0xB3FAC067u, 0xD64ACDD8u,
+  0xFFC6870Eu, 0x89AE6BFFu, 0x938F0271u, 0xD1ABDB81u,
+  0xE3840E04u, 0xEB23DCBAu, 0x47BAEECDu, 0xA0534924u,
+  0xC0B1C1D7u, 0x10C51562u, 0x292EC5C5u, 0x461A28CCu,
+  0xDF12D412u, 0x714D0F58u, 0x6A539FE8u, 0x69575D54u,
+  0x484DAA2Au, 0xB0BACE24u, 0xDA600DF7u, 0xA1014A2Eu,
+  0x68B51CF9u, 0x8EED7A23u, 0xB1D0704Eu, 0x6AC6A650u,
+  0x7E6847A3u, 0xEF314AD8u, 0x75021FBCu, 0x1D10E0CAu,
+  0x0F102ECBu, 0xA7E095F4u, 0x76E213C0u, 0x954B0382u,
+  0x08CBB86Eu, 0x2938F65Au, 0x4E159E01u, 0xCE85D9C6u,
+  0x282DB5C9u, 0x1C026F40u, 0x02B5AA92u, 0x79A0F84Eu,
+  0x701D7822u, 0xBFF77A5Au, 0x343E4204u, 0x75397039u,
+  0x286DC924u, 0x2AB81081u, 0x68F99F46u, 0x114DAB21u,
+  0x39ECFE5Cu, 0x842008C8u, 0xF17616C4u, 0xCFDDB2B4u,
+  0x41C583B3u, 0x26C7E76Du, 0xA3AE033Du, 0x084C38C2u,
+  0x7C904084u, 0xE6264CA7u, 0xF9BF01BBu, 0x85E4DDC2u,
+  0x5C75837Au, 0x8F7BEE40u, 0x738D7B17u, 0xC20E0A36u,
+  0xECDE8FA8u, 0x454514A0u, 0xD4E9AED3u, 0x65FD677Bu,
+  0x34CB2822u, 0x71E85BC9u, 0xD3A07A62u, 0x98362942u,
+  0x9942067Du, 0xABAC7252u, 0x177EB120u, 0x8036CBD8u,
+  0x84E8BE3Du, 0x024F3BD7u, 0x6552E331u, 0xD0CA192Eu,
+  0xB7E29D00u, 0x04B46081u, 0x82F887D7u, 0x1B2A608Fu,
+  0x740F1843u, 0x0B92AD97u, 0x5E2B542Fu, 0xF274267Eu,
+  0x8E514956u, 0x252D9B61u, 0xDEB399D2u, 0x0D4E7DE1u,
+  0x635E0575u, 0x65B1A630u, 0xA7779A5Bu, 0xE13C5488u,
+  0x37715216u, 0x07BAA26Eu, 0x3016AAC8u, 0xAF06B111u,
+  0xD74C0C65u, 0xF1A97D5Au, 0x7683684Du, 0x0C9CFE95u,
+  0xAF90239Eu, 0x2CD60111u, 0x11048955u, 0x80D7F5CBu,
+  0x1615A459u, 0x117E666Au, 0xA3DF3DB0u, 0x704D0184u,
+  0x7E738EBDu, 0x3951577Bu, 0x7CCAA2A3u, 0x58EC1BACu,
+  0xCB78A8E6u, 0x5BF191B1u, 0x7520FB35u, 0x97C9FB84u,
+  0x359F57D7u, 0x975B984Bu, 0x1BB9E348u, 0xE010A2D0u,
+  0x80782A98u, 0xCF49358Eu, 0x351369A7u, 0x384CEC40u,
+  0x6986ED32u, 0x2B7719C8u, 0xD0A34943u, 0x5C8B6C6Fu,
+  0x4E3B7AFFu, 0x8C078483u, 0x39328FAAu, 0xAC4D7C3Au,
+  0xBD6691DDu, 0xD30BBDFCu, 0xA6D840BCu, 0x0A8DB9CCu,
+  0xC80C43CAu, 0xEEDA449Du, 0x9B6C69B9u, 0xFC120BDFu,
+  0x1DB93FEAu, 0x6C008349u, 0xC73CE55Du, 0x6FEA5CCBu,
+  0x1C325751u, 0x913B01E8u, 0x95D079A3u, 0x14831806u,
+  0xAE46124Cu, 0x4EC55501u, 0xAB41BE37u, 0x2732824Bu,
+  0xCAB22D2Du, 0x5DC5D5F9u, 0xA496FCD1u, 0x726304FFu
+};
+
+/**
+ * \brief Checked chunking parameters.
+ */
+struct mmapio_cdc_param {
+  /** \brief smallest chunk size */
+  size_t min;
+  /** \brief average chunk size, a power of two */
+  size_t avg;
+  /** \brief largest chunk size */
+  size_t max;
+  /** \brief segment size */
+  size_t segment;
+  /** \brief cut mask used before the average size */
+  mmapio_u32 mask_s;
+  /** \brief cut mask used after the average size */
+  mmapio_u32 mask_l;
+};
+
+/**
+ * \brief Speculative boundaries of one segment.
+ */
+struct mmapio_cdc_seg {
+  /** \brief chunk starts, in order, beginning at the segment start */
+  size_t* starts;
+  /** \brief number of chunk starts */
+  size_t count;
+  /** \brief capacity of `starts` */
+  size_t cap;
+  /** \brief end of the last chunk, at or past the segment end */
+  size_t tail;
+  /** \brief nonzero if the boundary list could not grow */
+  int err;
+};
+
+/**
+ * \brief Chunking context.
+ */
+struct mmapio_cdc_ctx {
+  /** \brief parameters */
+  struct mmapio_cdc_param q;
+  /** \brief space to chunk */
+  unsigned char const* p;
+  /** \brief length of the space */
+  size_t len;
+  /** \brief executor */
+  struct mmapio_exec const* ex;
+  /** \brief segments of the current round */
+  struct mmapio_cdc_seg* segs;
+  /** \brief index of the first segment of the current round */
+  size_t first;
+  /** \brief chunks waiting for digests */
+  struct mmapio_cdc_chunk* batch;
+  /** \brief number of waiting chunks */
+  size_t nb;
+  /** \brief chunk callback */
+  mmapio_cdc_fn fn;
+  /** \brief callback context */
+  void* arg;
+  /** \brief value that stopped the chunking, or zero */
+  int stop;
+};
+
+/* BEGIN static functions */
+/**
+ * \brief Check and complete chunking parameters.
+ * \param[out] q parameters
+ * \param spec caller's parameters, or NULL for all defaults
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_cdc_setup
+  (struct mmapio_cdc_param* q, struct mmapio_cdc_spec const* spec);
+
+/**
+ * \brief Find the end of the first chunk.
+ * \param q parameters
+ * \param s space to chunk
+ * \param n length of the space
+ * \return the length of the first chunk
+ */
+static size_t mmapio_cdc_cut_q
+  (struct mmapio_cdc_param const* q, unsigned char const* s, size_t n);
+
+/**
+ * \brief Chunk one segment as if it began at a boundary.
+ * \param arg chunking context
+ * \param i segment index within the round
+ */
+static void mmapio_cdc_seg_one(void* arg, size_t i);
+
+/**
+ * \brief Digest the chunks of one hash task.
+ * \param arg chunking context
+ * \param i task index
+ */
+static void mmapio_cdc_hash_one(void* arg, size_t i);
+
+/**
+ * \brief Digest waiting chunks and pass them to the callback.
+ * \param c chunking context
+ */
+static void mmapio_cdc_flush(struct mmapio_cdc_ctx* c);
+
+/**
+ * \brief Queue a chunk.
+ * \param c chunking context
+ * \param off offset of the chunk
+ * \param len length of the chunk
+ */
+static void mmapio_cdc_push(struct mmapio_cdc_ctx* c, size_t off, size_t len);
+
+/**
+ * \brief Find a chunk start among a segment's speculative boundaries.
+ * \param s segment
+ * \param pos chunk start
+ * \return the index of `pos`, or `s->count` if absent
+ */
+static size_t mmapio_cdc_find(struct mmapio_cdc_seg const* s, size_t pos);
+
+int mmapio_cdc_setup
+  (struct mmapio_cdc_param* q, struct mmapio_cdc_spec const* spec)
+{
+  size_t const avg = (spec != NULL && spec->avg_size > 0u)
+    ? spec->avg_size : MMAPIO_CDC_AVG;
+  unsigned int bits = 6u;
+  if (avg < 64u) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  while (bits < 29u && ((size_t)1u<<(bits+1u)) <= avg)
+    bits += 1u;
+  q->avg = (size_t)1u<<bits;
+  q->min = (spec != NULL && spec->min_size > 0u)
+    ? spec->min_size : q->avg/4u;
+  if (spec != NULL && spec->max_size > 0u)
+    q->max = spec->max_size;
+  else if (q->avg <= ((size_t)-1)/8u)
+    q->max = q->avg*8u;
+  else q->max = (size_t)-1;
+  if (q->min > q->avg || q->avg > q->max) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  /* the high bits of a gear hash cover the most bytes */
+  q->mask_s = (mmapio_u32)((0xFFFFFFFFu<<(32u-(bits+2u))) & 0xFFFFFFFFu);
+  q->mask_l = (mmapio_u32)((0xFFFFFFFFu<<(32u-(bits-2u))) & 0xFFFFFFFFu);
+  q->segment = (spec != NULL && spec->segment > 0u)
+    ? spec->segment : MMAPIO_CDC_SEGMENT;
+  if (q->max > ((size_t)-1)/16u)
+    q->segment = (size_t)-1;
+  else if (q->segment < q->max*16u)
+    q->segment = q->max*16u;
+  return 0;
+}
+
+size_t mmapio_cdc_cut_q
+  (struct mmapio_cdc_param const* q, unsigned char const* s, size_t n)
+{
+  mmapio_u32 h = 0u;
+  size_t i = q->min;
+  size_t const end = (n < q->max) ? n : q->max;
+  size_t const normal = (q->avg < end) ? q->avg : end;
+  if (n <= q->min)
+    return n;
+#define MMAPIO_CDC_STEP(mask) \
+  h = ((h<<1) + mmapio_cdc_gear[s[i]]) & 0xFFFFFFFFu; \
+  if ((h & (mask)) == 0u) \
+    return i+1u; \
+  i += 1u;
+  while (i+4u <= normal) {
+    MMAPIO_CDC_STEP(q->mask_s)
+    MMAPIO_CDC_STEP(q->mask_s)
+    MMAPIO_CDC_STEP(q->mask_s)
+    MMAPIO_CDC_STEP(q->mask_s)
+  }
+  while (i < normal) {
+    MMAPIO_CDC_STEP(q->mask_s)
+  }
+  while (i+4u <= end) {
+    MMAPIO_CDC_STEP(q->mask_l)
+    MMAPIO_CDC_STEP(q->mask_l)
+    MMAPIO_CDC_STEP(q->mask_l)
+    MMAPIO_CDC_STEP(q->mask_l)
+  }
+  while (i < end) {
+    MMAPIO_CDC_STEP(q->mask_l)
+  }
+#undef MMAPIO_CDC_STEP
+  return end;
+}
+
+void mmapio_cdc_seg_one(void* arg, size_t i) {
+  struct mmapio_cdc_ctx* const c = (struct mmapio_cdc_ctx*)arg;
+  struct mmapio_cdc_seg* const s = c->segs + i;
+  size_t pos = (c->first + i) * c->q.segment;
+  size_t const end = (c->len - pos < c->q.segment)
+    ? c->len : pos + c->q.segment;
+  s->count = 0u;
+  s->err = 0;
+  while (pos < end) {
+    if (s->count >= s->cap) {
+      size_t const cap = (s->cap > 0u) ? s->cap*2u : 64u;
+      size_t* const starts = (size_t*)realloc(s->starts, cap*sizeof(size_t));
+      if (starts == NULL) {
+        s->err = 1;
+        return;
+      }
+      s->starts = starts;
+      s->cap = cap;
+    }
+    s->starts[s->count++] = pos;
+    pos += mmapio_cdc_cut_q(&c->q, c->p + pos, c->len - pos);
+  }
+  s->tail = pos;
+  return;
+}
+
+void mmapio_cdc_hash_one(void* arg, size_t i) {
+  struct mmapio_cdc_ctx* const c = (struct mmapio_cdc_ctx*)arg;
+  size_t j = i*MMAPIO_CDC_PER_TASK;
+  size_t const last = (c->nb - j < MMAPIO_CDC_PER_TASK)
+    ? c->nb : j + MMAPIO_CDC_PER_TASK;
+  for (; j < last; ++j) {
+    struct mmapio_cdc_chunk* const k = c->batch + j;
+    mmapio_sha256(c->p + k->off, k->len, k->digest);
+  }
+  return;
+}
+
+void mmapio_cdc_flush(struct mmapio_cdc_ctx* c) {
+  size_t i;
+  mmapio_exec_run(c->ex, (c->nb + MMAPIO_CDC_PER_TASK - 1u)
+      / MMAPIO_CDC_PER_TASK, &mmapio_cdc_hash_one, c);
+  for (i = 0u; i < c->nb && c->stop == 0; ++i)
+    c->stop = (*c->fn)(c->arg, c->batch + i);
+  c->nb = 0u;
+  return;
+}
+
+void mmapio_cdc_push(struct mmapio_cdc_ctx* c, size_t off, size_t len) {
+  c->batch[c->nb].off = off;
+  c->batch[c->nb].len = len;
+  c->nb += 1u;
+  if (c->nb >= MMAPIO_CDC_BATCH)
+    mmapio_cdc_flush(c);
+  return;
+}
+
+size_t mmapio_cdc_find(struct mmapio_cdc_seg const* s, size_t pos) {
+  size_t lo = 0u;
+  size_t hi = s->count;
+  while (lo < hi) {
+    size_t const mid = lo + (hi-lo)/2u;
+    if (s->starts[mid] < pos)
+      lo = mid+1u;
+    else hi = mid;
+  }
+  return (lo < s->count && s->starts[lo] == pos) ? lo : s->count;
+}
+/* END   static functions */
+
+/* BEGIN content-defined chunking */
+size_t mmapio_cdc_cut
+  (void const* p, size_t len, struct mmapio_cdc_spec const* spec)
+{
+  struct mmapio_cdc_param q;
+  if (mmapio_cdc_setup(&q, spec) != 0)
+    return 0u;
+  return mmapio_cdc_cut_q(&q, (unsigned char const*)p, len);
+}
+
+int mmapio_cdc_chunks(void const* p, size_t len,
+    struct mmapio_cdc_spec const* spec, mmapio_cdc_fn fn, void* arg)
+{
+  struct mmapio_cdc_ctx c;
+  size_t nseg;
+  size_t pos = 0u;
+  size_t i;
+  int err = 0;
+  if ((p == NULL && len > 0u) || fn == NULL) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (mmapio_cdc_setup(&c.q, spec) != 0)
+    return -1;
+  if (len == 0u)
+    return 0;
+  c.p = (unsigned char const*)p;
+  c.len = len;
+  c.ex = (spec != NULL) ? spec->ex : NULL;
+  c.nb = 0u;
+  c.fn = fn;
+  c.arg = arg;
+  c.stop = 0;
+  c.segs = (struct mmapio_cdc_seg*)calloc
+    (MMAPIO_CDC_WAVE, sizeof(struct mmapio_cdc_seg));
+  c.batch = (struct mmapio_cdc_chunk*)malloc
+    (MMAPIO_CDC_BATCH*sizeof(struct mmapio_cdc_chunk));
+  if (c.segs == NULL || c.batch == NULL) {
+    free(c.segs);
+    free(c.batch);
+    errno = ENOMEM;
+    return -1;
+  }
+  nseg = len/c.q.segment + (len%c.q.segment ? 1u : 0u);
+  for (c.first = 0u; c.first < nseg && c.stop == 0 && err == 0;
+      c.first += MMAPIO_CDC_WAVE)
+  {
+    size_t const n = (nseg - c.first < MMAPIO_CDC_WAVE)
+      ? nseg - c.first : MMAPIO_CDC_WAVE;
+    mmapio_exec_run(c.ex, n, &mmapio_cdc_seg_one, &c);
+    for (i = 0u; i < n; ++i)
+      err |= c.segs[i].err;
+    /* follow the true boundaries, and resync with speculative ones */
+    while (err == 0 && c.stop == 0 && pos < len
+        && pos/c.q.segment < c.first + n)
+    {
+      struct mmapio_cdc_seg const* const s =
+        c.segs + (pos/c.q.segment - c.first);
+      size_t k = mmapio_cdc_find(s, pos);
+      if (k < s->count) {
+        for (; k+1u < s->count && c.stop == 0; ++k)
+          mmapio_cdc_push(&c, s->starts[k], s->starts[k+1u]-s->starts[k]);
+        mmapio_cdc_push(&c, s->starts[k], s->tail - s->starts[k]);
+        pos = s->tail;
+      } else {
+        size_t const cut = mmapio_cdc_cut_q(&c.q, c.p + pos, len - pos);
+        mmapio_cdc_push(&c, pos, cut);
+        pos += cut;
+      }
+    }
+  }
+  if (err == 0 && c.stop == 0 && c.nb > 0u)
+    mmapio_cdc_flush(&c);
+  for (i = 0u; i < MMAPIO_CDC_WAVE; ++i)
+    free(c.segs[i].starts);
+  free(c.segs);
+  free(c.batch);
+  if (err != 0) {
+    errno = ENOMEM;
+    return -1;
+  }
+  return c.stop;
+}
+
+int mmapio_cdc_scan(struct mmapio_i* m,
+    struct mmapio_cdc_spec const* spec, mmapio_cdc_fn fn, void* arg)
+{
+  void* p;
+  size_t len;
+  int res;
+  if (m == NULL) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  len = mmapio_length(m);
+  if (len == 0u)
+    return mmapio_cdc_chunks(NULL, 0u, spec, fn, arg);
+  p = mmapio_acquire(m);
+  if (p == NULL)
+    return -1;
+  (void)mmapio_advise(m, 0u, 0u, mmapio_advice_sequential);
+  res = mmapio_cdc_chunks(p, len, spec, fn, arg);
+  mmapio_release(m, p);
+  return res;
+}
+/* END   content-defined chunking */
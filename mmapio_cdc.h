@@ -0,0 +1,110 @@
+/*
+ * \file mmapio_cdc.h
+ * \brief Content-defined chunking of mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Cdc_H_
+#define hg_MMapIO_mmapIo_Cdc_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Chunking parameters.
+ * \note Zero in any size field selects its default. The average size
+ *   rounds down to a power of two, from 64 bytes to 512 MiB.
+ */
+struct mmapio_cdc_spec {
+  /** \brief smallest chunk size; defaults to a quarter of the average */
+  size_t min_size;
+  /** \brief target average chunk size; defaults to 8 KiB */
+  size_t avg_size;
+  /** \brief largest chunk size; defaults to eight times the average */
+  size_t max_size;
+  /**
+   * \brief size of the segments chunked in parallel; defaults to
+   *   16 MiB, and grows to at least sixteen times the largest chunk
+   */
+  size_t segment;
+  /** \brief executor for chunking and hashing in parallel, or NULL */
+  struct mmapio_exec const* ex;
+};
+
+/**
+ * \brief Chunk of the chunked space.
+ */
+struct mmapio_cdc_chunk {
+  /** \brief offset of the chunk */
+  size_t off;
+  /** \brief length of the chunk */
+  size_t len;
+  /** \brief SHA-256 digest of the chunk */
+  unsigned char digest[32];
+};
+
+/**
+ * \brief Chunk callback.
+ * \param arg callback context
+ * \param c chunk, valid until the callback returns
+ * \return zero to continue, or nonzero to stop chunking
+ * \note Chunks arrive in order from the calling thread.
+ */
+typedef int (*mmapio_cdc_fn)(void* arg, struct mmapio_cdc_chunk const* c);
+
+/* BEGIN content-defined chunking */
+/**
+ * \brief Find the end of the first chunk.
+ * \param p space to chunk
+ * \param len length of the space
+ * \param spec chunking parameters
+ * \return the length of the first chunk, or zero on bad parameters
+ * \note Boundaries follow FastCDC: a 32-bit gear hash, no cuts before
+ *   the smallest size, and a stricter cut condition before the average
+ *   size than after it. Chunks depend only on the bytes since the
+ *   last boundary, so an edit moves only the boundaries near it.
+ */
+MMAPIO_API
+size_t mmapio_cdc_cut
+  (void const* p, size_t len, struct mmapio_cdc_spec const* spec);
+
+/**
+ * \brief Split a space into content-defined chunks.
+ * \param p space to chunk, such as a mapped file
+ * \param len length of the space
+ * \param spec chunking parameters
+ * \param fn chunk callback
+ * \param arg callback context
+ * \return zero after the last chunk, the nonzero value that stopped
+ *   the chunking, or -1 on error
+ * \note Segments are chunked in parallel as if each began at a
+ *   boundary. A serial pass then follows the true boundaries into
+ *   each segment until they meet a speculative one, which usually
+ *   happens within a chunk or two. From there, the segment's own
+ *   boundaries are exact. The result is the same as a serial scan.
+ */
+MMAPIO_API
+int mmapio_cdc_chunks(void const* p, size_t len,
+    struct mmapio_cdc_spec const* spec, mmapio_cdc_fn fn, void* arg);
+
+/**
+ * \brief Split a map instance into content-defined chunks.
+ * \param m map instance to chunk
+ * \param spec chunking parameters
+ * \param fn chunk callback
+ * \param arg callback context
+ * \return zero after the last chunk, the nonzero value that stopped
+ *   the chunking, or -1 on error
+ */
+MMAPIO_API
+int mmapio_cdc_scan(struct mmapio_i* m,
+    struct mmapio_cdc_spec const* spec, mmapio_cdc_fn fn, void* arg);
+/* END   content-defined chunking */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Cdc_H_*/
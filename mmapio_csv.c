@@ -0,0 +1,483 @@
+/*
+ * \file mmapio_csv.c
+ * \brief Parallel parsing of delimited text in mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_csv.h"
+#include "mmapio_atomic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if (defined __AVX2__)
+#  include <immintrin.h>
+#  define MMAPIO_CSV_AVX2 1
+#elif (defined __SSE2__) || (defined _M_X64) \
+  ||  ((defined _M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define MMAPIO_CSV_SSE2 1
+#endif /*__AVX2__*/
+#if (defined __PCLMUL__)
+#  include <wmmintrin.h>
+#  define MMAPIO_CSV_CLMUL 1
+#endif /*__PCLMUL__*/
+#if (defined _MSC_VER)
+#  include <intrin.h>
+#endif /*_MSC_VER*/
+
+/**
+ * \brief Default nominal chunk size.
+ */
+#define MMAPIO_CSV_CHUNK ((size_t)4u<<20)
+
+/**
+ * \brief Number of fields a chunk has room for before it first grows
+ *   its field array.
+ */
+#define MMAPIO_CSV_FIELDS 16u
+
+/**
+ * \brief Bit masks for one 64-byte block.
+ */
+struct mmapio_csv_block {
+  /** \brief positions of quote characters */
+  mmapio_u64 quote;
+  /** \brief positions of delimiters */
+  mmapio_u64 sep;
+  /** \brief positions of line feeds */
+  mmapio_u64 nl;
+};
+
+/**
+ * \brief Context for chunk tasks.
+ */
+struct mmapio_csv_task {
+  /** \brief text to parse */
+  unsigned char const* src;
+  /** \brief length of the text */
+  size_t len;
+  /** \brief nominal chunk size */
+  size_t chunk_size;
+  /** \brief number of chunks */
+  size_t count;
+  /** \brief field delimiter */
+  unsigned char delim;
+  /**
+   * \brief quote parity of each chunk, then whether each chunk starts
+   *   inside quotes
+   */
+  unsigned char* inq;
+  /** \brief record callback */
+  mmapio_csv_fn fn;
+  /** \brief callback context */
+  void* arg;
+  /** \brief first nonzero callback result */
+  mmapio_u32 volatile stop;
+  /** \brief nonzero if a chunk ran out of memory */
+  mmapio_u32 volatile nomem;
+};
+
+/* BEGIN static functions */
+/**
+ * \brief Classify 64 bytes.
+ * \param[out] b bit masks, with bit `i` for byte `i`
+ * \param p start of 64 readable bytes
+ * \param delim field delimiter
+ */
+static void mmapio_csv_classify
+  (struct mmapio_csv_block* b, unsigned char const* p, unsigned char delim);
+
+/**
+ * \brief Classify up to 64 bytes at a given position.
+ * \param[out] b bit masks; bits past the end of the text stay clear
+ * \param t task context
+ * \param pos position of the block
+ * \param end end of the classified range
+ * \return the number of bytes classified
+ */
+static size_t mmapio_csv_load(struct mmapio_csv_block* b,
+    struct mmapio_csv_task const* t, size_t pos, size_t end);
+
+/**
+ * \brief Compute the prefix XOR of a bit mask.
+ * \param x bit mask
+ * \return a mask with bit `i` set to the parity of bits `0..i` of `x`
+ * \note With carry-less multiplication, this is one instruction.
+ */
+static mmapio_u64 mmapio_csv_prefix_xor(mmapio_u64 x);
+
+/**
+ * \brief Count the set bits of a mask.
+ * \param x bit mask
+ * \return a bit count
+ */
+static unsigned int mmapio_csv_popcount(mmapio_u64 x);
+
+/**
+ * \brief Find the lowest set bit of a nonzero mask.
+ * \param x bit mask
+ * \return a bit index
+ */
+static unsigned int mmapio_csv_ctz(mmapio_u64 x);
+
+/**
+ * \brief Find the start of a chunk.
+ * \param t task context, with quote states filled in
+ * \param i chunk index, up to the chunk count
+ * \return the position just past the first line feed outside quotes at
+ *   or after the chunk's nominal start
+ */
+static size_t mmapio_csv_bound(struct mmapio_csv_task const* t, size_t i);
+
+/**
+ * \brief Count the quote parity of a nominal chunk.
+ * \param arg task context
+ * \param i chunk index
+ */
+static void mmapio_csv_count_one(void* arg, size_t i);
+
+/**
+ * \brief Parse the records of a chunk.
+ * \param arg task context
+ * \param i chunk index
+ */
+static void mmapio_csv_parse_one(void* arg, size_t i);
+
+/**
+ * \brief Deliver one record.
+ * \param t task context
+ * \param i chunk index
+ * \param fields fields of the record
+ * \param count number of fields
+ * \return nonzero if the parse should stop
+ */
+static int mmapio_csv_emit(struct mmapio_csv_task* t, size_t i,
+    struct mmapio_csv_field* fields, size_t count);
+
+void mmapio_csv_classify
+  (struct mmapio_csv_block* b, unsigned char const* p, unsigned char delim)
+{
+#if (defined MMAPIO_CSV_AVX2)
+  __m256i const q = _mm256_set1_epi8('"');
+  __m256i const d = _mm256_set1_epi8((char)delim);
+  __m256i const n = _mm256_set1_epi8('\n');
+  __m256i const lo = _mm256_loadu_si256((__m256i const*)p);
+  __m256i const hi = _mm256_loadu_si256((__m256i const*)(p+32));
+  b->quote = (mmapio_u64)(mmapio_u32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(lo, q))
+    | ((mmapio_u64)(mmapio_u32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(hi, q))<<32);
+  b->sep = (mmapio_u64)(mmapio_u32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(lo, d))
+    | ((mmapio_u64)(mmapio_u32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(hi, d))<<32);
+  b->nl = (mmapio_u64)(mmapio_u32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(lo, n))
+    | ((mmapio_u64)(mmapio_u32)_mm256_movemask_epi8(
+        _mm256_cmpeq_epi8(hi, n))<<32);
+#elif (defined MMAPIO_CSV_SSE2)
+  __m128i const q = _mm_set1_epi8('"');
+  __m128i const d = _mm_set1_epi8((char)delim);
+  __m128i const n = _mm_set1_epi8('\n');
+  unsigned int k;
+  b->quote = 0u;
+  b->sep = 0u;
+  b->nl = 0u;
+  for (k = 0u; k < 4u; ++k) {
+    __m128i const x = _mm_loadu_si128((__m128i const*)(p+k*16u));
+    b->quote |= (mmapio_u64)(unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(x, q))<<(k*16u);
+    b->sep |= (mmapio_u64)(unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(x, d))<<(k*16u);
+    b->nl |= (mmapio_u64)(unsigned int)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(x, n))<<(k*16u);
+  }
+#else
+  unsigned int k;
+  b->quote = 0u;
+  b->sep = 0u;
+  b->nl = 0u;
+  for (k = 0u; k < 64u; ++k) {
+    b->quote |= (mmapio_u64)(p[k] == '"')<<k;
+    b->sep |= (mmapio_u64)(p[k] == delim)<<k;
+    b->nl |= (mmapio_u64)(p[k] == '\n')<<k;
+  }
+#endif /*MMAPIO_CSV_AVX2*/
+  return;
+}
+
+size_t mmapio_csv_load(struct mmapio_csv_block* b,
+    struct mmapio_csv_task const* t, size_t pos, size_t end)
+{
+  if (end - pos >= 64u) {
+    mmapio_csv_classify(b, t->src+pos, t->delim);
+    return 64u;
+  } else {
+    /* classify a copy, then clear the bits past the end */
+    unsigned char pad[64];
+    size_t const n = end - pos;
+    mmapio_u64 const valid = ~(mmapio_u64)0u>>(64u-n);
+    memcpy(pad, t->src+pos, n);
+    memset(pad+n, 0, 64u-n);
+    mmapio_csv_classify(b, pad, t->delim);
+    b->quote &= valid;
+    b->sep &= valid;
+    b->nl &= valid;
+    return n;
+  }
+}
+
+mmapio_u64 mmapio_csv_prefix_xor(mmapio_u64 x) {
+#if (defined MMAPIO_CSV_CLMUL)
+  __m128i const v = _mm_set_epi64x(0, (long long)x);
+  __m128i const ones = _mm_set1_epi8(-1);
+  return (mmapio_u64)_mm_cvtsi128_si64(_mm_clmulepi64_si128(v, ones, 0));
+#else
+  x ^= x<<1;
+  x ^= x<<2;
+  x ^= x<<4;
+  x ^= x<<8;
+  x ^= x<<16;
+  x ^= x<<32;
+  return x;
+#endif /*MMAPIO_CSV_CLMUL*/
+}
+
+unsigned int mmapio_csv_popcount(mmapio_u64 x) {
+#if (defined __GNUC__)
+  return (unsigned int)__builtin_popcountll(x);
+#else
+  mmapio_u64 const all = ~(mmapio_u64)0u;
+  x = x - ((x>>1) & (all/3u));
+  x = (x & (all/5u)) + ((x>>2) & (all/5u));
+  x = (x + (x>>4)) & (all/17u);
+  return (unsigned int)((x * (all/255u))>>56);
+#endif /*__GNUC__*/
+}
+
+unsigned int mmapio_csv_ctz(mmapio_u64 x) {
+#if (defined __GNUC__)
+  return (unsigned int)__builtin_ctzll(x);
+#elif (defined _MSC_VER) && (defined _M_X64)
+  unsigned long i;
+  _BitScanForward64(&i, x);
+  return (unsigned int)i;
+#else
+  return mmapio_csv_popcount((x & (~x+1u)) - 1u);
+#endif /*__GNUC__*/
+}
+
+size_t mmapio_csv_bound(struct mmapio_csv_task const* t, size_t i) {
+  size_t pos;
+  mmapio_u64 carry;
+  if (i == 0u)
+    return 0u;
+  else if (i >= t->count)
+    return t->len;
+  pos = i*t->chunk_size;
+  carry = t->inq[i] ? ~(mmapio_u64)0u : 0u;
+  while (pos < t->len) {
+    struct mmapio_csv_block b;
+    size_t const n = mmapio_csv_load(&b, t, pos, t->len);
+    mmapio_u64 const inside = mmapio_csv_prefix_xor(b.quote) ^ carry;
+    mmapio_u64 const nl = b.nl & ~inside;
+    if (nl != 0u)
+      return pos + mmapio_csv_ctz(nl) + 1u;
+    carry = (mmapio_u64)0u - (inside>>63);
+    pos += n;
+  }
+  return t->len;
+}
+
+void mmapio_csv_count_one(void* arg, size_t i) {
+  struct mmapio_csv_task* const t = (struct mmapio_csv_task*)arg;
+  size_t pos = i*t->chunk_size;
+  size_t const end = (t->len - pos < t->chunk_size)
+    ? t->len : pos + t->chunk_size;
+  unsigned int parity = 0u;
+  while (pos < end) {
+    struct mmapio_csv_block b;
+    pos += mmapio_csv_load(&b, t, pos, end);
+    parity ^= mmapio_csv_popcount(b.quote);
+  }
+  t->inq[i] = (unsigned char)(parity&1u);
+  return;
+}
+
+int mmapio_csv_emit(struct mmapio_csv_task* t, size_t i,
+    struct mmapio_csv_field* fields, size_t count)
+{
+  size_t k;
+  int res;
+  if (count == 1u && fields[0].len == 0u)
+    return 0;
+  for (k = 0u; k < count; ++k) {
+    struct mmapio_csv_field* const f = fields+k;
+    if (f->len >= 2u && f->p[0] == '"' && f->p[f->len-1u] == '"') {
+      f->p += 1;
+      f->len -= 2u;
+      f->quoted = 1;
+    } else f->quoted = 0;
+  }
+  res = (*t->fn)(t->arg, i, fields, count);
+  if (res != 0) {
+    mmapio_u32 expect = 0u;
+    (void)mmapio_atomic_cas32(&t->stop, &expect, (mmapio_u32)res);
+    return 1;
+  } else return mmapio_atomic_load32(&t->stop) != 0u;
+}
+
+void mmapio_csv_parse_one(void* arg, size_t i) {
+  struct mmapio_csv_task* const t = (struct mmapio_csv_task*)arg;
+  size_t const start = mmapio_csv_bound(t, i);
+  size_t const end = mmapio_csv_bound(t, i+1u);
+  char const* const text = (char const*)t->src;
+  struct mmapio_csv_field* fields;
+  size_t cap = MMAPIO_CSV_FIELDS;
+  size_t count = 0u;
+  size_t field_start = start;
+  size_t pos = start;
+  mmapio_u64 carry = 0u;
+  int done = 0;
+  if (start >= end || mmapio_atomic_load32(&t->stop) != 0u)
+    return;
+  fields = (struct mmapio_csv_field*)malloc(
+      cap*sizeof(struct mmapio_csv_field));
+  if (fields == NULL) {
+    mmapio_atomic_store32(&t->nomem, 1u);
+    return;
+  }
+  while (pos < end && !done) {
+    struct mmapio_csv_block b;
+    size_t const n = mmapio_csv_load(&b, t, pos, end);
+    mmapio_u64 const inside = mmapio_csv_prefix_xor(b.quote) ^ carry;
+    mmapio_u64 structural = (b.sep | b.nl) & ~inside;
+    carry = (mmapio_u64)0u - (inside>>63);
+    while (structural != 0u && !done) {
+      unsigned int const bit = mmapio_csv_ctz(structural);
+      size_t const at = pos + bit;
+      int const is_nl = (int)((b.nl>>bit)&1u);
+      size_t flen = at - field_start;
+      if (count >= cap) {
+        struct mmapio_csv_field* const grown =
+          (struct mmapio_csv_field*)realloc(fields,
+              cap*2u*sizeof(struct mmapio_csv_field));
+        if (grown == NULL) {
+          mmapio_atomic_store32(&t->nomem, 1u);
+          done = 1;
+          break;
+        }
+        fields = grown;
+        cap *= 2u;
+      }
+      if (is_nl && flen > 0u && text[at-1u] == '\r')
+        flen -= 1u;
+      fields[count].p = text + field_start;
+      fields[count].len = flen;
+      count += 1u;
+      field_start = at+1u;
+      if (is_nl) {
+        done = mmapio_csv_emit(t, i, fields, count);
+        count = 0u;
+      }
+      structural &= structural-1u;
+    }
+    pos += n;
+  }
+  if (!done && (field_start < end || count > 0u)) {
+    /* last record of the text, without a line feed */
+    size_t flen = end - field_start;
+    if (count >= cap) {
+      struct mmapio_csv_field* const grown =
+        (struct mmapio_csv_field*)realloc(fields,
+            (cap+1u)*sizeof(struct mmapio_csv_field));
+      if (grown == NULL) {
+        mmapio_atomic_store32(&t->nomem, 1u);
+        free(fields);
+        return;
+      }
+      fields = grown;
+    }
+    if (flen > 0u && text[end-1u] == '\r')
+      flen -= 1u;
+    fields[count].p = text + field_start;
+    fields[count].len = flen;
+    (void)mmapio_csv_emit(t, i, fields, count+1u);
+  }
+  free(fields);
+  return;
+}
+/* END   static functions */
+
+/* BEGIN delimited text */
+size_t mmapio_csv_chunks(size_t len, size_t chunk_size) {
+  if (chunk_size == 0u)
+    chunk_size = MMAPIO_CSV_CHUNK;
+  return len/chunk_size + (len%chunk_size ? 1u : 0u);
+}
+
+int mmapio_csv_parse(void const* p, size_t len, int delim,
+    size_t chunk_size, struct mmapio_exec const* ex,
+    mmapio_csv_fn fn, void* arg)
+{
+  struct mmapio_csv_task t;
+  size_t i;
+  unsigned int state = 0u;
+  if ((p == NULL && len > 0u) || fn == NULL
+  ||  delim == '"' || delim == '\n' || delim < 0 || delim > 255)
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (chunk_size == 0u)
+    chunk_size = MMAPIO_CSV_CHUNK;
+  t.src = (unsigned char const*)p;
+  t.len = len;
+  t.chunk_size = chunk_size;
+  t.count = mmapio_csv_chunks(len, chunk_size);
+  t.delim = (unsigned char)delim;
+  t.fn = fn;
+  t.arg = arg;
+  t.stop = 0u;
+  t.nomem = 0u;
+  if (t.count == 0u)
+    return 0;
+  t.inq = (unsigned char*)malloc(t.count);
+  if (t.inq == NULL)
+    return -1;
+  /* quote parity of each chunk, then the quote state at each start */
+  mmapio_exec_run(ex, t.count, &mmapio_csv_count_one, &t);
+  for (i = 0u; i < t.count; ++i) {
+    unsigned int const parity = t.inq[i];
+    t.inq[i] = (unsigned char)state;
+    state ^= parity;
+  }
+  mmapio_exec_run(ex, t.count, &mmapio_csv_parse_one, &t);
+  free(t.inq);
+  if (t.nomem != 0u) {
+    errno = ENOMEM;
+    return -1;
+  }
+  return (int)t.stop;
+}
+
+size_t mmapio_csv_unquote(char* dst, struct mmapio_csv_field const* f) {
+  size_t i;
+  size_t n = 0u;
+  if (!f->quoted) {
+    memcpy(dst, f->p, f->len);
+    return f->len;
+  }
+  for (i = 0u; i < f->len; ++i) {
+    dst[n++] = f->p[i];
+    if (f->p[i] == '"' && i+1u < f->len && f->p[i+1u] == '"')
+      i += 1u;
+  }
+  return n;
+}
+/* END   delimited text */
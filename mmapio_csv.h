@@ -0,0 +1,96 @@
+/*
+ * \file mmapio_csv.h
+ * \brief Parallel parsing of delimited text in mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Csv_H_
+#define hg_MMapIO_mmapIo_Csv_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Field of a parsed record.
+ * \note A field points into the parsed space; nothing is copied.
+ */
+struct mmapio_csv_field {
+  /** \brief start of the field text */
+  char const* p;
+  /** \brief length of the field text */
+  size_t len;
+  /**
+   * \brief nonzero if the field was enclosed in quotes
+   * \note The text excludes the enclosing quotes, but may still hold
+   *   doubled quotes; see \link mmapio_csv_unquote \endlink.
+   */
+  int quoted;
+};
+
+/**
+ * \brief Record callback.
+ * \param arg callback context
+ * \param chunk index of the chunk that holds the record
+ * \param fields fields of the record, valid until the callback returns
+ * \param count number of fields, at least one
+ * \return zero to continue, or nonzero to stop the parse
+ * \note Records of one chunk arrive in order, but different chunks may
+ *   call back at the same time from different threads. Keep state per
+ *   chunk, and merge it in chunk order afterward if order matters.
+ */
+typedef int (*mmapio_csv_fn)(void* arg, size_t chunk,
+    struct mmapio_csv_field const* fields, size_t count);
+
+/* BEGIN delimited text */
+/**
+ * \brief Count the chunks a parse will use.
+ * \param len length of the text
+ * \param chunk_size nominal chunk size, or zero for the default
+ * \return a chunk count
+ */
+MMAPIO_API
+size_t mmapio_csv_chunks(size_t len, size_t chunk_size);
+
+/**
+ * \brief Parse delimited text.
+ * \param p text to parse, such as a mapped file
+ * \param len length of the text
+ * \param delim field delimiter, such as ',' or '\\t'
+ * \param chunk_size nominal size of each parallel chunk, or zero for
+ *   the default of 4 MiB
+ * \param ex executor for parsing chunks in parallel, or NULL
+ * \param fn record callback
+ * \param arg callback context
+ * \return zero after the last record, the nonzero value of a callback
+ *   that stopped the parse, or -1 on failure
+ * \note Records end with "\n" or "\r\n"; blank lines are skipped.
+ *   Quotes follow RFC 4180: a quoted field may hold delimiters, line
+ *   breaks and doubled quotes. The parse splits the text into chunks at
+ *   line breaks outside quotes, so a quote character inside an unquoted
+ *   field can mislead it.
+ * \note The parser classifies 64 bytes at a time into bit masks of
+ *   quotes, delimiters and line breaks, using SSE2 or AVX2 when the
+ *   compiler targets them.
+ */
+MMAPIO_API
+int mmapio_csv_parse(void const* p, size_t len, int delim,
+    size_t chunk_size, struct mmapio_exec const* ex,
+    mmapio_csv_fn fn, void* arg);
+
+/**
+ * \brief Copy the text of a field, collapsing doubled quotes.
+ * \param dst output space of at least `f->len` bytes
+ * \param f field to copy
+ * \return the length of the copied text
+ */
+MMAPIO_API
+size_t mmapio_csv_unquote(char* dst, struct mmapio_csv_field const* f);
+/* END   delimited text */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Csv_H_*/
@@ -0,0 +1,308 @@
+/*
+ * \file mmapio_cursor.h
+ * \brief Binary cursors for parsing mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Cursor_H_
+#define hg_MMapIO_mmapIo_Cursor_H_
+
+#include "mmapio_endian.h"
+
+/*
+ * A cursor hoists bounds checks out of the parser's hot loop: one call
+ * to `mmapio_cursor_reserve` checks room for a whole record, and the
+ * reads that follow run unchecked. Reads that depend on the data, such
+ * as slices and skips, clamp to the end of the space instead of
+ * branching. Every failure sets a sticky error flag, so a parser can
+ * run to the end of a record and check the flag once. After a failed
+ * reserve, the cursor reports no bytes left and refuses every later
+ * reserve, so loops driven by either one end on truncated input.
+ */
+
+/**
+ * \brief Size of the zero-filled space a cursor falls back to after
+ *   a failed reserve.
+ */
+#define MMAPIO_CURSOR_SINK 32
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Read position in a span of bytes.
+ */
+struct mmapio_cursor {
+  /** \brief start of the space */
+  unsigned char const* base;
+  /** \brief length of the space */
+  size_t len;
+  /** \brief offset of the next read */
+  size_t pos;
+  /**
+   * \brief mask applied to the read position after each unchecked
+   *   read; all ones, or zero after a failed reserve
+   */
+  size_t mask;
+  /** \brief nonzero after any failed reserve, slice or varint */
+  int err;
+  /** \brief zero bytes read in place of the space after an error */
+  unsigned char sink[MMAPIO_CURSOR_SINK];
+};
+
+/* BEGIN cursor setup */
+/**
+ * \brief Start a cursor over a span of bytes.
+ * \param c cursor to start
+ * \param p start of the span
+ * \param len length of the span
+ */
+MMAPIO_INLINE void mmapio_cursor_init
+  (struct mmapio_cursor* c, void const* p, size_t len)
+{
+  c->base = (unsigned char const*)p;
+  c->len = (p != NULL) ? len : 0u;
+  c->pos = 0u;
+  c->mask = ~(size_t)0u;
+  c->err = (p == NULL);
+  memset(c->sink, 0, sizeof(c->sink));
+  return;
+}
+
+/**
+ * \brief Start a cursor over the space of a map instance.
+ * \param c cursor to start
+ * \param m map instance
+ * \return a pointer to pass to \link mmapio_release \endlink, or NULL
+ *   if the acquire failed; the cursor then reports an error
+ */
+MMAPIO_INLINE void* mmapio_cursor_acquire
+  (struct mmapio_cursor* c, struct mmapio_i* m)
+{
+  void* const p = mmapio_acquire(m);
+  mmapio_cursor_init(c, p, (p != NULL) ? mmapio_length(m) : 0u);
+  return p;
+}
+
+/**
+ * \brief Check the sticky error flag.
+ * \param c cursor
+ * \return nonzero if every operation so far stayed within the space
+ */
+MMAPIO_INLINE int mmapio_cursor_ok(struct mmapio_cursor const* c) {
+  return !c->err;
+}
+
+/**
+ * \brief Count the bytes left after the read position.
+ * \param c cursor
+ * \return a byte count, or zero after a failed reserve
+ */
+MMAPIO_INLINE size_t mmapio_cursor_left(struct mmapio_cursor const* c) {
+  return (c->len - c->pos) & c->mask;
+}
+
+/**
+ * \brief Get the address of the read position.
+ * \param c cursor
+ * \return a pointer into the space
+ */
+MMAPIO_INLINE void const* mmapio_cursor_here(struct mmapio_cursor const* c) {
+  return c->base + c->pos;
+}
+
+/**
+ * \brief Check once for room to read several fields.
+ * \param c cursor
+ * \param n number of bytes the next unchecked reads may consume
+ * \return nonzero if the bytes are available, zero otherwise
+ * \note On failure, the cursor sets its error flag and switches to a
+ *   zero-filled space of \link MMAPIO_CURSOR_SINK \endlink bytes.
+ *   From then on, every read starts over at the front of that space,
+ *   so any number of unchecked reads stay in bounds and return zeros,
+ *   whatever `n` was. Clamped reads return empty slices, and every
+ *   later reserve fails. Such a cursor points into itself, so copies
+ *   of it must not outlive it.
+ */
+MMAPIO_INLINE int mmapio_cursor_reserve(struct mmapio_cursor* c, size_t n) {
+  if (c->mask != 0u && n <= c->len - c->pos)
+    return 1;
+  c->err = 1;
+  c->base = c->sink;
+  c->len = sizeof(c->sink);
+  c->pos = 0u;
+  c->mask = 0u;
+  return 0;
+}
+/* END   cursor setup */
+
+/* BEGIN unchecked reads */
+/**
+ * \brief Read one byte.
+ * \param c cursor with at least one reserved byte
+ * \return the byte
+ */
+MMAPIO_INLINE unsigned int mmapio_cursor_u8(struct mmapio_cursor* c) {
+  unsigned int const v = c->base[c->pos];
+  c->pos = (c->pos + 1u) & c->mask;
+  return v;
+}
+
+/**
+ * \brief Read a little-endian 16-bit value.
+ * \param c cursor with at least 2 reserved bytes
+ * \return the value
+ */
+MMAPIO_INLINE mmapio_u16 mmapio_cursor_u16le(struct mmapio_cursor* c) {
+  mmapio_u16 const v = mmapio_load_u16le(c->base + c->pos);
+  c->pos = (c->pos + 2u) & c->mask;
+  return v;
+}
+
+/**
+ * \brief Read a little-endian 32-bit value.
+ * \param c cursor with at least 4 reserved bytes
+ * \return the value
+ */
+MMAPIO_INLINE mmapio_u32 mmapio_cursor_u32le(struct mmapio_cursor* c) {
+  mmapio_u32 const v = mmapio_load_u32le(c->base + c->pos);
+  c->pos = (c->pos + 4u) & c->mask;
+  return v;
+}
+
+/**
+ * \brief Read a little-endian 64-bit value.
+ * \param c cursor with at least 8 reserved bytes
+ * \return the value
+ */
+MMAPIO_INLINE mmapio_u64 mmapio_cursor_u64le(struct mmapio_cursor* c) {
+  mmapio_u64 const v = mmapio_load_u64le(c->base + c->pos);
+  c->pos = (c->pos + 8u) & c->mask;
+  return v;
+}
+
+/**
+ * \brief Read a big-endian 16-bit value.
+ * \param c cursor with at least 2 reserved bytes
+ * \return the value
+ */
+MMAPIO_INLINE mmapio_u16 mmapio_cursor_u16be(struct mmapio_cursor* c) {
+  mmapio_u16 const v = mmapio_load_u16be(c->base + c->pos);
+  c->pos = (c->pos + 2u) & c->mask;
+  return v;
+}
+
+/**
+ * \brief Read a big-endian 32-bit value.
+ * \param c cursor with at least 4 reserved bytes
+ * \return the value
+ */
+MMAPIO_INLINE mmapio_u32 mmapio_cursor_u32be(struct mmapio_cursor* c) {
+  mmapio_u32 const v = mmapio_load_u32be(c->base + c->pos);
+  c->pos = (c->pos + 4u) & c->mask;
+  return v;
+}
+
+/**
+ * \brief Read a big-endian 64-bit value.
+ * \param c cursor with at least 8 reserved bytes
+ * \return the value
+ */
+MMAPIO_INLINE mmapio_u64 mmapio_cursor_u64be(struct mmapio_cursor* c) {
+  mmapio_u64 const v = mmapio_load_u64be(c->base + c->pos);
+  c->pos = (c->pos + 8u) & c->mask;
+  return v;
+}
+
+/**
+ * \brief Read an unsigned LEB128 variable-length integer.
+ * \param c cursor with at least 10 reserved bytes, or as many as
+ *   the format allows for the value
+ * \return the value
+ * \note A varint longer than 10 bytes sets the error flag; the cursor
+ *   stops after the tenth byte.
+ */
+MMAPIO_INLINE mmapio_u64 mmapio_cursor_varint(struct mmapio_cursor* c) {
+  mmapio_u64 v = 0u;
+  unsigned int shift = 0u;
+  unsigned int b;
+  c->pos &= c->mask;
+  do {
+    b = c->base[c->pos++];
+    v |= ((mmapio_u64)(b&127u))<<shift;
+    shift += 7u;
+  } while ((b&128u) && shift < 70u);
+  c->pos &= c->mask;
+  c->err |= (b>>7);
+  return v;
+}
+/* END   unchecked reads */
+
+/* BEGIN clamped reads */
+/**
+ * \brief Take a slice of the space and move past it.
+ * \param c cursor
+ * \param n requested slice length
+ * \param[out] got actual slice length; shorter than `n` only when the
+ *   space ends first
+ * \return the start of the slice
+ * \note A short slice sets the error flag. The check compiles to a
+ *   conditional move rather than a branch on common targets.
+ */
+MMAPIO_INLINE void const* mmapio_cursor_slice
+  (struct mmapio_cursor* c, size_t n, size_t* got)
+{
+  void const* const p = c->base + c->pos;
+  size_t const left = mmapio_cursor_left(c);
+  int const short_slice = (n > left);
+  n = short_slice ? left : n;
+  c->err |= short_slice;
+  c->pos = (c->pos + n) & c->mask;
+  *got = n;
+  return p;
+}
+
+/**
+ * \brief Take a slice prefixed by its length as a varint.
+ * \param c cursor with at least 10 reserved bytes for the prefix
+ * \param[out] got slice length
+ * \return the start of the slice
+ */
+MMAPIO_INLINE void const* mmapio_cursor_vslice
+  (struct mmapio_cursor* c, size_t* got)
+{
+  mmapio_u64 const n = mmapio_cursor_varint(c);
+  size_t const left = mmapio_cursor_left(c);
+  return mmapio_cursor_slice(c, (n > left) ? ~(size_t)0 : (size_t)n, got);
+}
+
+/**
+ * \brief Move past some bytes.
+ * \param c cursor
+ * \param n number of bytes to skip
+ * \note Skipping past the end clamps to the end and sets the
+ *   error flag.
+ */
+MMAPIO_INLINE void mmapio_cursor_skip(struct mmapio_cursor* c, size_t n) {
+  size_t got;
+  (void)mmapio_cursor_slice(c, n, &got);
+  return;
+}
+
+/**
+ * \brief Move past padding up to an alignment boundary.
+ * \param c cursor
+ * \param align power of two; the boundary counts from the start of
+ *   the space
+ */
+MMAPIO_INLINE void mmapio_cursor_align(struct mmapio_cursor* c, size_t align) {
+  mmapio_cursor_skip(c, (align - (c->pos & (align-1u))) & (align-1u));
+  return;
+}
+/* END   clamped reads */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Cursor_H_*/
@@ -0,0 +1,796 @@
+/*
+ * \file mmapio_delta.c
+ * \brief Binary deltas between two versions of a mapped file
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_delta.h"
+#include "mmapio_hash.h"
+#include "mmapio_endian.h"
+#include "mmapio_atomic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * \brief Patch file signature ("MMDL" in little-endian order).
+ */
+#define MMAPIO_DELTA_MAGIC 0x4C444D4Du
+
+/**
+ * \brief Patch file format version.
+ */
+#define MMAPIO_DELTA_VERSION 1u
+
+/**
+ * \brief Size of the patch header.
+ */
+#define MMAPIO_DELTA_HEADER 64u
+
+/**
+ * \brief Size of each segment table entry: stream offset, stream
+ *   length and output hash.
+ */
+#define MMAPIO_DELTA_ENTRY 24u
+
+/**
+ * \brief Default block size.
+ */
+#define MMAPIO_DELTA_BLOCK 2048u
+
+/**
+ * \brief Default segment size.
+ */
+#define MMAPIO_DELTA_SEGMENT ((size_t)16u<<20)
+
+/**
+ * \brief Multiplier of the rolling hash.
+ */
+#define MMAPIO_DELTA_MUL 0x01000193u
+
+/**
+ * \brief Most blocks with one rolling hash but different content that
+ *   the index keeps.
+ */
+#define MMAPIO_DELTA_DUPS 8u
+
+/**
+ * \brief Number of old blocks each index task hashes.
+ */
+#define MMAPIO_DELTA_BATCH 4096u
+
+/**
+ * \brief Operation of a patch segment.
+ */
+struct mmapio_delta_op {
+  /** \brief old offset of a copy, or new offset of a literal */
+  mmapio_u64 src;
+  /** \brief number of bytes */
+  mmapio_u64 len;
+  /** \brief nonzero for a copy, zero for a literal */
+  int copy;
+};
+
+/**
+ * \brief Encoded segment.
+ */
+struct mmapio_delta_seg {
+  /** \brief operations, in output order */
+  struct mmapio_delta_op* ops;
+  /** \brief number of operations */
+  size_t count;
+  /** \brief capacity of `ops` */
+  size_t cap;
+  /** \brief old offset where the next copy is expected to start */
+  mmapio_u64 expect;
+  /** \brief size of the encoded stream */
+  mmapio_u64 size;
+  /** \brief patch offset of the encoded stream */
+  mmapio_u64 off;
+  /** \brief hash of the segment's output */
+  mmapio_u64 hash;
+  /** \brief nonzero if the operation list could not grow */
+  int err;
+};
+
+/**
+ * \brief Encoding context.
+ */
+struct mmapio_delta_enc {
+  /** \brief old version */
+  unsigned char const* old;
+  /** \brief length of the old version */
+  size_t old_len;
+  /** \brief new version */
+  unsigned char const* cur;
+  /** \brief length of the new version */
+  size_t cur_len;
+  /** \brief block size */
+  size_t block;
+  /** \brief segment size */
+  size_t segment;
+  /** \brief multiplier raised to the block size less one */
+  mmapio_u32 pow;
+  /** \brief rolling hash of each old block */
+  mmapio_u32* weak;
+  /** \brief number of old blocks */
+  size_t nblocks;
+  /** \brief hash table of block indices plus one */
+  mmapio_u32* slots;
+  /** \brief hash table size less one */
+  size_t mask;
+  /** \brief shift from a mixed hash to a slot */
+  unsigned int shift;
+  /** \brief segments */
+  struct mmapio_delta_seg* segs;
+  /** \brief patch space */
+  unsigned char* out;
+};
+
+/**
+ * \brief Decoding context.
+ */
+struct mmapio_delta_dec {
+  /** \brief output space */
+  unsigned char* dst;
+  /** \brief old version */
+  unsigned char const* old;
+  /** \brief length of the old version */
+  size_t old_len;
+  /** \brief patch bytes */
+  unsigned char const* patch;
+  /** \brief length of the patch */
+  size_t len;
+  /** \brief length of the new version */
+  size_t cur_len;
+  /** \brief segment size */
+  size_t segment;
+  /** \brief nonzero once any segment fails */
+  mmapio_u32 volatile fail;
+};
+
+/**
+ * \brief Patch header fields.
+ */
+struct mmapio_delta_head {
+  /** \brief length of the old version */
+  mmapio_u64 old_len;
+  /** \brief length of the new version */
+  mmapio_u64 cur_len;
+  /** \brief number of segments */
+  mmapio_u64 nseg;
+  /** \brief segment size */
+  mmapio_u64 segment;
+};
+
+/* BEGIN static functions */
+/**
+ * \brief Compute the rolling hash of a block.
+ * \param p block
+ * \param n block size
+ * \return the hash
+ */
+static mmapio_u32 mmapio_delta_weak(unsigned char const* p, size_t n);
+
+/**
+ * \brief Hash one batch of old blocks.
+ * \param arg encoding context
+ * \param i batch index
+ */
+static void mmapio_delta_weak_one(void* arg, size_t i);
+
+/**
+ * \brief Map a rolling hash to a hash table slot.
+ * \param e encoding context
+ * \param w rolling hash
+ * \return a slot index
+ */
+static size_t mmapio_delta_slot
+  (struct mmapio_delta_enc const* e, mmapio_u32 w);
+
+/**
+ * \brief Index the old blocks.
+ * \param e encoding context
+ * \note Blocks go in from first to last, so lookups favor the
+ *   earliest matching block. Repeated blocks go in once.
+ */
+static void mmapio_delta_index(struct mmapio_delta_enc* e);
+
+/**
+ * \brief Find an old block equal to some new bytes.
+ * \param e encoding context
+ * \param w rolling hash of the new bytes
+ * \param p new bytes, one block long
+ * \return a block index, or `e->nblocks` if none matches
+ */
+static size_t mmapio_delta_find
+  (struct mmapio_delta_enc const* e, mmapio_u32 w, unsigned char const* p);
+
+/**
+ * \brief Count the bytes of a varint.
+ * \param v value
+ * \return the encoded length
+ */
+static unsigned int mmapio_delta_vlen(mmapio_u64 v);
+
+/**
+ * \brief Write a varint.
+ * \param p output
+ * \param v value
+ * \return the end of the varint
+ */
+static unsigned char* mmapio_delta_vput(unsigned char* p, mmapio_u64 v);
+
+/**
+ * \brief Read a varint.
+ * \param[in,out] p input position
+ * \param end end of the input
+ * \param[out] v value
+ * \return zero on success, -1 if the varint is cut short or too long
+ */
+static int mmapio_delta_vget
+  (unsigned char const** p, unsigned char const* end, mmapio_u64* v);
+
+/**
+ * \brief Encode a copy offset relative to the expected offset.
+ * \param src old offset
+ * \param expect expected offset
+ * \return the zigzag-encoded difference
+ */
+static mmapio_u64 mmapio_delta_zig(mmapio_u64 src, mmapio_u64 expect);
+
+/**
+ * \brief Append an operation to a segment.
+ * \param s segment
+ * \param src old offset of a copy, or new offset of a literal
+ * \param len number of bytes
+ * \param copy nonzero for a copy
+ */
+static void mmapio_delta_push(struct mmapio_delta_seg* s,
+    mmapio_u64 src, mmapio_u64 len, int copy);
+
+/**
+ * \brief Encode one segment of the new version.
+ * \param arg encoding context
+ * \param i segment index
+ */
+static void mmapio_delta_scan_one(void* arg, size_t i);
+
+/**
+ * \brief Write the stream of one segment.
+ * \param arg encoding context
+ * \param i segment index
+ */
+static void mmapio_delta_write_one(void* arg, size_t i);
+
+/**
+ * \brief Encode and write a patch from acquired versions.
+ * \param e encoding context, with both versions set
+ * \param nm name of the patch file
+ * \param ex executor
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_delta_run(struct mmapio_delta_enc* e, char const* nm,
+    struct mmapio_exec const* ex);
+
+/**
+ * \brief Read and check a patch header.
+ * \param patch patch bytes
+ * \param len length of the patch
+ * \param[out] h header fields
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_delta_head(void const* patch, size_t len,
+    struct mmapio_delta_head* h);
+
+/**
+ * \brief Apply one segment of a patch.
+ * \param arg decoding context
+ * \param i segment index
+ */
+static void mmapio_delta_apply_one(void* arg, size_t i);
+
+mmapio_u32 mmapio_delta_weak(unsigned char const* p, size_t n) {
+  mmapio_u32 h = 0u;
+  size_t i;
+  for (i = 0u; i < n; ++i)
+    h = (h*MMAPIO_DELTA_MUL + p[i]) & 0xFFFFFFFFu;
+  return h;
+}
+
+void mmapio_delta_weak_one(void* arg, size_t i) {
+  struct mmapio_delta_enc* const e = (struct mmapio_delta_enc*)arg;
+  size_t j = i*MMAPIO_DELTA_BATCH;
+  size_t const last = (e->nblocks - j < MMAPIO_DELTA_BATCH)
+    ? e->nblocks : j + MMAPIO_DELTA_BATCH;
+  for (; j < last; ++j)
+    e->weak[j] = mmapio_delta_weak(e->old + j*e->block, e->block);
+  return;
+}
+
+size_t mmapio_delta_slot(struct mmapio_delta_enc const* e, mmapio_u32 w) {
+  return (size_t)(((w * 0x9E3779B1u) & 0xFFFFFFFFu) >> e->shift);
+}
+
+void mmapio_delta_index(struct mmapio_delta_enc* e) {
+  size_t b;
+  for (b = 0u; b < e->nblocks; ++b) {
+    mmapio_u32 const w = e->weak[b];
+    size_t i = mmapio_delta_slot(e, w);
+    unsigned int dups = 0u;
+    int keep = 1;
+    while (keep && e->slots[i] != 0u) {
+      size_t const c = (size_t)e->slots[i] - 1u;
+      if (e->weak[c] == w) {
+        dups += 1u;
+        if (dups >= MMAPIO_DELTA_DUPS
+        ||  memcmp(e->old + c*e->block, e->old + b*e->block, e->block) == 0)
+          keep = 0;
+      }
+      i = (i+1u) & e->mask;
+    }
+    if (keep)
+      e->slots[i] = (mmapio_u32)(b+1u);
+  }
+  return;
+}
+
+size_t mmapio_delta_find
+  (struct mmapio_delta_enc const* e, mmapio_u32 w, unsigned char const* p)
+{
+  size_t i = mmapio_delta_slot(e, w);
+  while (e->slots[i] != 0u) {
+    size_t const c = (size_t)e->slots[i] - 1u;
+    if (e->weak[c] == w && memcmp(e->old + c*e->block, p, e->block) == 0)
+      return c;
+    i = (i+1u) & e->mask;
+  }
+  return e->nblocks;
+}
+
+unsigned int mmapio_delta_vlen(mmapio_u64 v) {
+  unsigned int n = 1u;
+  while (v >= 128u) {
+    v >>= 7;
+    n += 1u;
+  }
+  return n;
+}
+
+unsigned char* mmapio_delta_vput(unsigned char* p, mmapio_u64 v) {
+  while (v >= 128u) {
+    *(p++) = (unsigned char)((v & 127u) | 128u);
+    v >>= 7;
+  }
+  *(p++) = (unsigned char)v;
+  return p;
+}
+
+int mmapio_delta_vget
+  (unsigned char const** p, unsigned char const* end, mmapio_u64* v)
+{
+  unsigned char const* s = *p;
+  mmapio_u64 out = 0u;
+  unsigned int shift = 0u;
+  for (; s < end && shift < 64u; shift += 7u) {
+    unsigned int const b = *(s++);
+    out |= ((mmapio_u64)(b & 127u))<<shift;
+    if ((b & 128u) == 0u) {
+      *p = s;
+      *v = out;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+mmapio_u64 mmapio_delta_zig(mmapio_u64 src, mmapio_u64 expect) {
+  return (src >= expect) ? (src-expect)<<1 : ((expect-src)<<1) - 1u;
+}
+
+void mmapio_delta_push(struct mmapio_delta_seg* s,
+    mmapio_u64 src, mmapio_u64 len, int copy)
+{
+  if (s->err)
+    return;
+  if (s->count >= s->cap) {
+    size_t const cap = (s->cap > 0u) ? s->cap*2u : 16u;
+    struct mmapio_delta_op* const ops = (struct mmapio_delta_op*)realloc
+      (s->ops, cap*sizeof(struct mmapio_delta_op));
+    if (ops == NULL) {
+      s->err = 1;
+      return;
+    }
+    s->ops = ops;
+    s->cap = cap;
+  }
+  s->ops[s->count].src = src;
+  s->ops[s->count].len = len;
+  s->ops[s->count].copy = copy;
+  s->count += 1u;
+  s->size += mmapio_delta_vlen((len<<1) | (copy ? 1u : 0u));
+  if (copy) {
+    s->size += mmapio_delta_vlen(mmapio_delta_zig(src, s->expect));
+    s->expect = src + len;
+  } else s->size += len;
+  return;
+}
+
+void mmapio_delta_scan_one(void* arg, size_t i) {
+  struct mmapio_delta_enc* const e = (struct mmapio_delta_enc*)arg;
+  struct mmapio_delta_seg* const s = e->segs + i;
+  unsigned char const* const cur = e->cur;
+  size_t const block = e->block;
+  size_t const start = i*e->segment;
+  size_t const end = (e->cur_len - start < e->segment)
+    ? e->cur_len : start + e->segment;
+  size_t p = start;
+  size_t lit = start;
+  mmapio_u32 h = 0u;
+  int have = 0;
+  s->expect = start;
+  s->hash = mmapio_hash64(cur + start, end - start, 0u);
+  while (p < end && e->nblocks > 0u && e->cur_len - p >= block && !s->err) {
+    size_t b;
+    if (!have) {
+      h = mmapio_delta_weak(cur + p, block);
+      have = 1;
+    }
+    b = mmapio_delta_find(e, h, cur + p);
+    if (b < e->nblocks) {
+      size_t o = b*block;
+      size_t n = (end - p < block) ? end - p : block;
+      if (n == block) {
+        /* extend forward a cache line at a time, then byte by byte */
+        while (end - (p+n) >= 64u && e->old_len - (o+n) >= 64u
+            && memcmp(cur + p + n, e->old + o + n, 64u) == 0)
+        {
+          n += 64u;
+        }
+        while (p+n < end && o+n < e->old_len && cur[p+n] == e->old[o+n])
+          n += 1u;
+      }
+      /* extend backward into the pending literal */
+      while (p > lit && o > 0u && cur[p-1u] == e->old[o-1u]) {
+        p -= 1u;
+        o -= 1u;
+        n += 1u;
+      }
+      if (p > lit)
+        mmapio_delta_push(s, (mmapio_u64)lit, (mmapio_u64)(p - lit), 0);
+      mmapio_delta_push(s, (mmapio_u64)o, (mmapio_u64)n, 1);
+      p += n;
+      lit = p;
+      have = 0;
+    } else {
+      if (e->cur_len - p > block) {
+        h = ((h - cur[p]*e->pow)*MMAPIO_DELTA_MUL + cur[p+block])
+          & 0xFFFFFFFFu;
+      }
+      p += 1u;
+    }
+  }
+  if (lit < end)
+    mmapio_delta_push(s, (mmapio_u64)lit, (mmapio_u64)(end - lit), 0);
+  return;
+}
+
+void mmapio_delta_write_one(void* arg, size_t i) {
+  struct mmapio_delta_enc* const e = (struct mmapio_delta_enc*)arg;
+  struct mmapio_delta_seg const* const s = e->segs + i;
+  unsigned char* p = e->out + (size_t)s->off;
+  mmapio_u64 expect = (mmapio_u64)i*e->segment;
+  size_t j;
+  for (j = 0u; j < s->count; ++j) {
+    struct mmapio_delta_op const* const op = s->ops + j;
+    p = mmapio_delta_vput(p, (op->len<<1) | (op->copy ? 1u : 0u));
+    if (op->copy) {
+      p = mmapio_delta_vput(p, mmapio_delta_zig(op->src, expect));
+      expect = op->src + op->len;
+    } else {
+      memcpy(p, e->cur + (size_t)op->src, (size_t)op->len);
+      p += (size_t)op->len;
+    }
+  }
+  return;
+}
+
+int mmapio_delta_run(struct mmapio_delta_enc* e, char const* nm,
+    struct mmapio_exec const* ex)
+{
+  size_t const nseg = e->cur_len/e->segment
+    + (e->cur_len%e->segment ? 1u : 0u);
+  size_t const nslots = (e->mask > 0u) ? e->mask+1u : 0u;
+  struct mmapio_i* m = NULL;
+  mmapio_u64 total = MMAPIO_DELTA_HEADER + (mmapio_u64)nseg*MMAPIO_DELTA_ENTRY;
+  int res = 0;
+  size_t i;
+  e->weak = (mmapio_u32*)malloc(e->nblocks*sizeof(mmapio_u32) + 1u);
+  e->slots = (mmapio_u32*)calloc(nslots + 1u, sizeof(mmapio_u32));
+  e->segs = (struct mmapio_delta_seg*)calloc
+    (nseg + 1u, sizeof(struct mmapio_delta_seg));
+  if (e->weak == NULL || e->slots == NULL || e->segs == NULL) {
+    errno = ENOMEM;
+    res = -1;
+  }
+  if (res == 0) {
+    /* index the old version, then encode the new one */
+    mmapio_exec_run(ex, e->nblocks/MMAPIO_DELTA_BATCH
+        + (e->nblocks%MMAPIO_DELTA_BATCH ? 1u : 0u),
+        &mmapio_delta_weak_one, e);
+    mmapio_delta_index(e);
+    mmapio_exec_run(ex, nseg, &mmapio_delta_scan_one, e);
+    for (i = 0u; i < nseg; ++i) {
+      if (e->segs[i].err) {
+        errno = ENOMEM;
+        res = -1;
+      }
+      e->segs[i].off = total;
+      total += e->segs[i].size;
+    }
+  }
+  if (res == 0 && total != (mmapio_u64)(size_t)total) {
+    errno = ERANGE;
+    res = -1;
+  }
+  if (res == 0) {
+    m = mmapio_publish_open(nm, (size_t)total);
+    e->out = (m != NULL) ? (unsigned char*)mmapio_acquire(m) : NULL;
+    if (e->out == NULL)
+      res = -1;
+  }
+  if (res == 0) {
+    unsigned char* const p = e->out;
+    memset(p, 0, MMAPIO_DELTA_HEADER);
+    mmapio_store_u32le(p, MMAPIO_DELTA_MAGIC);
+    mmapio_store_u32le(p+4, MMAPIO_DELTA_VERSION);
+    mmapio_store_u32le(p+8, (mmapio_u32)e->block);
+    mmapio_store_u64le(p+16, (mmapio_u64)e->old_len);
+    mmapio_store_u64le(p+24, (mmapio_u64)e->cur_len);
+    mmapio_store_u64le(p+32, (mmapio_u64)nseg);
+    mmapio_store_u64le(p+40, (mmapio_u64)e->segment);
+    for (i = 0u; i < nseg; ++i) {
+      unsigned char* const t = p + MMAPIO_DELTA_HEADER
+        + i*MMAPIO_DELTA_ENTRY;
+      mmapio_store_u64le(t, e->segs[i].off);
+      mmapio_store_u64le(t+8, e->segs[i].size);
+      mmapio_store_u64le(t+16, e->segs[i].hash);
+    }
+    mmapio_exec_run(ex, nseg, &mmapio_delta_write_one, e);
+    mmapio_release(m, e->out);
+    res = mmapio_publish_commit(m, 0u);
+  }
+  if (m != NULL) {
+    int const err = errno;
+    mmapio_close(m);
+    errno = err;
+  }
+  if (e->segs != NULL) {
+    for (i = 0u; i < nseg; ++i)
+      free(e->segs[i].ops);
+  }
+  free(e->segs);
+  free(e->slots);
+  free(e->weak);
+  return res;
+}
+
+int mmapio_delta_head(void const* patch, size_t len,
+    struct mmapio_delta_head* h)
+{
+  unsigned char const* const p = (unsigned char const*)patch;
+  mmapio_u64 want;
+  if (p == NULL || len < MMAPIO_DELTA_HEADER
+  ||  mmapio_load_u32le(p) != MMAPIO_DELTA_MAGIC
+  ||  mmapio_load_u32le(p+4) != MMAPIO_DELTA_VERSION)
+  {
+    return -1;
+  }
+  h->old_len = mmapio_load_u64le(p+16);
+  h->cur_len = mmapio_load_u64le(p+24);
+  h->nseg = mmapio_load_u64le(p+32);
+  h->segment = mmapio_load_u64le(p+40);
+  if (h->segment == 0u
+  ||  h->old_len != (mmapio_u64)(size_t)h->old_len
+  ||  h->cur_len != (mmapio_u64)(size_t)h->cur_len
+  ||  h->segment != (mmapio_u64)(size_t)h->segment)
+  {
+    return -1;
+  }
+  want = h->cur_len/h->segment + (h->cur_len%h->segment ? 1u : 0u);
+  if (h->nseg != want
+  ||  h->nseg > (len - MMAPIO_DELTA_HEADER)/MMAPIO_DELTA_ENTRY)
+  {
+    return -1;
+  }
+  return 0;
+}
+
+void mmapio_delta_apply_one(void* arg, size_t i) {
+  struct mmapio_delta_dec* const d = (struct mmapio_delta_dec*)arg;
+  unsigned char const* const t = d->patch + MMAPIO_DELTA_HEADER
+    + i*MMAPIO_DELTA_ENTRY;
+  mmapio_u64 const off = mmapio_load_u64le(t);
+  mmapio_u64 const size = mmapio_load_u64le(t+8);
+  size_t const start = i*d->segment;
+  size_t const n = (d->cur_len - start < d->segment)
+    ? d->cur_len - start : d->segment;
+  unsigned char* const out = d->dst + start;
+  unsigned char const* p;
+  unsigned char const* end;
+  mmapio_u64 expect = (mmapio_u64)start;
+  size_t pos = 0u;
+  int ok = (off <= d->len && size <= d->len - off);
+  p = ok ? d->patch + (size_t)off : NULL;
+  end = ok ? p + (size_t)size : NULL;
+  while (ok && p < end) {
+    mmapio_u64 tag = 0u;
+    mmapio_u64 len;
+    ok = (mmapio_delta_vget(&p, end, &tag) == 0);
+    len = tag>>1;
+    ok = ok && (len <= n - pos);
+    if (ok && (tag & 1u)) {
+      mmapio_u64 zig = 0u;
+      mmapio_u64 src;
+      ok = (mmapio_delta_vget(&p, end, &zig) == 0);
+      src = (zig & 1u) ? expect - ((zig>>1) + 1u) : expect + (zig>>1);
+      ok = ok && src <= d->old_len && len <= d->old_len - src;
+      if (ok) {
+        memcpy(out + pos, d->old + (size_t)src, (size_t)len);
+        expect = src + len;
+      }
+    } else if (ok) {
+      ok = (len <= (mmapio_u64)(end - p));
+      if (ok) {
+        memcpy(out + pos, p, (size_t)len);
+        p += (size_t)len;
+      }
+    }
+    pos += ok ? (size_t)len : 0u;
+  }
+  if (!ok || pos != n || mmapio_hash64(out, n, 0u) != mmapio_load_u64le(t+16))
+    (void)mmapio_atomic_or32(&d->fail, 1u);
+  return;
+}
+/* END   static functions */
+
+/* BEGIN binary deltas */
+int mmapio_delta_encode(char const* nm, struct mmapio_i* old,
+    struct mmapio_i* cur, struct mmapio_delta_spec const* spec)
+{
+  struct mmapio_delta_enc e;
+  size_t const block = (spec != NULL && spec->block_size > 0u)
+    ? spec->block_size : MMAPIO_DELTA_BLOCK;
+  void* old_p = NULL;
+  void* cur_p = NULL;
+  unsigned int bits = 4u;
+  int res = 0;
+  size_t i;
+  if (nm == NULL || old == NULL || cur == NULL
+  ||  block < 64u || block > ((size_t)1u<<20))
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  memset(&e, 0, sizeof(e));
+  e.block = block;
+  e.segment = (spec != NULL && spec->segment > 0u)
+    ? spec->segment : MMAPIO_DELTA_SEGMENT;
+  if (e.segment < block*16u)
+    e.segment = block*16u;
+  e.pow = 1u;
+  for (i = 1u; i < block; ++i)
+    e.pow = (e.pow*MMAPIO_DELTA_MUL) & 0xFFFFFFFFu;
+  e.old_len = mmapio_length(old);
+  e.cur_len = mmapio_length(cur);
+  e.nblocks = e.old_len/block;
+  if (e.nblocks > ((size_t)1u<<30)) {
+    errno = ERANGE;
+    return -1;
+  }
+  /* keep the index at most half full */
+  while (((size_t)1u<<bits) < e.nblocks*2u)
+    bits += 1u;
+  e.mask = e.nblocks > 0u ? ((size_t)1u<<bits) - 1u : 0u;
+  e.shift = 32u - bits;
+  if (e.old_len > 0u) {
+    old_p = mmapio_acquire(old);
+    if (old_p == NULL)
+      return -1;
+    (void)mmapio_advise(old, 0u, 0u, mmapio_advice_willneed);
+  }
+  if (e.cur_len > 0u) {
+    cur_p = mmapio_acquire(cur);
+    if (cur_p == NULL)
+      res = -1;
+    else (void)mmapio_advise(cur, 0u, 0u, mmapio_advice_sequential);
+  }
+  if (res == 0) {
+    e.old = (unsigned char const*)old_p;
+    e.cur = (unsigned char const*)cur_p;
+    res = mmapio_delta_run(&e, nm, spec != NULL ? spec->ex : NULL);
+  }
+  if (cur_p != NULL)
+    mmapio_release(cur, cur_p);
+  if (old_p != NULL)
+    mmapio_release(old, old_p);
+  return res;
+}
+
+int mmapio_delta_info(void const* patch, size_t len,
+    mmapio_u64* old_len, mmapio_u64* new_len)
+{
+  struct mmapio_delta_head h;
+  if (mmapio_delta_head(patch, len, &h) != 0) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (old_len != NULL)
+    *old_len = h.old_len;
+  if (new_len != NULL)
+    *new_len = h.cur_len;
+  return 0;
+}
+
+int mmapio_delta_apply(struct mmapio_i* dst, struct mmapio_i* old,
+    void const* patch, size_t len, struct mmapio_exec const* ex)
+{
+  struct mmapio_delta_dec d;
+  struct mmapio_delta_head h;
+  void* dst_p = NULL;
+  void* old_p = NULL;
+  int res = 0;
+  if (dst == NULL || old == NULL || mmapio_delta_head(patch, len, &h) != 0
+  ||  mmapio_length(old) != h.old_len || mmapio_length(dst) < h.cur_len)
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (h.cur_len > 0u) {
+    dst_p = mmapio_acquire(dst);
+    if (dst_p == NULL)
+      return -1;
+  }
+  if (h.old_len > 0u) {
+    old_p = mmapio_acquire(old);
+    if (old_p == NULL)
+      res = -1;
+  }
+  if (res == 0) {
+    d.dst = (unsigned char*)dst_p;
+    d.old = (unsigned char const*)old_p;
+    d.old_len = (size_t)h.old_len;
+    d.patch = (unsigned char const*)patch;
+    d.len = len;
+    d.cur_len = (size_t)h.cur_len;
+    d.segment = (size_t)h.segment;
+    d.fail = 0u;
+    mmapio_exec_run(ex, (size_t)h.nseg, &mmapio_delta_apply_one, &d);
+    if (d.fail != 0u) {
+#if (defined EINVAL)
+      errno = EINVAL;
+#else
+      errno = EDOM;
+#endif /*EINVAL*/
+      res = -1;
+    }
+  }
+  if (old_p != NULL)
+    mmapio_release(old, old_p);
+  if (dst_p != NULL)
+    mmapio_release(dst, dst_p);
+  return res;
+}
+/* END   binary deltas */
@@ -0,0 +1,90 @@
+/*
+ * \file mmapio_delta.h
+ * \brief Binary deltas between two versions of a mapped file
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Delta_H_
+#define hg_MMapIO_mmapIo_Delta_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Delta encoding parameters.
+ * \note Zero in any size field selects its default.
+ */
+struct mmapio_delta_spec {
+  /**
+   * \brief size of the old file's signature blocks; defaults to
+   *   2 KiB, from 64 bytes to 1 MiB
+   * \note Smaller blocks find more matches, but the index grows by
+   *   twelve bytes for each block.
+   */
+  size_t block_size;
+  /**
+   * \brief size of the new file's segments, each encoded and applied
+   *   on its own; defaults to 16 MiB, and grows to at least sixteen
+   *   blocks
+   */
+  size_t segment;
+  /** \brief executor for encoding in parallel, or NULL */
+  struct mmapio_exec const* ex;
+};
+
+/* BEGIN binary deltas */
+/**
+ * \brief Write a patch that turns an old file into a new one.
+ * \param nm name of the patch file to write
+ * \param old map instance of the old version
+ * \param cur map instance of the new version
+ * \param spec encoding parameters, or NULL for defaults
+ * \return zero on success, -1 otherwise
+ * \note The encoder indexes the old file by a rolling hash of each
+ *   block, then scans every segment of the new file for blocks that
+ *   match. Matches are checked byte for byte and extended in both
+ *   directions, so a patch never depends on a hash being unique.
+ * \note The patch is written through \link mmapio_publish_open
+ *   \endlink, so readers never see a partial patch.
+ */
+MMAPIO_API
+int mmapio_delta_encode(char const* nm, struct mmapio_i* old,
+    struct mmapio_i* cur, struct mmapio_delta_spec const* spec);
+
+/**
+ * \brief Read the file sizes a patch expects.
+ * \param patch patch bytes, such as a mapped patch file
+ * \param len length of the patch
+ * \param[out] old_len size of the old version; may be NULL
+ * \param[out] new_len size of the new version; may be NULL
+ * \return zero on success, -1 if the patch header is not valid
+ */
+MMAPIO_API
+int mmapio_delta_info(void const* patch, size_t len,
+    mmapio_u64* old_len, mmapio_u64* new_len);
+
+/**
+ * \brief Apply a patch.
+ * \param dst writeable map instance with room for the new version,
+ *   such as a file preallocated to the size from
+ *   \link mmapio_delta_info \endlink and opened with 'w'
+ * \param old map instance of the old version
+ * \param patch patch bytes, such as a mapped patch file
+ * \param len length of the patch
+ * \param ex executor for applying segments in parallel, or NULL
+ * \return zero on success, -1 otherwise
+ * \note Each segment checks its output against a hash stored in the
+ *   patch, so applying to the wrong old version fails with `EINVAL`.
+ */
+MMAPIO_API
+int mmapio_delta_apply(struct mmapio_i* dst, struct mmapio_i* old,
+    void const* patch, size_t len, struct mmapio_exec const* ex);
+/* END   binary deltas */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Delta_H_*/
@@ -0,0 +1,242 @@
+/*
+ * \file mmapio_endian.c
+ * \brief Unaligned, endian-explicit access to mapped binary data
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_endian.h"
+#include <string.h>
+
+#if (defined __AVX2__)
+#  include <immintrin.h>
+#  define MMAPIO_ENDIAN_AVX2 1
+#elif (defined __SSE2__) || (defined _M_X64) \
+  ||  ((defined _M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define MMAPIO_ENDIAN_SSE2 1
+#elif (defined __ARM_NEON) || (defined __ARM_NEON__)
+#  include <arm_neon.h>
+#  define MMAPIO_ENDIAN_NEON 1
+#endif /*__AVX2__*/
+
+/* BEGIN static functions */
+#if (defined MMAPIO_ENDIAN_AVX2)
+/**
+ * \brief Reverse bytes within each lane of 32-byte blocks.
+ * \param dst output array
+ * \param src input array
+ * \param n number of bytes; a multiple of 32
+ * \param order shuffle order within each 16-byte half
+ */
+static void mmapio_endian_shuffle
+  (unsigned char* dst, unsigned char const* src, size_t n, __m256i order);
+#elif (defined MMAPIO_ENDIAN_SSE2)
+/**
+ * \brief Reverse the bytes of each 16-bit lane.
+ * \param x lanes to swap
+ * \return the swapped lanes
+ */
+static __m128i mmapio_endian_swap16_sse2(__m128i x);
+#endif /*MMAPIO_ENDIAN_AVX2*/
+
+/**
+ * \brief Find the host byte order.
+ * \return 1 for little-endian, 2 for big-endian, 0 for other orders
+ */
+static int mmapio_endian_host(void);
+
+/**
+ * \brief Finish a swap with scalar code.
+ * \param dst output array
+ * \param src input array
+ * \param n number of elements
+ * \param width element width in bytes: 2, 4 or 8
+ */
+static void mmapio_endian_tail
+  (unsigned char* dst, unsigned char const* src, size_t n, unsigned width);
+
+#if (defined MMAPIO_ENDIAN_AVX2)
+void mmapio_endian_shuffle
+  (unsigned char* dst, unsigned char const* src, size_t n, __m256i order)
+{
+  size_t i;
+  for (i = 0; i < n; i += 32) {
+    __m256i const x = _mm256_loadu_si256((__m256i const*)(src+i));
+    _mm256_storeu_si256((__m256i*)(dst+i), _mm256_shuffle_epi8(x, order));
+  }
+  return;
+}
+#elif (defined MMAPIO_ENDIAN_SSE2)
+__m128i mmapio_endian_swap16_sse2(__m128i x) {
+  return _mm_or_si128(_mm_slli_epi16(x, 8), _mm_srli_epi16(x, 8));
+}
+#endif /*MMAPIO_ENDIAN_AVX2*/
+
+int mmapio_endian_host(void) {
+#if MMAPIO_ENDIAN
+  return MMAPIO_ENDIAN;
+#else
+  mmapio_u32 const v = 0x04030201u;
+  unsigned char b[4];
+  memcpy(b, &v, 4);
+  if (b[0] == 1 && b[1] == 2 && b[2] == 3 && b[3] == 4)
+    return 1;
+  else if (b[0] == 4 && b[1] == 3 && b[2] == 2 && b[3] == 1)
+    return 2;
+  else return 0;
+#endif /*MMAPIO_ENDIAN*/
+}
+
+void mmapio_endian_tail
+  (unsigned char* dst, unsigned char const* src, size_t n, unsigned width)
+{
+  size_t i;
+  switch (width) {
+  case 2:
+    for (i = 0; i < n; ++i, src += 2, dst += 2) {
+      mmapio_u16 v;
+      memcpy(&v, src, 2);
+      v = mmapio_swap_u16(v);
+      memcpy(dst, &v, 2);
+    }
+    break;
+  case 4:
+    for (i = 0; i < n; ++i, src += 4, dst += 4) {
+      mmapio_u32 v;
+      memcpy(&v, src, 4);
+      v = mmapio_swap_u32(v);
+      memcpy(dst, &v, 4);
+    }
+    break;
+  case 8:
+    for (i = 0; i < n; ++i, src += 8, dst += 8) {
+      mmapio_u64 v;
+      memcpy(&v, src, 8);
+      v = mmapio_swap_u64(v);
+      memcpy(dst, &v, 8);
+    }
+    break;
+  }
+  return;
+}
+/* END   static functions */
+
+/* BEGIN array conversion */
+void mmapio_swap_u16_n(void* dst, void const* src, size_t n) {
+  unsigned char* const d = (unsigned char*)dst;
+  unsigned char const* const s = (unsigned char const*)src;
+  size_t i = 0;
+#if (defined MMAPIO_ENDIAN_AVX2)
+  i = n & ~(size_t)15;
+  mmapio_endian_shuffle(d, s, i*2, _mm256_setr_epi8(
+      1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14,
+      1,0,3,2,5,4,7,6,9,8,11,10,13,12,15,14));
+#elif (defined MMAPIO_ENDIAN_SSE2)
+  for (; i+8 <= n; i += 8) {
+    __m128i const x = _mm_loadu_si128((__m128i const*)(s+i*2));
+    _mm_storeu_si128((__m128i*)(d+i*2), mmapio_endian_swap16_sse2(x));
+  }
+#elif (defined MMAPIO_ENDIAN_NEON)
+  for (; i+8 <= n; i += 8)
+    vst1q_u8(d+i*2, vrev16q_u8(vld1q_u8(s+i*2)));
+#endif /*MMAPIO_ENDIAN_AVX2*/
+  mmapio_endian_tail(d+i*2, s+i*2, n-i, 2);
+  return;
+}
+
+void mmapio_swap_u32_n(void* dst, void const* src, size_t n) {
+  unsigned char* const d = (unsigned char*)dst;
+  unsigned char const* const s = (unsigned char const*)src;
+  size_t i = 0;
+#if (defined MMAPIO_ENDIAN_AVX2)
+  i = n & ~(size_t)7;
+  mmapio_endian_shuffle(d, s, i*4, _mm256_setr_epi8(
+      3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12,
+      3,2,1,0,7,6,5,4,11,10,9,8,15,14,13,12));
+#elif (defined MMAPIO_ENDIAN_SSE2)
+  for (; i+4 <= n; i += 4) {
+    __m128i x = _mm_loadu_si128((__m128i const*)(s+i*4));
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(2,3,0,1));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(2,3,0,1));
+    _mm_storeu_si128((__m128i*)(d+i*4), mmapio_endian_swap16_sse2(x));
+  }
+#elif (defined MMAPIO_ENDIAN_NEON)
+  for (; i+4 <= n; i += 4)
+    vst1q_u8(d+i*4, vrev32q_u8(vld1q_u8(s+i*4)));
+#endif /*MMAPIO_ENDIAN_AVX2*/
+  mmapio_endian_tail(d+i*4, s+i*4, n-i, 4);
+  return;
+}
+
+void mmapio_swap_u64_n(void* dst, void const* src, size_t n) {
+  unsigned char* const d = (unsigned char*)dst;
+  unsigned char const* const s = (unsigned char const*)src;
+  size_t i = 0;
+#if (defined MMAPIO_ENDIAN_AVX2)
+  i = n & ~(size_t)3;
+  mmapio_endian_shuffle(d, s, i*8, _mm256_setr_epi8(
+      7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8,
+      7,6,5,4,3,2,1,0,15,14,13,12,11,10,9,8));
+#elif (defined MMAPIO_ENDIAN_SSE2)
+  for (; i+2 <= n; i += 2) {
+    __m128i x = _mm_loadu_si128((__m128i const*)(s+i*8));
+    x = _mm_shufflelo_epi16(x, _MM_SHUFFLE(0,1,2,3));
+    x = _mm_shufflehi_epi16(x, _MM_SHUFFLE(0,1,2,3));
+    _mm_storeu_si128((__m128i*)(d+i*8), mmapio_endian_swap16_sse2(x));
+  }
+#elif (defined MMAPIO_ENDIAN_NEON)
+  for (; i+2 <= n; i += 2)
+    vst1q_u8(d+i*8, vrev64q_u8(vld1q_u8(s+i*8)));
+#endif /*MMAPIO_ENDIAN_AVX2*/
+  mmapio_endian_tail(d+i*8, s+i*8, n-i, 8);
+  return;
+}
+
+void mmapio_conv_u16le_n(void* dst, void const* src, size_t n) {
+  if (mmapio_endian_host() == 1) {
+    if (dst != src)
+      memcpy(dst, src, n*2);
+  } else mmapio_swap_u16_n(dst, src, n);
+  return;
+}
+
+void mmapio_conv_u32le_n(void* dst, void const* src, size_t n) {
+  if (mmapio_endian_host() == 1) {
+    if (dst != src)
+      memcpy(dst, src, n*4);
+  } else mmapio_swap_u32_n(dst, src, n);
+  return;
+}
+
+void mmapio_conv_u64le_n(void* dst, void const* src, size_t n) {
+  if (mmapio_endian_host() == 1) {
+    if (dst != src)
+      memcpy(dst, src, n*8);
+  } else mmapio_swap_u64_n(dst, src, n);
+  return;
+}
+
+void mmapio_conv_u16be_n(void* dst, void const* src, size_t n) {
+  if (mmapio_endian_host() == 2) {
+    if (dst != src)
+      memcpy(dst, src, n*2);
+  } else mmapio_swap_u16_n(dst, src, n);
+  return;
+}
+
+void mmapio_conv_u32be_n(void* dst, void const* src, size_t n) {
+  if (mmapio_endian_host() == 2) {
+    if (dst != src)
+      memcpy(dst, src, n*4);
+  } else mmapio_swap_u32_n(dst, src, n);
+  return;
+}
+
+void mmapio_conv_u64be_n(void* dst, void const* src, size_t n) {
+  if (mmapio_endian_host() == 2) {
+    if (dst != src)
+      memcpy(dst, src, n*8);
+  } else mmapio_swap_u64_n(dst, src, n);
+  return;
+}
+/* END   array conversion */
@@ -0,0 +1,511 @@
+/*
+ * \file mmapio_endian.h
+ * \brief Unaligned, endian-explicit access to mapped binary data
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Endian_H_
+#define hg_MMapIO_mmapIo_Endian_H_
+
+#include "mmapio.h"
+#include <string.h>
+#if (defined _MSC_VER)
+#  include <stdlib.h>
+#endif /*_MSC_VER*/
+
+#ifndef MMAPIO_INLINE
+#  if (defined __STDC_VERSION__) && (__STDC_VERSION__ >= 199901L)
+#    define MMAPIO_INLINE static inline
+#  elif (defined __cplusplus)
+#    define MMAPIO_INLINE static inline
+#  elif (defined __GNUC__)
+#    define MMAPIO_INLINE static __inline__
+#  elif (defined _MSC_VER)
+#    define MMAPIO_INLINE static __inline
+#  else
+#    define MMAPIO_INLINE static
+#  endif /*__STDC_VERSION__*/
+#endif /*MMAPIO_INLINE*/
+
+/*
+ * MMAPIO_ENDIAN gives the host byte order: 1 for little-endian, 2 for
+ * big-endian, 0 if unknown. With a known order, loads and stores copy
+ * through `memcpy`, which compilers turn into one unaligned access,
+ * and swap bytes only when the orders differ. With an unknown order,
+ * they assemble values byte by byte.
+ */
+#ifndef MMAPIO_ENDIAN
+#  if (defined __BYTE_ORDER__) && (defined __ORDER_LITTLE_ENDIAN__) \
+  && (__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__)
+#    define MMAPIO_ENDIAN 1
+#  elif (defined __BYTE_ORDER__) && (defined __ORDER_BIG_ENDIAN__) \
+  && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+#    define MMAPIO_ENDIAN 2
+#  elif (defined _MSC_VER)
+#    define MMAPIO_ENDIAN 1
+#  else
+#    define MMAPIO_ENDIAN 0
+#  endif /*__BYTE_ORDER__*/
+#endif /*MMAPIO_ENDIAN*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/* BEGIN byte swaps */
+/**
+ * \brief Reverse the bytes of a 16-bit value.
+ * \param v value to swap
+ * \return the swapped value
+ */
+MMAPIO_INLINE mmapio_u16 mmapio_swap_u16(mmapio_u16 v) {
+#if (defined __GNUC__) \
+  && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 8))
+  return __builtin_bswap16(v);
+#elif (defined _MSC_VER)
+  return _byteswap_ushort(v);
+#else
+  return (mmapio_u16)(((v&0xFFu)<<8) | ((v>>8)&0xFFu));
+#endif /*__GNUC__*/
+}
+
+/**
+ * \brief Reverse the bytes of a 32-bit value.
+ * \param v value to swap
+ * \return the swapped value
+ */
+MMAPIO_INLINE mmapio_u32 mmapio_swap_u32(mmapio_u32 v) {
+#if (defined __GNUC__) \
+  && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+  return __builtin_bswap32(v);
+#elif (defined _MSC_VER)
+  return _byteswap_ulong(v);
+#else
+  return ((v&0xFFu)<<24) | ((v&0xFF00u)<<8)
+    |    ((v>>8)&0xFF00u) | ((v>>24)&0xFFu);
+#endif /*__GNUC__*/
+}
+
+/**
+ * \brief Reverse the bytes of a 64-bit value.
+ * \param v value to swap
+ * \return the swapped value
+ */
+MMAPIO_INLINE mmapio_u64 mmapio_swap_u64(mmapio_u64 v) {
+#if (defined __GNUC__) \
+  && ((__GNUC__ > 4) || (__GNUC__ == 4 && __GNUC_MINOR__ >= 3))
+  return __builtin_bswap64(v);
+#elif (defined _MSC_VER)
+  return _byteswap_uint64(v);
+#else
+  return ((mmapio_u64)mmapio_swap_u32((mmapio_u32)(v&0xFFFFFFFFu))<<32)
+    |    (mmapio_u64)mmapio_swap_u32((mmapio_u32)(v>>32));
+#endif /*__GNUC__*/
+}
+/* END   byte swaps */
+
+/* BEGIN little-endian access */
+/**
+ * \brief Load a little-endian 16-bit value from any address.
+ * \param p address of the value
+ * \return the value in host order
+ */
+MMAPIO_INLINE mmapio_u16 mmapio_load_u16le(void const* p) {
+#if MMAPIO_ENDIAN
+  mmapio_u16 v;
+  memcpy(&v, p, sizeof(v));
+  return (MMAPIO_ENDIAN == 1) ? v : mmapio_swap_u16(v);
+#else
+  unsigned char const* const b = (unsigned char const*)p;
+  return (mmapio_u16)(b[0] | (b[1]<<8));
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Load a little-endian 32-bit value from any address.
+ * \param p address of the value
+ * \return the value in host order
+ */
+MMAPIO_INLINE mmapio_u32 mmapio_load_u32le(void const* p) {
+#if MMAPIO_ENDIAN
+  mmapio_u32 v;
+  memcpy(&v, p, sizeof(v));
+  return (MMAPIO_ENDIAN == 1) ? v : mmapio_swap_u32(v);
+#else
+  unsigned char const* const b = (unsigned char const*)p;
+  return ((mmapio_u32)b[0]) | ((mmapio_u32)b[1]<<8)
+    |    ((mmapio_u32)b[2]<<16) | ((mmapio_u32)b[3]<<24);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Load a little-endian 64-bit value from any address.
+ * \param p address of the value
+ * \return the value in host order
+ */
+MMAPIO_INLINE mmapio_u64 mmapio_load_u64le(void const* p) {
+#if MMAPIO_ENDIAN
+  mmapio_u64 v;
+  memcpy(&v, p, sizeof(v));
+  return (MMAPIO_ENDIAN == 1) ? v : mmapio_swap_u64(v);
+#else
+  return ((mmapio_u64)mmapio_load_u32le(((unsigned char const*)p)+4)<<32)
+    |    (mmapio_u64)mmapio_load_u32le(p);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Load a little-endian IEEE 754 single from any address.
+ * \param p address of the value
+ * \return the value
+ */
+MMAPIO_INLINE float mmapio_load_f32le(void const* p) {
+  mmapio_u32 const u = mmapio_load_u32le(p);
+  float v;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+/**
+ * \brief Load a little-endian IEEE 754 double from any address.
+ * \param p address of the value
+ * \return the value
+ */
+MMAPIO_INLINE double mmapio_load_f64le(void const* p) {
+  mmapio_u64 const u = mmapio_load_u64le(p);
+  double v;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+/**
+ * \brief Store a 16-bit value in little-endian order at any address.
+ * \param p address of the value
+ * \param v value in host order
+ */
+MMAPIO_INLINE void mmapio_store_u16le(void* p, mmapio_u16 v) {
+#if MMAPIO_ENDIAN
+  if (MMAPIO_ENDIAN != 1)
+    v = mmapio_swap_u16(v);
+  memcpy(p, &v, sizeof(v));
+#else
+  unsigned char* const b = (unsigned char*)p;
+  b[0] = (unsigned char)(v&255u);
+  b[1] = (unsigned char)((v>>8)&255u);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Store a 32-bit value in little-endian order at any address.
+ * \param p address of the value
+ * \param v value in host order
+ */
+MMAPIO_INLINE void mmapio_store_u32le(void* p, mmapio_u32 v) {
+#if MMAPIO_ENDIAN
+  if (MMAPIO_ENDIAN != 1)
+    v = mmapio_swap_u32(v);
+  memcpy(p, &v, sizeof(v));
+#else
+  unsigned char* const b = (unsigned char*)p;
+  b[0] = (unsigned char)(v&255u);
+  b[1] = (unsigned char)((v>>8)&255u);
+  b[2] = (unsigned char)((v>>16)&255u);
+  b[3] = (unsigned char)((v>>24)&255u);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Store a 64-bit value in little-endian order at any address.
+ * \param p address of the value
+ * \param v value in host order
+ */
+MMAPIO_INLINE void mmapio_store_u64le(void* p, mmapio_u64 v) {
+#if MMAPIO_ENDIAN
+  if (MMAPIO_ENDIAN != 1)
+    v = mmapio_swap_u64(v);
+  memcpy(p, &v, sizeof(v));
+#else
+  mmapio_store_u32le(p, (mmapio_u32)(v&0xFFFFFFFFu));
+  mmapio_store_u32le(((unsigned char*)p)+4, (mmapio_u32)(v>>32));
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Store an IEEE 754 single in little-endian order at any address.
+ * \param p address of the value
+ * \param v value
+ */
+MMAPIO_INLINE void mmapio_store_f32le(void* p, float v) {
+  mmapio_u32 u;
+  memcpy(&u, &v, sizeof(u));
+  mmapio_store_u32le(p, u);
+}
+
+/**
+ * \brief Store an IEEE 754 double in little-endian order at any address.
+ * \param p address of the value
+ * \param v value
+ */
+MMAPIO_INLINE void mmapio_store_f64le(void* p, double v) {
+  mmapio_u64 u;
+  memcpy(&u, &v, sizeof(u));
+  mmapio_store_u64le(p, u);
+}
+/* END   little-endian access */
+
+/* BEGIN big-endian access */
+/**
+ * \brief Load a big-endian 16-bit value from any address.
+ * \param p address of the value
+ * \return the value in host order
+ */
+MMAPIO_INLINE mmapio_u16 mmapio_load_u16be(void const* p) {
+#if MMAPIO_ENDIAN
+  mmapio_u16 v;
+  memcpy(&v, p, sizeof(v));
+  return (MMAPIO_ENDIAN == 2) ? v : mmapio_swap_u16(v);
+#else
+  unsigned char const* const b = (unsigned char const*)p;
+  return (mmapio_u16)((b[0]<<8) | b[1]);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Load a big-endian 32-bit value from any address.
+ * \param p address of the value
+ * \return the value in host order
+ */
+MMAPIO_INLINE mmapio_u32 mmapio_load_u32be(void const* p) {
+#if MMAPIO_ENDIAN
+  mmapio_u32 v;
+  memcpy(&v, p, sizeof(v));
+  return (MMAPIO_ENDIAN == 2) ? v : mmapio_swap_u32(v);
+#else
+  unsigned char const* const b = (unsigned char const*)p;
+  return ((mmapio_u32)b[0]<<24) | ((mmapio_u32)b[1]<<16)
+    |    ((mmapio_u32)b[2]<<8) | ((mmapio_u32)b[3]);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Load a big-endian 64-bit value from any address.
+ * \param p address of the value
+ * \return the value in host order
+ */
+MMAPIO_INLINE mmapio_u64 mmapio_load_u64be(void const* p) {
+#if MMAPIO_ENDIAN
+  mmapio_u64 v;
+  memcpy(&v, p, sizeof(v));
+  return (MMAPIO_ENDIAN == 2) ? v : mmapio_swap_u64(v);
+#else
+  return ((mmapio_u64)mmapio_load_u32be(p)<<32)
+    |    (mmapio_u64)mmapio_load_u32be(((unsigned char const*)p)+4);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Load a big-endian IEEE 754 single from any address.
+ * \param p address of the value
+ * \return the value
+ */
+MMAPIO_INLINE float mmapio_load_f32be(void const* p) {
+  mmapio_u32 const u = mmapio_load_u32be(p);
+  float v;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+/**
+ * \brief Load a big-endian IEEE 754 double from any address.
+ * \param p address of the value
+ * \return the value
+ */
+MMAPIO_INLINE double mmapio_load_f64be(void const* p) {
+  mmapio_u64 const u = mmapio_load_u64be(p);
+  double v;
+  memcpy(&v, &u, sizeof(v));
+  return v;
+}
+
+/**
+ * \brief Store a 16-bit value in big-endian order at any address.
+ * \param p address of the value
+ * \param v value in host order
+ */
+MMAPIO_INLINE void mmapio_store_u16be(void* p, mmapio_u16 v) {
+#if MMAPIO_ENDIAN
+  if (MMAPIO_ENDIAN != 2)
+    v = mmapio_swap_u16(v);
+  memcpy(p, &v, sizeof(v));
+#else
+  unsigned char* const b = (unsigned char*)p;
+  b[0] = (unsigned char)((v>>8)&255u);
+  b[1] = (unsigned char)(v&255u);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Store a 32-bit value in big-endian order at any address.
+ * \param p address of the value
+ * \param v value in host order
+ */
+MMAPIO_INLINE void mmapio_store_u32be(void* p, mmapio_u32 v) {
+#if MMAPIO_ENDIAN
+  if (MMAPIO_ENDIAN != 2)
+    v = mmapio_swap_u32(v);
+  memcpy(p, &v, sizeof(v));
+#else
+  unsigned char* const b = (unsigned char*)p;
+  b[0] = (unsigned char)((v>>24)&255u);
+  b[1] = (unsigned char)((v>>16)&255u);
+  b[2] = (unsigned char)((v>>8)&255u);
+  b[3] = (unsigned char)(v&255u);
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Store a 64-bit value in big-endian order at any address.
+ * \param p address of the value
+ * \param v value in host order
+ */
+MMAPIO_INLINE void mmapio_store_u64be(void* p, mmapio_u64 v) {
+#if MMAPIO_ENDIAN
+  if (MMAPIO_ENDIAN != 2)
+    v = mmapio_swap_u64(v);
+  memcpy(p, &v, sizeof(v));
+#else
+  mmapio_store_u32be(p, (mmapio_u32)(v>>32));
+  mmapio_store_u32be(((unsigned char*)p)+4, (mmapio_u32)(v&0xFFFFFFFFu));
+#endif /*MMAPIO_ENDIAN*/
+}
+
+/**
+ * \brief Store an IEEE 754 single in big-endian order at any address.
+ * \param p address of the value
+ * \param v value
+ */
+MMAPIO_INLINE void mmapio_store_f32be(void* p, float v) {
+  mmapio_u32 u;
+  memcpy(&u, &v, sizeof(u));
+  mmapio_store_u32be(p, u);
+}
+
+/**
+ * \brief Store an IEEE 754 double in big-endian order at any address.
+ * \param p address of the value
+ * \param v value
+ */
+MMAPIO_INLINE void mmapio_store_f64be(void* p, double v) {
+  mmapio_u64 u;
+  memcpy(&u, &v, sizeof(u));
+  mmapio_store_u64be(p, u);
+}
+/* END   big-endian access */
+
+/* BEGIN array conversion */
+/**
+ * \brief Reverse the bytes of each 16-bit element of an array.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ * \note Neither array needs any alignment.
+ */
+MMAPIO_API
+void mmapio_swap_u16_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Reverse the bytes of each 32-bit element of an array.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ * \note Also suits arrays of IEEE 754 singles.
+ */
+MMAPIO_API
+void mmapio_swap_u32_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Reverse the bytes of each 64-bit element of an array.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ * \note Also suits arrays of IEEE 754 doubles.
+ */
+MMAPIO_API
+void mmapio_swap_u64_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Convert an array of 16-bit elements between little-endian
+ *   and host order.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ * \note The conversion is its own inverse, so the same call serves
+ *   loading and storing.
+ */
+MMAPIO_API
+void mmapio_conv_u16le_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Convert an array of 32-bit elements between little-endian
+ *   and host order.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ */
+MMAPIO_API
+void mmapio_conv_u32le_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Convert an array of 64-bit elements between little-endian
+ *   and host order.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ */
+MMAPIO_API
+void mmapio_conv_u64le_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Convert an array of 16-bit elements between big-endian
+ *   and host order.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ */
+MMAPIO_API
+void mmapio_conv_u16be_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Convert an array of 32-bit elements between big-endian
+ *   and host order.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ */
+MMAPIO_API
+void mmapio_conv_u32be_n(void* dst, void const* src, size_t n);
+
+/**
+ * \brief Convert an array of 64-bit elements between big-endian
+ *   and host order.
+ * \param dst output array; may equal `src`, but may not otherwise
+ *   overlap it
+ * \param src input array
+ * \param n number of elements
+ */
+MMAPIO_API
+void mmapio_conv_u64be_n(void* dst, void const* src, size_t n);
+/* END   array conversion */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Endian_H_*/
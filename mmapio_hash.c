@@ -0,0 +1,284 @@
+/*
+ * \file mmapio_hash.c
+ * \brief Hash functions for keys and content in mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_hash.h"
+#include "mmapio_endian.h"
+#include <string.h>
+
+#if (defined __SHA__) && (defined __SSE4_1__)
+#  include <immintrin.h>
+#  define MMAPIO_HASH_SHANI 1
+#endif /*__SHA__*/
+
+/**
+ * \brief Build a 64-bit constant from two 32-bit halves.
+ */
+#define MMAPIO_HASH_U64(hi, lo) \
+  (((mmapio_u64)(hi)<<32) | (mmapio_u64)(lo))
+
+/**
+ * \brief XXH64 primes.
+ */
+#define MMAPIO_HASH_P1 MMAPIO_HASH_U64(0x9E3779B1u, 0x85EBCA87u)
+#define MMAPIO_HASH_P2 MMAPIO_HASH_U64(0xC2B2AE3Du, 0x27D4EB4Fu)
+#define MMAPIO_HASH_P3 MMAPIO_HASH_U64(0x165667B1u, 0x9E3779F9u)
+#define MMAPIO_HASH_P4 MMAPIO_HASH_U64(0x85EBCA77u, 0xC2B2AE63u)
+#define MMAPIO_HASH_P5 MMAPIO_HASH_U64(0x27D4EB2Fu, 0x165667C5u)
+
+/**
+ * \brief Rotate a 32-bit word right.
+ */
+#define MMAPIO_HASH_ROTR(x, r) \
+  ((((x)>>(r)) | ((x)<<(32u-(r)))) & 0xFFFFFFFFu)
+
+/**
+ * \brief SHA-256 round constants.
+ */
+static mmapio_u32 const mmapio_sha256_k[64] = {
+  0x428A2F98u, 0x71374491u, 0xB5C0FBCFu, 0xE9B5DBA5u,
+  0x3956C25Bu, 0x59F111F1u, 0x923F82A4u, 0xAB1C5ED5u,
+  0xD807AA98u, 0x12835B01u, 0x243185BEu, 0x550C7DC3u,
+  0x72BE5D74u, 0x80DEB1FEu, 0x9BDC06A7u, 0xC19BF174u,
+  0xE49B69C1u, 0xEFBE4786u, 0x0FC19DC6u, 0x240CA1CCu,
+  0x2DE92C6Fu, 0x4A7484AAu, 0x5CB0A9DCu, 0x76F988DAu,
+  0x983E5152u, 0xA831C66Du, 0xB00327C8u, 0xBF597FC7u,
+  0xC6E00BF3u, 0xD5A79147u, 0x06CA6351u, 0x14292967u,
+  0x27B70A85u, 0x2E1B2138u, 0x4D2C6DFCu, 0x53380D13u,
+  0x650A7354u, 0x766A0ABBu, 0x81C2C92Eu, 0x92722C85u,
+  0xA2BFE8A1u, 0xA81A664Bu, 0xC24B8B70u, 0xC76C51A3u,
+  0xD192E819u, 0xD6990624u, 0xF40E3585u, 0x106AA070u,
+  0x19A4C116u, 0x1E376C08u, 0x2748774Cu, 0x34B0BCB5u,
+  0x391C0CB3u, 0x4ED8AA4Au, 0x5B9CCA4Fu, 0x682E6FF3u,
+  0x748F82EEu, 0x78A5636Fu, 0x84C87814u, 0x8CC70208u,
+  0x90BEFFFAu, 0xA4506CEBu, 0xBEF9A3F7u, 0xC67178F2u
+};
+
+/* BEGIN static functions */
+/**
+ * \brief Rotate a word left.
+ * \param x word
+ * \param r rotation count, from 1 to 63
+ * \return the rotated word
+ */
+static mmapio_u64 mmapio_hash_rotl(mmapio_u64 x, unsigned int r);
+
+/**
+ * \brief Mix one input word into an accumulator.
+ * \param acc accumulator
+ * \param v input word
+ * \return the new accumulator
+ */
+static mmapio_u64 mmapio_hash_round(mmapio_u64 acc, mmapio_u64 v);
+
+/**
+ * \brief Fold a lane accumulator into the hash.
+ * \param h hash
+ * \param v lane accumulator
+ * \return the new hash
+ */
+static mmapio_u64 mmapio_hash_merge(mmapio_u64 h, mmapio_u64 v);
+
+/**
+ * \brief Mix 64-byte blocks into a SHA-256 state.
+ * \param st state words
+ * \param b blocks
+ * \param n number of blocks
+ * \note With the SHA extensions, the state stays in vector registers
+ *   across blocks.
+ */
+static void mmapio_sha256_blocks
+  (mmapio_u32* st, unsigned char const* b, size_t n);
+
+mmapio_u64 mmapio_hash_rotl(mmapio_u64 x, unsigned int r) {
+  return (x<<r) | (x>>(64u-r));
+}
+
+mmapio_u64 mmapio_hash_round(mmapio_u64 acc, mmapio_u64 v) {
+  acc += v * MMAPIO_HASH_P2;
+  acc = mmapio_hash_rotl(acc, 31u);
+  return acc * MMAPIO_HASH_P1;
+}
+
+mmapio_u64 mmapio_hash_merge(mmapio_u64 h, mmapio_u64 v) {
+  h ^= mmapio_hash_round(0u, v);
+  return h * MMAPIO_HASH_P1 + MMAPIO_HASH_P4;
+}
+
+#if (defined MMAPIO_HASH_SHANI)
+void mmapio_sha256_blocks
+  (mmapio_u32* st, unsigned char const* b, size_t n)
+{
+  __m128i const swap = _mm_set_epi8
+    (12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+  __m128i abef, cdgh, tmp;
+#if (defined __AVX__)
+  /* the SHA instructions have no VEX form; avoid the transition stall */
+  _mm256_zeroupper();
+#endif /*__AVX__*/
+  tmp = _mm_shuffle_epi32(_mm_loadu_si128((__m128i const*)st), 0xB1);
+  cdgh = _mm_shuffle_epi32(_mm_loadu_si128((__m128i const*)(st+4)), 0x1B);
+  abef = _mm_alignr_epi8(tmp, cdgh, 8);
+  cdgh = _mm_blend_epi16(cdgh, tmp, 0xF0);
+  for (; n > 0u; --n, b += 64) {
+    __m128i const abef_in = abef;
+    __m128i const cdgh_in = cdgh;
+    __m128i m[4];
+    unsigned int g;
+    /* sixteen groups of four rounds; m[] holds the message schedule */
+    for (g = 0u; g < 16u; ++g) {
+      __m128i w;
+      if (g < 4u) {
+        m[g] = _mm_shuffle_epi8
+          (_mm_loadu_si128((__m128i const*)(b + g*16u)), swap);
+      }
+      w = _mm_add_epi32(m[g&3u],
+          _mm_loadu_si128((__m128i const*)(mmapio_sha256_k + g*4u)));
+      cdgh = _mm_sha256rnds2_epu32(cdgh, abef, w);
+      if (g >= 3u && g <= 14u) {
+        __m128i* const next = m + ((g+1u)&3u);
+        *next = _mm_add_epi32(*next,
+            _mm_alignr_epi8(m[g&3u], m[(g-1u)&3u], 4));
+        *next = _mm_sha256msg2_epu32(*next, m[g&3u]);
+      }
+      abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(w, 0x0E));
+      if (g >= 1u && g <= 12u)
+        m[(g-1u)&3u] = _mm_sha256msg1_epu32(m[(g-1u)&3u], m[g&3u]);
+    }
+    abef = _mm_add_epi32(abef, abef_in);
+    cdgh = _mm_add_epi32(cdgh, cdgh_in);
+  }
+  tmp = _mm_shuffle_epi32(abef, 0x1B);
+  cdgh = _mm_shuffle_epi32(cdgh, 0xB1);
+  _mm_storeu_si128((__m128i*)st, _mm_blend_epi16(tmp, cdgh, 0xF0));
+  _mm_storeu_si128((__m128i*)(st+4), _mm_alignr_epi8(cdgh, tmp, 8));
+  return;
+}
+#else
+void mmapio_sha256_blocks
+  (mmapio_u32* st, unsigned char const* b, size_t n)
+{
+  mmapio_u32 w[64];
+  mmapio_u32 v[8];
+  unsigned int i;
+  for (; n > 0u; --n, b += 64) {
+    for (i = 0u; i < 16u; ++i)
+      w[i] = mmapio_load_u32be(b + i*4u);
+    for (; i < 64u; ++i) {
+      mmapio_u32 const a = w[i-15u];
+      mmapio_u32 const c = w[i-2u];
+      mmapio_u32 const s0 = MMAPIO_HASH_ROTR(a, 7u)
+        ^ MMAPIO_HASH_ROTR(a, 18u) ^ (a>>3);
+      mmapio_u32 const s1 = MMAPIO_HASH_ROTR(c, 17u)
+        ^ MMAPIO_HASH_ROTR(c, 19u) ^ (c>>10);
+      w[i] = (w[i-16u] + s0 + w[i-7u] + s1) & 0xFFFFFFFFu;
+    }
+    memcpy(v, st, sizeof(v));
+    for (i = 0u; i < 64u; ++i) {
+      mmapio_u32 const e = v[4];
+      mmapio_u32 const a = v[0];
+      mmapio_u32 const t1 = (v[7] + (MMAPIO_HASH_ROTR(e, 6u)
+          ^ MMAPIO_HASH_ROTR(e, 11u) ^ MMAPIO_HASH_ROTR(e, 25u))
+        + ((e & v[5]) ^ (~e & v[6])) + mmapio_sha256_k[i] + w[i])
+        & 0xFFFFFFFFu;
+      mmapio_u32 const t2 = ((MMAPIO_HASH_ROTR(a, 2u)
+          ^ MMAPIO_HASH_ROTR(a, 13u) ^ MMAPIO_HASH_ROTR(a, 22u))
+        + ((a & v[1]) ^ (a & v[2]) ^ (v[1] & v[2]))) & 0xFFFFFFFFu;
+      v[7] = v[6];
+      v[6] = v[5];
+      v[5] = e;
+      v[4] = (v[3] + t1) & 0xFFFFFFFFu;
+      v[3] = v[2];
+      v[2] = v[1];
+      v[1] = a;
+      v[0] = (t1 + t2) & 0xFFFFFFFFu;
+    }
+    for (i = 0u; i < 8u; ++i)
+      st[i] = (st[i] + v[i]) & 0xFFFFFFFFu;
+  }
+  return;
+}
+#endif /*MMAPIO_HASH_SHANI*/
+/* END   static functions */
+
+/* BEGIN hash functions */
+mmapio_u64 mmapio_hash64(void const* p, size_t len, mmapio_u64 seed) {
+  unsigned char const* s = (unsigned char const*)p;
+  size_t n = len;
+  mmapio_u64 h;
+  if (n >= 32u) {
+    /* four independent lanes over 32-byte stripes */
+    mmapio_u64 v1 = seed + MMAPIO_HASH_P1 + MMAPIO_HASH_P2;
+    mmapio_u64 v2 = seed + MMAPIO_HASH_P2;
+    mmapio_u64 v3 = seed;
+    mmapio_u64 v4 = seed - MMAPIO_HASH_P1;
+    do {
+      v1 = mmapio_hash_round(v1, mmapio_load_u64le(s));
+      v2 = mmapio_hash_round(v2, mmapio_load_u64le(s+8));
+      v3 = mmapio_hash_round(v3, mmapio_load_u64le(s+16));
+      v4 = mmapio_hash_round(v4, mmapio_load_u64le(s+24));
+      s += 32;
+      n -= 32u;
+    } while (n >= 32u);
+    h = mmapio_hash_rotl(v1, 1u) + mmapio_hash_rotl(v2, 7u)
+      + mmapio_hash_rotl(v3, 12u) + mmapio_hash_rotl(v4, 18u);
+    h = mmapio_hash_merge(h, v1);
+    h = mmapio_hash_merge(h, v2);
+    h = mmapio_hash_merge(h, v3);
+    h = mmapio_hash_merge(h, v4);
+  } else h = seed + MMAPIO_HASH_P5;
+  h += (mmapio_u64)len;
+  for (; n >= 8u; n -= 8u, s += 8) {
+    h ^= mmapio_hash_round(0u, mmapio_load_u64le(s));
+    h = mmapio_hash_rotl(h, 27u) * MMAPIO_HASH_P1 + MMAPIO_HASH_P4;
+  }
+  if (n >= 4u) {
+    h ^= (mmapio_u64)mmapio_load_u32le(s) * MMAPIO_HASH_P1;
+    h = mmapio_hash_rotl(h, 23u) * MMAPIO_HASH_P2 + MMAPIO_HASH_P3;
+    s += 4;
+    n -= 4u;
+  }
+  for (; n > 0u; --n, ++s) {
+    h ^= (mmapio_u64)(*s) * MMAPIO_HASH_P5;
+    h = mmapio_hash_rotl(h, 11u) * MMAPIO_HASH_P1;
+  }
+  /* final avalanche */
+  h ^= h>>33;
+  h *= MMAPIO_HASH_P2;
+  h ^= h>>29;
+  h *= MMAPIO_HASH_P3;
+  h ^= h>>32;
+  return h;
+}
+
+void mmapio_sha256(void const* p, size_t len, unsigned char* out) {
+  unsigned char const* s = (unsigned char const*)p;
+  mmapio_u32 st[8] = {
+    0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au,
+    0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u
+  };
+  unsigned char tail[128];
+  size_t n = len;
+  size_t tn;
+  unsigned int i;
+  mmapio_sha256_blocks(st, s, n/64u);
+  s += n - n%64u;
+  n %= 64u;
+  /* pad with a one bit, zeros and the bit length */
+  memset(tail, 0, sizeof(tail));
+  if (n > 0u)
+    memcpy(tail, s, n);
+  tail[n] = 0x80u;
+  tn = (n < 56u) ? 64u : 128u;
+  mmapio_store_u32be(tail + tn - 8u,
+      (mmapio_u32)(((mmapio_u64)len>>29) & 0xFFFFFFFFu));
+  mmapio_store_u32be(tail + tn - 4u,
+      (mmapio_u32)(((mmapio_u64)len<<3) & 0xFFFFFFFFu));
+  mmapio_sha256_blocks(st, tail, tn/64u);
+  for (i = 0u; i < 8u; ++i)
+    mmapio_store_u32be(out + i*4u, st[i]);
+  return;
+}
+/* END   hash functions */
@@ -0,0 +1,45 @@
+/*
+ * \file mmapio_hash.h
+ * \brief Hash functions for keys and content in mapped files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Hash_H_
+#define hg_MMapIO_mmapIo_Hash_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/* BEGIN hash functions */
+/**
+ * \brief Compute a fast 64-bit hash.
+ * \param p bytes to hash
+ * \param len number of bytes
+ * \param seed hash seed
+ * \return the hash value
+ * \note The function implements the XXH64 algorithm, so its values
+ *   match other XXH64 implementations and may be stored in files. It
+ *   is not suited to adversarial input.
+ */
+MMAPIO_API
+mmapio_u64 mmapio_hash64(void const* p, size_t len, mmapio_u64 seed);
+
+/**
+ * \brief Compute a SHA-256 digest.
+ * \param p bytes to hash
+ * \param len number of bytes
+ * \param[out] out 32-byte digest
+ * \note Use this digest where content must be told apart reliably,
+ *   such as deduplication of stored chunks.
+ */
+MMAPIO_API
+void mmapio_sha256(void const* p, size_t len, unsigned char* out);
+/* END   hash functions */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Hash_H_*/
@@ -0,0 +1,801 @@
+/*
+ * \file mmapio_lz.c
+ * \brief Block-compressed containers with random access
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_lz.h"
+#include "mmapio_atomic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * \brief Container signature ("MMLZ" in little-endian order).
+ */
+#define MMAPIO_LZ_MAGIC 0x5A4C4D4Du
+
+/**
+ * \brief Container format version.
+ */
+#define MMAPIO_LZ_VERSION 1u
+
+/**
+ * \brief Size of the container header.
+ */
+#define MMAPIO_LZ_HEADER 64u
+
+/**
+ * \brief Number of bits in a codec hash table index.
+ */
+#define MMAPIO_LZ_HASH_BITS 12
+
+/**
+ * \brief Shortest match the codec encodes.
+ */
+#define MMAPIO_LZ_MIN_MATCH 4u
+
+/**
+ * \brief Matches may not start within this many bytes of the end.
+ */
+#define MMAPIO_LZ_TAIL 12u
+
+/**
+ * \brief Lock polls to try before yielding the processor.
+ */
+#define MMAPIO_LZ_SPINS 64u
+
+/**
+ * \brief Cache slot states.
+ */
+enum mmapio_lz_state {
+  mmapio_lz_empty = 0,
+  mmapio_lz_loading = 1,
+  mmapio_lz_ready = 2
+};
+
+/**
+ * \brief Cache slot for one decompressed block.
+ */
+struct mmapio_lz_slot {
+  /** \brief block index */
+  size_t block;
+  /** \brief number of holders */
+  size_t refs;
+  /** \brief last use, for eviction */
+  mmapio_u64 stamp;
+  /** \brief slot state */
+  int state;
+};
+
+/**
+ * \brief Reader for a mapped block-compressed container.
+ */
+struct mmapio_lz {
+  /** \brief container map instance */
+  struct mmapio_i* container;
+  /** \brief acquired container bytes */
+  unsigned char const* base;
+  /** \brief uncompressed size */
+  size_t raw_size;
+  /** \brief uncompressed block size */
+  size_t block_size;
+  /** \brief number of blocks */
+  size_t count;
+  /** \brief number of cache slots */
+  size_t nslots;
+  /** \brief cache slots */
+  struct mmapio_lz_slot* slots;
+  /** \brief cache buffers, one block per slot */
+  unsigned char* bufs;
+  /** \brief use counter */
+  mmapio_u64 clock;
+  /** \brief cache spin lock */
+  mmapio_u32 volatile lock;
+};
+
+/**
+ * \brief Map interface over one block of a container.
+ */
+struct mmapio_lz_view {
+  /** \brief base structure */
+  struct mmapio_i base;
+  /** \brief reader */
+  struct mmapio_lz* r;
+  /** \brief block index */
+  size_t block;
+};
+
+/**
+ * \brief Context for container building tasks.
+ */
+struct mmapio_lz_pack_task {
+  unsigned char* dst;
+  unsigned char const* src;
+  size_t srclen;
+  size_t block_size;
+  size_t stride;
+  size_t data_start;
+};
+
+/**
+ * \brief Context for prefetch tasks.
+ */
+struct mmapio_lz_prefetch_task {
+  struct mmapio_lz* r;
+  size_t first;
+};
+
+/**
+ * \brief Read a little-endian 32-bit value.
+ * \param p source bytes
+ * \return the value
+ */
+static mmapio_u32 mmapio_lz_get32(unsigned char const* p);
+
+/**
+ * \brief Read a little-endian 64-bit value.
+ * \param p source bytes
+ * \return the value
+ */
+static mmapio_u64 mmapio_lz_get64(unsigned char const* p);
+
+/**
+ * \brief Write a little-endian 32-bit value.
+ * \param p destination bytes
+ * \param v the value
+ */
+static void mmapio_lz_put32(unsigned char* p, mmapio_u32 v);
+
+/**
+ * \brief Write a little-endian 64-bit value.
+ * \param p destination bytes
+ * \param v the value
+ */
+static void mmapio_lz_put64(unsigned char* p, mmapio_u64 v);
+
+/**
+ * \brief Write a codec length extension.
+ * \param op output position
+ * \param oend end of output
+ * \param n remaining length after the token nibble
+ * \return the new output position, or NULL if out of room
+ */
+static unsigned char* mmapio_lz_put_len
+  (unsigned char* op, unsigned char* oend, size_t n);
+
+/**
+ * \brief Write one codec sequence.
+ * \param op output position
+ * \param oend end of output
+ * \param lit start of literals
+ * \param nlit number of literals
+ * \param dist match distance, or zero for the final sequence
+ * \param nmatch match length
+ * \return the new output position, or NULL if out of room
+ */
+static unsigned char* mmapio_lz_put_seq
+  (unsigned char* op, unsigned char* oend, unsigned char const* lit,
+    size_t nlit, size_t dist, size_t nmatch);
+
+/**
+ * \brief Compress one block of a container.
+ * \param arg a \link mmapio_lz_pack_task \endlink
+ * \param i block index
+ */
+static void mmapio_lz_pack_one(void* arg, size_t i);
+
+/**
+ * \brief Decompress one block ahead of use.
+ * \param arg a \link mmapio_lz_prefetch_task \endlink
+ * \param i index from the first prefetched block
+ */
+static void mmapio_lz_prefetch_one(void* arg, size_t i);
+
+/**
+ * \brief Compute the uncompressed length of a block.
+ * \param r reader
+ * \param i block index
+ * \return a length in bytes
+ */
+static size_t mmapio_lz_raw_len(struct mmapio_lz const* r, size_t i);
+
+/**
+ * \brief Take the cache lock.
+ * \param r reader
+ */
+static void mmapio_lz_lock(struct mmapio_lz* r);
+
+/**
+ * \brief Give back the cache lock.
+ * \param r reader
+ */
+static void mmapio_lz_unlock(struct mmapio_lz* r);
+
+/**
+ * \brief Destructor; frees a block view.
+ * \param m map instance
+ */
+static void mmapio_lz_mmi_dtor(struct mmapio_i* m);
+
+/**
+ * \brief Acquire the block of a view.
+ * \param m map instance
+ * \return pointer to the block on success, NULL otherwise
+ */
+static void* mmapio_lz_mmi_acquire(struct mmapio_i* m);
+
+/**
+ * \brief Release the block of a view.
+ * \param m map instance
+ * \param p pointer of region to release
+ */
+static void mmapio_lz_mmi_release(struct mmapio_i* m, void* p);
+
+/**
+ * \brief Check the length of a view's block.
+ * \param m map instance
+ * \return the uncompressed length of the block
+ */
+static size_t mmapio_lz_mmi_length(struct mmapio_i const* m);
+
+/* BEGIN static functions */
+mmapio_u32 mmapio_lz_get32(unsigned char const* p) {
+  return ((mmapio_u32)p[0])
+    |    (((mmapio_u32)p[1])<<8)
+    |    (((mmapio_u32)p[2])<<16)
+    |    (((mmapio_u32)p[3])<<24);
+}
+
+mmapio_u64 mmapio_lz_get64(unsigned char const* p) {
+  return ((mmapio_u64)mmapio_lz_get32(p))
+    |    (((mmapio_u64)mmapio_lz_get32(p+4))<<32);
+}
+
+void mmapio_lz_put32(unsigned char* p, mmapio_u32 v) {
+  p[0] = (unsigned char)(v&255u);
+  p[1] = (unsigned char)((v>>8)&255u);
+  p[2] = (unsigned char)((v>>16)&255u);
+  p[3] = (unsigned char)((v>>24)&255u);
+  return;
+}
+
+void mmapio_lz_put64(unsigned char* p, mmapio_u64 v) {
+  mmapio_lz_put32(p, (mmapio_u32)(v&0xFFFFFFFFu));
+  mmapio_lz_put32(p+4, (mmapio_u32)(v>>32));
+  return;
+}
+
+unsigned char* mmapio_lz_put_len
+  (unsigned char* op, unsigned char* oend, size_t n)
+{
+  for (; n >= 255u; n -= 255u) {
+    if (op >= oend)
+      return NULL;
+    *(op++) = 255u;
+  }
+  if (op >= oend)
+    return NULL;
+  *(op++) = (unsigned char)n;
+  return op;
+}
+
+unsigned char* mmapio_lz_put_seq
+  (unsigned char* op, unsigned char* oend, unsigned char const* lit,
+    size_t nlit, size_t dist, size_t nmatch)
+{
+  unsigned char* const token = op;
+  size_t const mcode = dist ? nmatch-MMAPIO_LZ_MIN_MATCH : 0u;
+  if (op >= oend)
+    return NULL;
+  *token = (unsigned char)(((nlit < 15u ? nlit : 15u)<<4)
+      | (mcode < 15u ? mcode : 15u));
+  op += 1;
+  if (nlit >= 15u) {
+    op = mmapio_lz_put_len(op, oend, nlit-15u);
+    if (op == NULL)
+      return NULL;
+  }
+  if (nlit > (size_t)(oend-op))
+    return NULL;
+  memcpy(op, lit, nlit);
+  op += nlit;
+  if (dist) {
+    if ((size_t)(oend-op) < 2u)
+      return NULL;
+    op[0] = (unsigned char)(dist&255u);
+    op[1] = (unsigned char)((dist>>8)&255u);
+    op += 2;
+    if (mcode >= 15u) {
+      op = mmapio_lz_put_len(op, oend, mcode-15u);
+    }
+  }
+  return op;
+}
+
+void mmapio_lz_pack_one(void* arg, size_t i) {
+  struct mmapio_lz_pack_task const* const t =
+    (struct mmapio_lz_pack_task const*)arg;
+  size_t const start = i*t->block_size;
+  size_t const n = (t->srclen - start < t->block_size)
+    ? t->srclen - start
+    : t->block_size;
+  unsigned char* const slot = t->dst + t->data_start + i*t->stride;
+  /* a block only counts as compressed if it shrank */
+  size_t clen = mmapio_lz_block_pack(slot, n-1u, t->src+start, n);
+  if (clen == 0u) {
+    /* incompressible, so store the block as is */
+    memcpy(slot, t->src+start, n);
+    clen = n;
+  }
+  /* park the compressed length where the block offset will go */
+  mmapio_lz_put64(t->dst + MMAPIO_LZ_HEADER + (i+1u)*8u, clen);
+  return;
+}
+
+void mmapio_lz_prefetch_one(void* arg, size_t i) {
+  struct mmapio_lz_prefetch_task const* const t =
+    (struct mmapio_lz_prefetch_task const*)arg;
+  void* const p = mmapio_lz_acquire(t->r, t->first+i, NULL);
+  if (p != NULL)
+    mmapio_lz_release(t->r, p);
+  return;
+}
+
+size_t mmapio_lz_raw_len(struct mmapio_lz const* r, size_t i) {
+  return (i+1u < r->count) ? r->block_size : r->raw_size - i*r->block_size;
+}
+
+void mmapio_lz_lock(struct mmapio_lz* r) {
+  mmapio_u32 expect = 0u;
+  unsigned int tries = 0u;
+  while (!mmapio_atomic_cas32(&r->lock, &expect, 1u)) {
+    /* wait for the holder without writing, then back off */
+    while (mmapio_atomic_load32(&r->lock) != 0u) {
+      tries += 1u;
+      if (tries >= MMAPIO_LZ_SPINS) {
+        mmapio_atomic_yield();
+        tries = 0u;
+      }
+    }
+    expect = 0u;
+  }
+  return;
+}
+
+void mmapio_lz_unlock(struct mmapio_lz* r) {
+  mmapio_atomic_store32(&r->lock, 0u);
+  return;
+}
+
+void mmapio_lz_mmi_dtor(struct mmapio_i* m) {
+  mmapio_pool_free(m, sizeof(struct mmapio_lz_view));
+  return;
+}
+
+void* mmapio_lz_mmi_acquire(struct mmapio_i* m) {
+  struct mmapio_lz_view* const v = (struct mmapio_lz_view*)m;
+  return mmapio_lz_acquire(v->r, v->block, NULL);
+}
+
+void mmapio_lz_mmi_release(struct mmapio_i* m, void* p) {
+  struct mmapio_lz_view* const v = (struct mmapio_lz_view*)m;
+  mmapio_lz_release(v->r, p);
+  return;
+}
+
+size_t mmapio_lz_mmi_length(struct mmapio_i const* m) {
+  struct mmapio_lz_view const* const v = (struct mmapio_lz_view const*)m;
+  return mmapio_lz_raw_len(v->r, v->block);
+}
+/* END   static functions */
+
+/* BEGIN block codec */
+size_t mmapio_lz_block_bound(size_t n) {
+  size_t const extra = n/255u + 16u;
+  if (n > (~(size_t)0u) - extra)
+    return 0u;
+  return n + extra;
+}
+
+size_t mmapio_lz_block_pack
+  (void* dst, size_t dstlen, void const* src, size_t srclen)
+{
+  mmapio_u32 table[1<<MMAPIO_LZ_HASH_BITS];
+  unsigned char const* const s = (unsigned char const*)src;
+  unsigned char* const obase = (unsigned char*)dst;
+  unsigned char* const oend = obase + dstlen;
+  unsigned char* op = obase;
+  size_t anchor = 0u;
+  size_t ip = 0u;
+  if (srclen > 0xFFFFFFFEu) {
+    return 0u;
+  }
+  memset(table, 0xFF, sizeof(table));
+  if (srclen > MMAPIO_LZ_TAIL) {
+    size_t const limit = srclen - MMAPIO_LZ_TAIL;
+    size_t const match_end = srclen - 5u;
+    while (ip < limit) {
+      mmapio_u32 const seq = mmapio_lz_get32(s+ip);
+      unsigned int const h = (unsigned int)(
+          ((seq * 2654435761u)&0xFFFFFFFFu) >> (32-MMAPIO_LZ_HASH_BITS));
+      mmapio_u32 const ref = table[h];
+      table[h] = (mmapio_u32)ip;
+      if (ref != 0xFFFFFFFFu && ip-ref <= 65535u
+      &&  mmapio_lz_get32(s+ref) == seq)
+      {
+        size_t len = MMAPIO_LZ_MIN_MATCH;
+        while (ip+len < match_end && s[ref+len] == s[ip+len]) {
+          len += 1u;
+        }
+        op = mmapio_lz_put_seq(op, oend, s+anchor, ip-anchor, ip-ref, len);
+        if (op == NULL)
+          return 0u;
+        ip += len;
+        anchor = ip;
+      } else ip += 1u;
+    }
+  }
+  op = mmapio_lz_put_seq(op, oend, s+anchor, srclen-anchor, 0u, 0u);
+  if (op == NULL)
+    return 0u;
+  return (size_t)(op-obase);
+}
+
+size_t mmapio_lz_block_unpack
+  (void* dst, size_t dstlen, void const* src, size_t srclen)
+{
+  unsigned char const* ip = (unsigned char const*)src;
+  unsigned char const* const iend = ip + srclen;
+  unsigned char* const obase = (unsigned char*)dst;
+  unsigned char* op = obase;
+  unsigned char* const oend = obase + dstlen;
+  while (ip < iend) {
+    unsigned int const token = *(ip++);
+    size_t nlit = token>>4;
+    size_t nmatch = token&15u;
+    if (nlit == 15u) {
+      unsigned int b;
+      do {
+        if (ip >= iend)
+          return (size_t)-1;
+        b = *(ip++);
+        nlit += b;
+      } while (b == 255u);
+    }
+    if (nlit > (size_t)(iend-ip) || nlit > (size_t)(oend-op))
+      return (size_t)-1;
+    memcpy(op, ip, nlit);
+    op += nlit;
+    ip += nlit;
+    if (ip == iend)
+      break;
+    /* match */{
+      size_t dist;
+      size_t k;
+      if ((size_t)(iend-ip) < 2u)
+        return (size_t)-1;
+      dist = ((size_t)ip[0]) | (((size_t)ip[1])<<8);
+      ip += 2;
+      if (nmatch == 15u) {
+        unsigned int b;
+        do {
+          if (ip >= iend)
+            return (size_t)-1;
+          b = *(ip++);
+          nmatch += b;
+        } while (b == 255u);
+      }
+      nmatch += MMAPIO_LZ_MIN_MATCH;
+      if (dist == 0u || dist > (size_t)(op-obase)
+      ||  nmatch > (size_t)(oend-op))
+      {
+        return (size_t)-1;
+      }
+      /* byte copy, since a match may overlap its own output */
+      for (k = 0u; k < nmatch; ++k) {
+        op[k] = op[k-dist];
+      }
+      op += nmatch;
+    }
+  }
+  return (size_t)(op-obase);
+}
+/* END   block codec */
+
+/* BEGIN container */
+size_t mmapio_lz_bound(size_t srclen, size_t block_size) {
+  size_t count;
+  size_t stride;
+  size_t head;
+  if (block_size < 256u || block_size > 0x40000000u)
+    return 0u;
+  count = srclen/block_size + (srclen%block_size ? 1u : 0u);
+  stride = mmapio_lz_block_bound(block_size);
+  if (count >= ((~(size_t)0u) - MMAPIO_LZ_HEADER)/(stride+8u))
+    return 0u;
+  head = MMAPIO_LZ_HEADER + (count+1u)*8u;
+  return head + count*stride;
+}
+
+size_t mmapio_lz_pack(void* dst, size_t dstlen,
+    void const* src, size_t srclen, size_t block_size,
+    struct mmapio_exec const* ex)
+{
+  unsigned char* const out = (unsigned char*)dst;
+  size_t const bound = mmapio_lz_bound(srclen, block_size);
+  size_t const count = srclen/block_size + (srclen%block_size ? 1u : 0u);
+  struct mmapio_lz_pack_task t;
+  if (bound == 0u || dstlen < bound) {
+    errno = ERANGE;
+    return 0u;
+  }
+  t.dst = out;
+  t.src = (unsigned char const*)src;
+  t.srclen = srclen;
+  t.block_size = block_size;
+  t.stride = mmapio_lz_block_bound(block_size);
+  t.data_start = MMAPIO_LZ_HEADER + (count+1u)*8u;
+  mmapio_exec_run(ex, count, &mmapio_lz_pack_one, &t);
+  /* close the gaps between blocks and turn lengths into offsets */{
+    size_t i;
+    size_t pos = t.data_start;
+    for (i = 0u; i < count; ++i) {
+      unsigned char* const slot = out + MMAPIO_LZ_HEADER + (i+1u)*8u;
+      size_t const clen = (size_t)mmapio_lz_get64(slot);
+      memmove(out+pos, out + t.data_start + i*t.stride, clen);
+      mmapio_lz_put64(slot-8u, pos);
+      pos += clen;
+    }
+    mmapio_lz_put64(out + MMAPIO_LZ_HEADER + count*8u, pos);
+    /* write the header */
+    memset(out, 0, MMAPIO_LZ_HEADER);
+    mmapio_lz_put32(out, MMAPIO_LZ_MAGIC);
+    mmapio_lz_put32(out+4, MMAPIO_LZ_VERSION);
+    mmapio_lz_put32(out+8, (mmapio_u32)block_size);
+    mmapio_lz_put64(out+16, srclen);
+    mmapio_lz_put64(out+24, count);
+    return pos;
+  }
+}
+
+struct mmapio_lz* mmapio_lz_open
+  (struct mmapio_i* container, size_t cache_blocks)
+{
+  struct mmapio_lz* r;
+  unsigned char const* base;
+  size_t const len = mmapio_length(container);
+  mmapio_u64 raw_size;
+  mmapio_u64 count;
+  size_t block_size;
+  if (cache_blocks == 0u || len < MMAPIO_LZ_HEADER) {
+    errno = ERANGE;
+    return NULL;
+  }
+  base = (unsigned char const*)mmapio_acquire(container);
+  if (base == NULL)
+    return NULL;
+  /* check the header */{
+    block_size = mmapio_lz_get32(base+8);
+    raw_size = mmapio_lz_get64(base+16);
+    count = mmapio_lz_get64(base+24);
+    if (mmapio_lz_get32(base) != MMAPIO_LZ_MAGIC
+    ||  mmapio_lz_get32(base+4) != MMAPIO_LZ_VERSION
+    ||  block_size < 256u || block_size > 0x40000000u
+    ||  count >= (len - MMAPIO_LZ_HEADER)/8u
+    ||  raw_size > (mmapio_u64)count*block_size
+    ||  (count > 0u && raw_size <= (mmapio_u64)(count-1u)*block_size)
+    ||  cache_blocks > ((~(size_t)0u)/block_size))
+    {
+      mmapio_release(container, (void*)base);
+#if (defined EINVAL)
+      errno = EINVAL;
+#else
+      errno = EDOM;
+#endif /*EINVAL*/
+      return NULL;
+    }
+  }
+  /* check the index once, so that lookups need not */{
+    size_t i;
+    mmapio_u64 prev = MMAPIO_LZ_HEADER + (count+1u)*8u;
+    for (i = 0u; i <= (size_t)count; ++i) {
+      mmapio_u64 const x = mmapio_lz_get64(base + MMAPIO_LZ_HEADER + i*8u);
+      if (x < prev || x > len) {
+        mmapio_release(container, (void*)base);
+#if (defined EINVAL)
+        errno = EINVAL;
+#else
+        errno = EDOM;
+#endif /*EINVAL*/
+        return NULL;
+      }
+      prev = x;
+    }
+  }
+  r = (struct mmapio_lz*)calloc(1, sizeof(struct mmapio_lz));
+  if (r == NULL) {
+    mmapio_release(container, (void*)base);
+    return NULL;
+  }
+  r->slots = (struct mmapio_lz_slot*)calloc(cache_blocks,
+      sizeof(struct mmapio_lz_slot));
+  r->bufs = (unsigned char*)malloc(cache_blocks*block_size);
+  if (r->slots == NULL || r->bufs == NULL) {
+    free(r->bufs);
+    free(r->slots);
+    free(r);
+    mmapio_release(container, (void*)base);
+    return NULL;
+  }
+  r->container = container;
+  r->base = base;
+  r->raw_size = (size_t)raw_size;
+  r->block_size = block_size;
+  r->count = (size_t)count;
+  r->nslots = cache_blocks;
+  r->clock = 0u;
+  r->lock = 0u;
+  return r;
+}
+
+void mmapio_lz_close(struct mmapio_lz* r) {
+  mmapio_release(r->container, (void*)r->base);
+  free(r->bufs);
+  free(r->slots);
+  free(r);
+  return;
+}
+
+size_t mmapio_lz_length(struct mmapio_lz const* r) {
+  return r->raw_size;
+}
+
+size_t mmapio_lz_block_size(struct mmapio_lz const* r) {
+  return r->block_size;
+}
+
+size_t mmapio_lz_block_count(struct mmapio_lz const* r) {
+  return r->count;
+}
+
+void* mmapio_lz_acquire(struct mmapio_lz* r, size_t i, size_t* len) {
+  size_t j;
+  size_t victim;
+  unsigned char* buf;
+  if (i >= r->count) {
+    errno = ERANGE;
+    return NULL;
+  }
+  for (;;) {
+    int loading = 0;
+    mmapio_lz_lock(r);
+    victim = r->nslots;
+    for (j = 0u; j < r->nslots; ++j) {
+      struct mmapio_lz_slot* const s = r->slots+j;
+      if (s->state != mmapio_lz_empty && s->block == i) {
+        if (s->state == mmapio_lz_ready) {
+          s->refs += 1u;
+          s->stamp = ++r->clock;
+          mmapio_lz_unlock(r);
+          if (len != NULL)
+            *len = mmapio_lz_raw_len(r, i);
+          return r->bufs + j*r->block_size;
+        }
+        loading = 1;
+        break;
+      } else if (s->refs > 0u || s->state == mmapio_lz_loading) {
+        continue;
+      } else if (victim == r->nslots
+          ||  (r->slots[victim].state != mmapio_lz_empty
+            && (s->state == mmapio_lz_empty
+              || s->stamp < r->slots[victim].stamp)))
+      {
+        /* prefer empty slots, then the least recently used */
+        victim = j;
+      }
+    }
+    if (!loading)
+      break;
+    /*
+     * Another thread decompresses this block. That takes far longer
+     * than a lock hold, so give up the processor before looking again.
+     */
+    mmapio_lz_unlock(r);
+    mmapio_atomic_yield();
+  }
+  if (victim == r->nslots) {
+    mmapio_lz_unlock(r);
+    errno = EBUSY;
+    return NULL;
+  }
+  /* claim the victim slot, then decompress outside the lock */{
+    struct mmapio_lz_slot* const s = r->slots+victim;
+    s->block = i;
+    s->refs = 1u;
+    s->state = mmapio_lz_loading;
+    s->stamp = ++r->clock;
+  }
+  mmapio_lz_unlock(r);
+  buf = r->bufs + victim*r->block_size;
+  /* decompress */{
+    size_t const raw_len = mmapio_lz_raw_len(r, i);
+    unsigned char const* const idx = r->base + MMAPIO_LZ_HEADER + i*8u;
+    size_t const start = (size_t)mmapio_lz_get64(idx);
+    size_t const clen = (size_t)mmapio_lz_get64(idx+8) - start;
+    size_t res;
+    if (clen == raw_len) {
+      memcpy(buf, r->base+start, raw_len);
+      res = raw_len;
+    } else {
+      res = mmapio_lz_block_unpack(buf, raw_len, r->base+start, clen);
+    }
+    mmapio_lz_lock(r);
+    if (res != raw_len) {
+      r->slots[victim].state = mmapio_lz_empty;
+      r->slots[victim].refs = 0u;
+      mmapio_lz_unlock(r);
+#if (defined EILSEQ)
+      errno = EILSEQ;
+#else
+      errno = EDOM;
+#endif /*EILSEQ*/
+      return NULL;
+    }
+    r->slots[victim].state = mmapio_lz_ready;
+    mmapio_lz_unlock(r);
+    if (len != NULL)
+      *len = raw_len;
+  }
+  return buf;
+}
+
+void mmapio_lz_release(struct mmapio_lz* r, void* p) {
+  size_t j;
+  if (p == NULL || (unsigned char*)p < r->bufs)
+    return;
+  j = (size_t)((unsigned char*)p - r->bufs)/r->block_size;
+  if (j >= r->nslots)
+    return;
+  mmapio_lz_lock(r);
+  if (r->slots[j].refs > 0u)
+    r->slots[j].refs -= 1u;
+  mmapio_lz_unlock(r);
+  return;
+}
+
+void mmapio_lz_prefetch(struct mmapio_lz* r, size_t first, size_t count,
+    struct mmapio_exec const* ex)
+{
+  struct mmapio_lz_prefetch_task t;
+  if (first >= r->count)
+    return;
+  if (count > r->count - first)
+    count = r->count - first;
+  if (count > r->nslots)
+    count = r->nslots;
+  t.r = r;
+  t.first = first;
+  mmapio_exec_run(ex, count, &mmapio_lz_prefetch_one, &t);
+  return;
+}
+
+struct mmapio_i* mmapio_lz_open_block(struct mmapio_lz* r, size_t i) {
+  struct mmapio_lz_view* out;
+  if (i >= r->count) {
+    errno = ERANGE;
+    return NULL;
+  }
+  out = (struct mmapio_lz_view*)mmapio_pool_alloc
+    (sizeof(struct mmapio_lz_view));
+  if (out == NULL)
+    return NULL;
+  out->r = r;
+  out->block = i;
+  out->base.mmi_dtor = &mmapio_lz_mmi_dtor;
+  out->base.mmi_acquire = &mmapio_lz_mmi_acquire;
+  out->base.mmi_release = &mmapio_lz_mmi_release;
+  out->base.mmi_length = &mmapio_lz_mmi_length;
+  return (struct mmapio_i*)out;
+}
+/* END   container */
@@ -0,0 +1,182 @@
+/*
+ * \file mmapio_lz.h
+ * \brief Block-compressed containers with random access
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Lz_H_
+#define hg_MMapIO_mmapIo_Lz_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Reader for a mapped block-compressed container.
+ * \note A container holds a header, an index of block offsets, and
+ *   independently compressed blocks. Readers decompress blocks on
+ *   demand into a bounded cache. Cache operations are safe to call
+ *   from several threads at once.
+ */
+struct mmapio_lz;
+
+/* BEGIN block codec */
+/**
+ * \brief Compute the worst-case compressed size of a buffer.
+ * \param n size of the uncompressed buffer
+ * \return a size in bytes, or zero on overflow
+ */
+MMAPIO_API
+size_t mmapio_lz_block_bound(size_t n);
+
+/**
+ * \brief Compress a buffer with the bundled LZ codec.
+ * \param dst output buffer
+ * \param dstlen size of the output buffer
+ * \param src input buffer
+ * \param srclen size of the input buffer
+ * \return the compressed size on success, zero if the output would
+ *   not fit
+ */
+MMAPIO_API
+size_t mmapio_lz_block_pack
+  (void* dst, size_t dstlen, void const* src, size_t srclen);
+
+/**
+ * \brief Decompress a buffer made by \link mmapio_lz_block_pack \endlink.
+ * \param dst output buffer
+ * \param dstlen size of the output buffer
+ * \param src compressed input
+ * \param srclen size of the compressed input
+ * \return the decompressed size on success, `(size_t)-1` if the
+ *   input is damaged or the output would not fit
+ */
+MMAPIO_API
+size_t mmapio_lz_block_unpack
+  (void* dst, size_t dstlen, void const* src, size_t srclen);
+/* END   block codec */
+
+/* BEGIN container */
+/**
+ * \brief Compute the worst-case size of a container.
+ * \param srclen size of the uncompressed data
+ * \param block_size size of each uncompressed block
+ * \return a size in bytes, or zero if the parameters are invalid
+ */
+MMAPIO_API
+size_t mmapio_lz_bound(size_t srclen, size_t block_size);
+
+/**
+ * \brief Build a container from uncompressed data.
+ * \param dst output space of at least \link mmapio_lz_bound \endlink
+ *   bytes, such as a mapping opened with 'w'
+ * \param dstlen length of the output space
+ * \param src uncompressed data
+ * \param srclen size of the uncompressed data
+ * \param block_size size of each uncompressed block, from 256 bytes
+ *   to 1 GiB
+ * \param ex executor for compressing blocks in parallel, or NULL
+ * \return the container size on success, zero otherwise
+ * \note The output space may be larger than the container; truncate
+ *   the file to the returned size afterward.
+ */
+MMAPIO_API
+size_t mmapio_lz_pack(void* dst, size_t dstlen,
+    void const* src, size_t srclen, size_t block_size,
+    struct mmapio_exec const* ex);
+
+/**
+ * \brief Open a reader on a mapped container.
+ * \param container map instance holding the container; must outlive
+ *   the reader
+ * \param cache_blocks number of decompressed blocks to keep in memory
+ * \return a reader on success, NULL otherwise
+ */
+MMAPIO_API
+struct mmapio_lz* mmapio_lz_open
+  (struct mmapio_i* container, size_t cache_blocks);
+
+/**
+ * \brief Close a reader.
+ * \param r reader to close
+ * \note All blocks acquired from the reader must be released first.
+ */
+MMAPIO_API
+void mmapio_lz_close(struct mmapio_lz* r);
+
+/**
+ * \brief Check the uncompressed size of a container.
+ * \param r reader
+ * \return a size in bytes
+ */
+MMAPIO_API
+size_t mmapio_lz_length(struct mmapio_lz const* r);
+
+/**
+ * \brief Check the uncompressed block size of a container.
+ * \param r reader
+ * \return a size in bytes; the last block may be shorter
+ */
+MMAPIO_API
+size_t mmapio_lz_block_size(struct mmapio_lz const* r);
+
+/**
+ * \brief Count the blocks of a container.
+ * \param r reader
+ * \return a block count
+ */
+MMAPIO_API
+size_t mmapio_lz_block_count(struct mmapio_lz const* r);
+
+/**
+ * \brief Acquire a decompressed block.
+ * \param r reader
+ * \param i index of the block
+ * \param[out] len length of the block, or NULL
+ * \return a pointer to the block on success, NULL otherwise
+ * \note The block stays in the cache until released. When every cache
+ *   entry is held, this function fails with `EBUSY`.
+ */
+MMAPIO_API
+void* mmapio_lz_acquire(struct mmapio_lz* r, size_t i, size_t* len);
+
+/**
+ * \brief Release a decompressed block.
+ * \param r reader
+ * \param p pointer from \link mmapio_lz_acquire \endlink
+ */
+MMAPIO_API
+void mmapio_lz_release(struct mmapio_lz* r, void* p);
+
+/**
+ * \brief Decompress a run of blocks into the cache ahead of use.
+ * \param r reader
+ * \param first index of the first block
+ * \param count number of blocks; clamped to the container and to
+ *   the cache size
+ * \param ex executor for decompressing blocks in parallel, or NULL
+ * \note Sequential scans should prefetch the next run of blocks
+ *   while consuming the current one.
+ */
+MMAPIO_API
+void mmapio_lz_prefetch(struct mmapio_lz* r, size_t first, size_t count,
+    struct mmapio_exec const* ex);
+
+/**
+ * \brief Open a map interface for one decompressed block.
+ * \param r reader; must outlive the interface
+ * \param i index of the block
+ * \return an interface on success, NULL otherwise
+ * \note Acquiring the interface pins the block in the cache until
+ *   the matching release.
+ */
+MMAPIO_API
+struct mmapio_i* mmapio_lz_open_block(struct mmapio_lz* r, size_t i);
+/* END   container */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Lz_H_*/
@@ -0,0 +1,280 @@
+/*
+ * \file mmapio_prof.c
+ * \brief Residency and fault profiles of mapped workloads
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#define _POSIX_C_SOURCE 200809L
+#include "mmapio_prof.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#if (defined _WIN32)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif /*WIN32_LEAN_AND_MEAN*/
+#  include <windows.h>
+#else
+#  include <time.h>
+#  include <sys/resource.h>
+#endif /*_WIN32*/
+
+/**
+ * \brief Profile state for one map instance.
+ */
+struct mmapio_prof_entry {
+  /** \brief registered map instance */
+  struct mmapio_i* m;
+  /** \brief output label */
+  char* label;
+  /** \brief residency at the previous sample, one byte per page */
+  unsigned char* vec;
+  /** \brief number of pages in `vec` */
+  size_t pages;
+  /** \brief nonzero until the first sample */
+  int fresh;
+};
+
+struct mmapio_prof {
+  /** \brief bucket size in pages */
+  size_t bucket_pages;
+  /** \brief page size in bytes */
+  size_t psize;
+  /** \brief registered instances */
+  struct mmapio_prof_entry* entries;
+  /** \brief number of registered instances */
+  size_t count;
+  /** \brief capacity of `entries` */
+  size_t cap;
+  /** \brief residency scratch space */
+  unsigned char* cur;
+  /** \brief capacity of `cur` */
+  size_t cur_cap;
+  /** \brief start time in milliseconds */
+  mmapio_u64 start_ms;
+  /** \brief major fault count at the previous sample */
+  mmapio_u64 majflt;
+  /** \brief nonzero once the header is out */
+  int header_done;
+};
+
+/**
+ * \brief Read a monotonic clock.
+ * \return a time in milliseconds
+ */
+static mmapio_u64 mmapio_prof_now(void);
+
+/**
+ * \brief Count the major faults of this process.
+ * \return a fault count, or zero if unavailable
+ */
+static mmapio_u64 mmapio_prof_majflt(void);
+
+/**
+ * \brief Write a label as one comma-separated field.
+ * \param out output stream
+ * \param label label to write
+ */
+static void mmapio_prof_put_label(FILE* out, char const* label);
+
+/**
+ * \brief Sample one map instance.
+ * \param p profiler
+ * \param e instance state
+ * \param out output stream, or NULL
+ * \param ms sample time
+ * \param majd major faults since the previous sample
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_prof_sample_one(struct mmapio_prof* p,
+    struct mmapio_prof_entry* e, FILE* out, mmapio_u64 ms, mmapio_u64 majd);
+
+/* BEGIN static functions */
+mmapio_u64 mmapio_prof_now(void) {
+#if (defined _WIN32)
+  return (mmapio_u64)GetTickCount();
+#else
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0u;
+  return ((mmapio_u64)ts.tv_sec)*1000u
+    +    (mmapio_u64)(ts.tv_nsec/1000000L);
+#endif /*_WIN32*/
+}
+
+mmapio_u64 mmapio_prof_majflt(void) {
+#if (defined _WIN32)
+  return 0u;
+#else
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    return 0u;
+  return (mmapio_u64)ru.ru_majflt;
+#endif /*_WIN32*/
+}
+
+void mmapio_prof_put_label(FILE* out, char const* label) {
+  if (strpbrk(label, ",\"\r\n") == NULL) {
+    fputs(label, out);
+    return;
+  }
+  fputc('"', out);
+  for (; *label; ++label) {
+    if (*label == '"')
+      fputc('"', out);
+    fputc(*label, out);
+  }
+  fputc('"', out);
+  return;
+}
+
+int mmapio_prof_sample_one(struct mmapio_prof* p,
+    struct mmapio_prof_entry* e, FILE* out, mmapio_u64 ms, mmapio_u64 majd)
+{
+  size_t const psize = p->psize;
+  size_t len;
+  size_t pages;
+  size_t shift;
+  size_t b;
+  /* measure the pages under the area */{
+    void* const ptr = mmapio_acquire(e->m);
+    if (ptr == NULL)
+      return -1;
+    len = mmapio_length(e->m);
+    shift = (size_t)ptr % psize;
+    mmapio_release(e->m, ptr);
+    if (len == 0u)
+      return 0;
+    pages = (len+shift-1u)/psize + 1u;
+  }
+  if (pages > p->cur_cap) {
+    unsigned char* const next = (unsigned char*)realloc(p->cur, pages);
+    if (next == NULL)
+      return -1;
+    p->cur = next;
+    p->cur_cap = pages;
+  }
+  if (pages > e->pages) {
+    /* pages new to the area count as previously absent */
+    unsigned char* const next = (unsigned char*)realloc(e->vec, pages);
+    if (next == NULL)
+      return -1;
+    memset(next+e->pages, 0, pages-e->pages);
+    e->vec = next;
+    e->pages = pages;
+  }
+  memset(p->cur, 0, pages);
+  if (mmapio_residency(e->m, 0u, len, p->cur) == (size_t)-1)
+    return -1;
+  for (b = 0u; b < pages; b += p->bucket_pages) {
+    size_t const end = (pages-b < p->bucket_pages)
+      ? pages : b+p->bucket_pages;
+    size_t resident = 0u;
+    size_t faulted = 0u;
+    size_t dropped = 0u;
+    size_t i;
+    for (i = b; i < end; ++i) {
+      resident += p->cur[i];
+      faulted += p->cur[i] & ~e->vec[i];
+      dropped += e->vec[i] & ~p->cur[i];
+    }
+    if (e->fresh)
+      faulted = 0u;
+    if (out != NULL && (e->fresh || faulted || dropped)) {
+      fprintf(out, "%lu,", (long unsigned int)ms);
+      mmapio_prof_put_label(out, e->label);
+      fprintf(out, ",%lu,%lu,%lu,%lu,%lu\n",
+        (long unsigned int)(b ? b*psize-shift : 0u),
+        (long unsigned int)resident,
+        (long unsigned int)faulted, (long unsigned int)dropped,
+        (long unsigned int)majd);
+    }
+  }
+  memcpy(e->vec, p->cur, pages);
+  e->fresh = 0;
+  return 0;
+}
+/* END   static functions */
+
+/* BEGIN fault profiler */
+struct mmapio_prof* mmapio_prof_open(size_t bucket_size) {
+  size_t const psize = mmapio_page_size();
+  struct mmapio_prof* p;
+  if (psize == 0u || bucket_size == 0u) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return NULL;
+  }
+  p = (struct mmapio_prof*)calloc(1, sizeof(struct mmapio_prof));
+  if (p == NULL)
+    return NULL;
+  p->psize = psize;
+  p->bucket_pages = bucket_size/psize + (bucket_size%psize != 0u);
+  p->start_ms = mmapio_prof_now();
+  p->majflt = mmapio_prof_majflt();
+  return p;
+}
+
+void mmapio_prof_close(struct mmapio_prof* p) {
+  size_t i;
+  for (i = 0u; i < p->count; ++i) {
+    free(p->entries[i].vec);
+    free(p->entries[i].label);
+  }
+  free(p->entries);
+  free(p->cur);
+  free(p);
+  return;
+}
+
+int mmapio_prof_add
+  (struct mmapio_prof* p, struct mmapio_i* m, char const* label)
+{
+  struct mmapio_prof_entry* e;
+  size_t const label_len = strlen(label);
+  if (p->count >= p->cap) {
+    size_t const next_cap = p->cap ? p->cap*2u : 8u;
+    struct mmapio_prof_entry* const next =
+      (struct mmapio_prof_entry*)realloc(p->entries,
+          next_cap*sizeof(struct mmapio_prof_entry));
+    if (next == NULL)
+      return -1;
+    p->entries = next;
+    p->cap = next_cap;
+  }
+  e = p->entries + p->count;
+  e->label = (char*)malloc(label_len+1u);
+  if (e->label == NULL)
+    return -1;
+  memcpy(e->label, label, label_len+1u);
+  e->m = m;
+  e->vec = NULL;
+  e->pages = 0u;
+  e->fresh = 1;
+  p->count += 1u;
+  return 0;
+}
+
+int mmapio_prof_sample(struct mmapio_prof* p, FILE* out) {
+  mmapio_u64 const ms = mmapio_prof_now() - p->start_ms;
+  mmapio_u64 const majflt = mmapio_prof_majflt();
+  mmapio_u64 const majd = majflt - p->majflt;
+  size_t i;
+  int res = 0;
+  p->majflt = majflt;
+  if (out != NULL && !p->header_done) {
+    fputs("ms,label,offset,resident,faulted,dropped,majflt\n", out);
+    p->header_done = 1;
+  }
+  for (i = 0u; i < p->count; ++i) {
+    /* keep sampling the others after a failure */
+    if (mmapio_prof_sample_one(p, p->entries+i, out, ms, majd) != 0)
+      res = -1;
+  }
+  return res;
+}
+/* END   fault profiler */
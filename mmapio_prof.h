@@ -0,0 +1,81 @@
+/*
+ * \file mmapio_prof.h
+ * \brief Residency and fault profiles of mapped workloads
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Prof_H_
+#define hg_MMapIO_mmapIo_Prof_H_
+
+#include "mmapio.h"
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Profiler over a set of map instances.
+ * \note Each sample splits every registered instance into buckets of
+ *   fixed size and counts, for each bucket, the resident pages and
+ *   the pages brought in or dropped since the previous sample. Pages
+ *   brought in between samples stand for the faults (and readahead)
+ *   the workload caused there. The profiler starts no threads; call
+ *   \link mmapio_prof_sample \endlink on a timer.
+ */
+struct mmapio_prof;
+
+/* BEGIN fault profiler */
+/**
+ * \brief Start a profiler.
+ * \param bucket_size size in bytes of each offset bucket; rounded up
+ *   to whole pages
+ * \return a profiler on success, NULL otherwise
+ */
+MMAPIO_API
+struct mmapio_prof* mmapio_prof_open(size_t bucket_size);
+
+/**
+ * \brief Stop a profiler.
+ * \param p profiler to stop
+ * \note Registered map instances stay open.
+ */
+MMAPIO_API
+void mmapio_prof_close(struct mmapio_prof* p);
+
+/**
+ * \brief Register a map instance with a profiler.
+ * \param p profiler
+ * \param m map instance; must stay open while registered
+ * \param label name for the instance in the output; copied
+ * \return zero on success, -1 otherwise
+ */
+MMAPIO_API
+int mmapio_prof_add
+  (struct mmapio_prof* p, struct mmapio_i* m, char const* label);
+
+/**
+ * \brief Take a sample of all registered map instances.
+ * \param p profiler
+ * \param out stream for comma-separated rows, or NULL to only update
+ *   the profiler's state
+ * \return zero on success, -1 otherwise
+ * \note The first row written by a profiler is a header. Each later
+ *   row has the columns `ms,label,offset,resident,faulted,dropped,majflt`:
+ *   milliseconds since the profiler started, the instance's label, the
+ *   bucket's starting offset from the start of the map (zero for the
+ *   first bucket, a page boundary for later ones), resident pages,
+ *   pages brought in and dropped since the previous sample, and the
+ *   major faults of the whole process since the previous sample (zero
+ *   where unavailable).
+ *   Rows for buckets that did not change are skipped after the first
+ *   sample.
+ */
+MMAPIO_API
+int mmapio_prof_sample(struct mmapio_prof* p, FILE* out);
+/* END   fault profiler */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Prof_H_*/
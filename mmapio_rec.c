@@ -0,0 +1,540 @@
+/*
+ * \file mmapio_rec.c
+ * \brief Access recording and warm-start replay
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_rec.h"
+#include "mmapio_atomic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * \brief Trace signature ("MMRT" in little-endian order).
+ */
+#define MMAPIO_REC_MAGIC 0x54524D4Du
+
+/**
+ * \brief Trace format version.
+ */
+#define MMAPIO_REC_VERSION 1u
+
+/**
+ * \brief Size of the fixed trace header.
+ */
+#define MMAPIO_REC_HEADER 16u
+
+/**
+ * \brief Largest encoding of one variable-length number.
+ */
+#define MMAPIO_REC_VARINT 10u
+
+/**
+ * \brief Recording state for one map instance.
+ */
+struct mmapio_rec_entry {
+  /** \brief registered map instance */
+  struct mmapio_i* m;
+  /** \brief label to save with the trace */
+  char* label;
+  /** \brief sample number of each range's first use, or zero */
+  mmapio_u32 volatile* first;
+  /** \brief number of times each range was seen in use */
+  mmapio_u32 volatile* hits;
+  /** \brief number of ranges in `first` and `hits` */
+  size_t ranges;
+  /** \brief residency at the previous sample, one byte per page */
+  unsigned char* vec;
+  /** \brief number of pages in `vec` */
+  size_t pages;
+};
+
+/**
+ * \brief One range of a trace being saved.
+ */
+struct mmapio_rec_item {
+  /** \brief sample number of first use */
+  mmapio_u32 first;
+  /** \brief use count */
+  mmapio_u32 hits;
+  /** \brief instance number */
+  size_t id;
+  /** \brief range index */
+  size_t range;
+};
+
+struct mmapio_rec {
+  /** \brief range size in bytes */
+  size_t range_size;
+  /** \brief page size in bytes */
+  size_t psize;
+  /** \brief current sample number */
+  mmapio_u32 volatile epoch;
+  /** \brief registered instances */
+  struct mmapio_rec_entry* entries;
+  /** \brief number of registered instances */
+  size_t count;
+  /** \brief capacity of `entries` */
+  size_t cap;
+  /** \brief residency scratch space */
+  unsigned char* cur;
+  /** \brief capacity of `cur` */
+  size_t cur_cap;
+};
+
+/**
+ * \brief Grow the range tables of an instance to cover its area.
+ * \param r recorder
+ * \param e instance state
+ * \param len current length of the area
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_rec_fit
+  (struct mmapio_rec* r, struct mmapio_rec_entry* e, size_t len);
+
+/**
+ * \brief Mark a range as used.
+ * \param r recorder
+ * \param e instance state
+ * \param i range index
+ */
+static void mmapio_rec_mark
+  (struct mmapio_rec* r, struct mmapio_rec_entry* e, size_t i);
+
+/**
+ * \brief Order trace items by first use, then by use count.
+ * \param a first item
+ * \param b second item
+ * \return negative, zero, or positive as for `qsort`
+ */
+static int mmapio_rec_item_cmp(void const* a, void const* b);
+
+/**
+ * \brief Write a variable-length number.
+ * \param p output position
+ * \param v number to write
+ * \return the position after the number
+ */
+static unsigned char* mmapio_rec_put_var(unsigned char* p, mmapio_u64 v);
+
+/**
+ * \brief Read a variable-length number.
+ * \param[in,out] p input position
+ * \param end end of input
+ * \param[out] v number read
+ * \return zero on success, -1 if the input ends early
+ */
+static int mmapio_rec_get_var
+  (unsigned char const** p, unsigned char const* end, mmapio_u64* v);
+
+/* BEGIN static functions */
+int mmapio_rec_fit
+  (struct mmapio_rec* r, struct mmapio_rec_entry* e, size_t len)
+{
+  size_t const ranges = len/r->range_size + 1u;
+  mmapio_u32* first;
+  mmapio_u32* hits;
+  if (ranges <= e->ranges)
+    return 0;
+  if (ranges > (~(size_t)0u)/sizeof(mmapio_u32)) {
+    errno = ERANGE;
+    return -1;
+  }
+  first = (mmapio_u32*)realloc((void*)e->first, ranges*sizeof(mmapio_u32));
+  if (first == NULL)
+    return -1;
+  e->first = first;
+  hits = (mmapio_u32*)realloc((void*)e->hits, ranges*sizeof(mmapio_u32));
+  if (hits == NULL)
+    return -1;
+  e->hits = hits;
+  memset(first+e->ranges, 0, (ranges-e->ranges)*sizeof(mmapio_u32));
+  memset(hits+e->ranges, 0, (ranges-e->ranges)*sizeof(mmapio_u32));
+  e->ranges = ranges;
+  return 0;
+}
+
+void mmapio_rec_mark
+  (struct mmapio_rec* r, struct mmapio_rec_entry* e, size_t i)
+{
+  mmapio_u32 expect = 0u;
+  mmapio_atomic_cas32(e->first+i, &expect, mmapio_atomic_load32(&r->epoch));
+  mmapio_atomic_add32(e->hits+i, 1u);
+  return;
+}
+
+int mmapio_rec_item_cmp(void const* a, void const* b) {
+  struct mmapio_rec_item const* const x = (struct mmapio_rec_item const*)a;
+  struct mmapio_rec_item const* const y = (struct mmapio_rec_item const*)b;
+  if (x->first != y->first)
+    return x->first < y->first ? -1 : 1;
+  if (x->hits != y->hits)
+    return x->hits > y->hits ? -1 : 1;
+  if (x->id != y->id)
+    return x->id < y->id ? -1 : 1;
+  if (x->range != y->range)
+    return x->range < y->range ? -1 : 1;
+  return 0;
+}
+
+unsigned char* mmapio_rec_put_var(unsigned char* p, mmapio_u64 v) {
+  while (v >= 0x80u) {
+    *(p++) = (unsigned char)((v&0x7Fu)|0x80u);
+    v >>= 7;
+  }
+  *(p++) = (unsigned char)v;
+  return p;
+}
+
+int mmapio_rec_get_var
+  (unsigned char const** p, unsigned char const* end, mmapio_u64* v)
+{
+  unsigned char const* q = *p;
+  mmapio_u64 out = 0u;
+  unsigned int shift = 0u;
+  for (; q < end && shift < 64u; ++q, shift += 7u) {
+    out |= ((mmapio_u64)(*q&0x7Fu))<<shift;
+    if ((*q&0x80u) == 0u) {
+      *p = q+1;
+      *v = out;
+      return 0;
+    }
+  }
+  return -1;
+}
+/* END   static functions */
+
+/* BEGIN access recorder */
+struct mmapio_rec* mmapio_rec_open(size_t range_size) {
+  size_t const psize = mmapio_page_size();
+  struct mmapio_rec* r;
+  if (psize == 0u || range_size == 0u
+  ||  range_size > (~(size_t)0u) - psize)
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return NULL;
+  }
+  r = (struct mmapio_rec*)calloc(1, sizeof(struct mmapio_rec));
+  if (r == NULL)
+    return NULL;
+  r->psize = psize;
+  r->range_size = ((range_size-1u)/psize + 1u)*psize;
+  r->epoch = 1u;
+  return r;
+}
+
+void mmapio_rec_close(struct mmapio_rec* r) {
+  size_t i;
+  for (i = 0u; i < r->count; ++i) {
+    free((void*)r->entries[i].first);
+    free((void*)r->entries[i].hits);
+    free(r->entries[i].vec);
+    free(r->entries[i].label);
+  }
+  free(r->entries);
+  free(r->cur);
+  free(r);
+  return;
+}
+
+int mmapio_rec_add
+  (struct mmapio_rec* r, struct mmapio_i* m, char const* label)
+{
+  struct mmapio_rec_entry* e;
+  size_t const label_len = strlen(label);
+  if (r->count >= 0x7FFFu) {
+    errno = ERANGE;
+    return -1;
+  }
+  if (r->count >= r->cap) {
+    size_t const next_cap = r->cap ? r->cap*2u : 8u;
+    struct mmapio_rec_entry* const next =
+      (struct mmapio_rec_entry*)realloc(r->entries,
+          next_cap*sizeof(struct mmapio_rec_entry));
+    if (next == NULL)
+      return -1;
+    r->entries = next;
+    r->cap = next_cap;
+  }
+  e = r->entries + r->count;
+  memset(e, 0, sizeof(*e));
+  e->label = (char*)malloc(label_len+1u);
+  if (e->label == NULL)
+    return -1;
+  memcpy(e->label, label, label_len+1u);
+  if (mmapio_rec_fit(r, e, mmapio_length(m)) != 0) {
+    int const err = errno;
+    free((void*)e->first);
+    free((void*)e->hits);
+    free(e->label);
+    errno = err;
+    return -1;
+  }
+  e->m = m;
+  r->count += 1u;
+  return (int)(r->count-1u);
+}
+
+void mmapio_rec_hint
+  (struct mmapio_rec* r, int id, size_t off, size_t len)
+{
+  struct mmapio_rec_entry* e;
+  size_t i;
+  size_t last;
+  if (id < 0 || (size_t)id >= r->count || len == 0u)
+    return;
+  e = r->entries + id;
+  last = (off + (len-1u) < off) ? (~(size_t)0u) : off + (len-1u);
+  for (i = off/r->range_size; i <= last/r->range_size && i < e->ranges; ++i)
+    mmapio_rec_mark(r, e, i);
+  return;
+}
+
+int mmapio_rec_sample(struct mmapio_rec* r) {
+  size_t const psize = r->psize;
+  size_t k;
+  int res = 0;
+  for (k = 0u; k < r->count; ++k) {
+    struct mmapio_rec_entry* const e = r->entries + k;
+    size_t len;
+    size_t shift;
+    size_t pages;
+    size_t j;
+    /* measure the pages under the area */{
+      void* const ptr = mmapio_acquire(e->m);
+      if (ptr == NULL) {
+        res = -1;
+        continue;
+      }
+      len = mmapio_length(e->m);
+      shift = (size_t)ptr % psize;
+      mmapio_release(e->m, ptr);
+      if (len == 0u)
+        continue;
+      pages = (len+shift-1u)/psize + 1u;
+    }
+    if (mmapio_rec_fit(r, e, len) != 0) {
+      res = -1;
+      continue;
+    }
+    if (pages > r->cur_cap) {
+      unsigned char* const next = (unsigned char*)realloc(r->cur, pages);
+      if (next == NULL) {
+        res = -1;
+        continue;
+      }
+      r->cur = next;
+      r->cur_cap = pages;
+    }
+    if (pages > e->pages) {
+      unsigned char* const next = (unsigned char*)realloc(e->vec, pages);
+      if (next == NULL) {
+        res = -1;
+        continue;
+      }
+      memset(next+e->pages, 0, pages-e->pages);
+      e->vec = next;
+      e->pages = pages;
+    }
+    memset(r->cur, 0, pages);
+    if (mmapio_residency(e->m, 0u, len, r->cur) == (size_t)-1) {
+      res = -1;
+      continue;
+    }
+    for (j = 0u; j < pages; ++j) {
+      if (r->cur[j] & ~e->vec[j]) {
+        /* the first page may start before the area */
+        size_t const off = (j > 0u) ? j*psize - shift : 0u;
+        mmapio_rec_mark(r, e, off/r->range_size);
+      }
+    }
+    memcpy(e->vec, r->cur, pages);
+  }
+  mmapio_atomic_add32(&r->epoch, 1u);
+  return res;
+}
+
+size_t mmapio_rec_bound(struct mmapio_rec const* r) {
+  size_t out = MMAPIO_REC_HEADER + 2u*MMAPIO_REC_VARINT;
+  size_t i;
+  for (i = 0u; i < r->count; ++i) {
+    out += MMAPIO_REC_VARINT + strlen(r->entries[i].label)
+      +    r->entries[i].ranges*2u*MMAPIO_REC_VARINT;
+  }
+  return out;
+}
+
+size_t mmapio_rec_save(struct mmapio_rec* r, void* dst, size_t dstlen) {
+  struct mmapio_rec_item* items;
+  size_t n = 0u;
+  size_t total = 0u;
+  size_t i;
+  unsigned char* p = (unsigned char*)dst;
+  if (dstlen < mmapio_rec_bound(r)) {
+    errno = ERANGE;
+    return 0u;
+  }
+  for (i = 0u; i < r->count; ++i) {
+    total += r->entries[i].ranges;
+  }
+  items = (struct mmapio_rec_item*)malloc(
+      (total ? total : 1u)*sizeof(struct mmapio_rec_item));
+  if (items == NULL)
+    return 0u;
+  /* collect the used ranges, earliest first */
+  for (i = 0u; i < r->count; ++i) {
+    struct mmapio_rec_entry const* const e = r->entries + i;
+    size_t j;
+    for (j = 0u; j < e->ranges; ++j) {
+      mmapio_u32 const first = mmapio_atomic_load32(e->first+j);
+      if (first == 0u)
+        continue;
+      items[n].first = first;
+      items[n].hits = mmapio_atomic_load32(e->hits+j);
+      items[n].id = i;
+      items[n].range = j;
+      n += 1u;
+    }
+  }
+  qsort(items, n, sizeof(struct mmapio_rec_item), &mmapio_rec_item_cmp);
+  /* write the header */{
+    mmapio_u64 const rs = r->range_size;
+    for (i = 0u; i < 4u; ++i) {
+      p[i] = (unsigned char)((MMAPIO_REC_MAGIC>>(8u*i))&255u);
+      p[4u+i] = (unsigned char)((MMAPIO_REC_VERSION>>(8u*i))&255u);
+    }
+    for (i = 0u; i < 8u; ++i) {
+      p[8u+i] = (unsigned char)((rs>>(8u*i))&255u);
+    }
+    p += MMAPIO_REC_HEADER;
+  }
+  p = mmapio_rec_put_var(p, r->count);
+  for (i = 0u; i < r->count; ++i) {
+    size_t const label_len = strlen(r->entries[i].label);
+    p = mmapio_rec_put_var(p, label_len);
+    memcpy(p, r->entries[i].label, label_len);
+    p += label_len;
+  }
+  p = mmapio_rec_put_var(p, n);
+  for (i = 0u; i < n; ++i) {
+    p = mmapio_rec_put_var(p, items[i].id);
+    p = mmapio_rec_put_var(p, items[i].range);
+  }
+  free(items);
+  return (size_t)(p-(unsigned char*)dst);
+}
+
+size_t mmapio_rec_replay(void const* trace, size_t len,
+    struct mmapio_i* const* maps, char const* const* labels, size_t count,
+    size_t limit)
+{
+  unsigned char const* p = (unsigned char const*)trace;
+  unsigned char const* const end = p+len;
+  mmapio_u64 magic = 0u;
+  mmapio_u64 version = 0u;
+  mmapio_u64 range_size = 0u;
+  mmapio_u64 handles = 0u;
+  mmapio_u64 records = 0u;
+  mmapio_u64 k;
+  size_t* which;
+  size_t out = 0u;
+  size_t spent = 0u;
+  size_t i;
+  int damaged = 0;
+  if (len >= MMAPIO_REC_HEADER) {
+    for (i = 0u; i < 4u; ++i) {
+      magic |= ((mmapio_u64)p[i])<<(8u*i);
+      version |= ((mmapio_u64)p[4u+i])<<(8u*i);
+    }
+    for (i = 0u; i < 8u; ++i) {
+      range_size |= ((mmapio_u64)p[8u+i])<<(8u*i);
+    }
+    p += MMAPIO_REC_HEADER;
+  }
+  if (len < MMAPIO_REC_HEADER
+  ||  magic != MMAPIO_REC_MAGIC || version != MMAPIO_REC_VERSION
+  ||  range_size == 0u || range_size > (mmapio_u64)(~(size_t)0u)
+  ||  mmapio_rec_get_var(&p, end, &handles) != 0
+  ||  handles > (mmapio_u64)(end-p))
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return (size_t)-1;
+  }
+  which = (size_t*)malloc((handles ? (size_t)handles : 1u)*sizeof(size_t));
+  if (which == NULL)
+    return (size_t)-1;
+  /* match the trace's labels to the given instances */
+  for (k = 0u; k < handles && !damaged; ++k) {
+    mmapio_u64 label_len;
+    if (mmapio_rec_get_var(&p, end, &label_len) != 0
+    ||  label_len > (mmapio_u64)(end-p))
+    {
+      damaged = 1;
+      break;
+    }
+    which[k] = count;
+    for (i = 0u; i < count; ++i) {
+      if (strlen(labels[i]) == label_len
+      &&  memcmp(labels[i], p, (size_t)label_len) == 0)
+      {
+        which[k] = i;
+        break;
+      }
+    }
+    p += (size_t)label_len;
+  }
+  if (!damaged && mmapio_rec_get_var(&p, end, &records) != 0)
+    damaged = 1;
+  /* prefetch in priority order */
+  for (k = 0u; k < records && !damaged; ++k) {
+    mmapio_u64 id;
+    mmapio_u64 range;
+    struct mmapio_i* m;
+    size_t total;
+    size_t off;
+    size_t n;
+    if (mmapio_rec_get_var(&p, end, &id) != 0
+    ||  mmapio_rec_get_var(&p, end, &range) != 0
+    ||  id >= handles)
+    {
+      damaged = 1;
+      break;
+    }
+    if (which[id] >= count)
+      continue;
+    m = maps[which[id]];
+    total = mmapio_length(m);
+    if (range > (mmapio_u64)(total/(size_t)range_size))
+      continue;
+    off = (size_t)range*(size_t)range_size;
+    if (off >= total)
+      continue;
+    n = (total-off < (size_t)range_size) ? total-off : (size_t)range_size;
+    if (limit > 0u && n > limit-spent)
+      break;
+    if (mmapio_advise(m, off, n, mmapio_advice_willneed) == 0) {
+      spent += n;
+      out += 1u;
+    }
+  }
+  free(which);
+  if (damaged) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return (size_t)-1;
+  }
+  return out;
+}
+/* END   access recorder */
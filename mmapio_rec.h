@@ -0,0 +1,127 @@
+/*
+ * \file mmapio_rec.h
+ * \brief Access recording and warm-start replay
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Rec_H_
+#define hg_MMapIO_mmapIo_Rec_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Recorder of the ranges a workload touches.
+ * \note The recorder splits each registered map instance into ranges
+ *   of fixed size and notes when each range was first needed. A range
+ *   counts as needed when it turns resident between two samples, or
+ *   when the application names it in a hint. The saved trace lists
+ *   the ranges in the order the workload first needed them, so a
+ *   replay at the next start can bring them in ahead of demand.
+ */
+struct mmapio_rec;
+
+/* BEGIN access recorder */
+/**
+ * \brief Start a recorder.
+ * \param range_size size in bytes of each recorded range; rounded up
+ *   to whole pages
+ * \return a recorder on success, NULL otherwise
+ */
+MMAPIO_API
+struct mmapio_rec* mmapio_rec_open(size_t range_size);
+
+/**
+ * \brief Stop a recorder.
+ * \param r recorder to stop
+ * \note Registered map instances stay open.
+ */
+MMAPIO_API
+void mmapio_rec_close(struct mmapio_rec* r);
+
+/**
+ * \brief Register a map instance with a recorder.
+ * \param r recorder
+ * \param m map instance; must stay open while registered
+ * \param label name that identifies the instance across restarts,
+ *   such as its file name; copied
+ * \return an instance number for \link mmapio_rec_hint \endlink on
+ *   success, -1 otherwise
+ */
+MMAPIO_API
+int mmapio_rec_add
+  (struct mmapio_rec* r, struct mmapio_i* m, char const* label);
+
+/**
+ * \brief Note that the workload needs part of a map instance.
+ * \param r recorder
+ * \param id instance number from \link mmapio_rec_add \endlink
+ * \param off offset from the start of the mapped area
+ * \param len length of the part
+ * \note Safe to call from several threads at once, but not together
+ *   with \link mmapio_rec_add \endlink or \link mmapio_rec_sample
+ *   \endlink. Parts past the area's length at the last sample are
+ *   ignored.
+ */
+MMAPIO_API
+void mmapio_rec_hint
+  (struct mmapio_rec* r, int id, size_t off, size_t len);
+
+/**
+ * \brief Compare residency with the previous sample.
+ * \param r recorder
+ * \return zero on success, -1 otherwise
+ * \note Ranges already resident at the first sample count as needed
+ *   at the start. Call on a timer while the workload warms up.
+ */
+MMAPIO_API
+int mmapio_rec_sample(struct mmapio_rec* r);
+
+/**
+ * \brief Compute the largest trace a recorder could save.
+ * \param r recorder
+ * \return a size in bytes
+ */
+MMAPIO_API
+size_t mmapio_rec_bound(struct mmapio_rec const* r);
+
+/**
+ * \brief Save a trace of the ranges needed so far.
+ * \param r recorder
+ * \param dst output space of at least \link mmapio_rec_bound \endlink
+ *   bytes, such as a mapping opened with 'w'
+ * \param dstlen length of the output space
+ * \return the trace size on success, zero otherwise
+ */
+MMAPIO_API
+size_t mmapio_rec_save(struct mmapio_rec* r, void* dst, size_t dstlen);
+
+/**
+ * \brief Prefetch the ranges of a saved trace, in the order the
+ *   recorded workload first needed them.
+ * \param trace saved trace
+ * \param len length of the saved trace
+ * \param maps map instances to warm
+ * \param labels labels of the map instances, matched against the
+ *   labels in the trace
+ * \param count number of map instances
+ * \param limit maximum number of bytes to prefetch, or zero for no
+ *   limit
+ * \return the number of ranges prefetched on success, `(size_t)-1`
+ *   if the trace is damaged
+ * \note Prefetch requests return before the reads finish, so the
+ *   application can start serving while the cache fills.
+ */
+MMAPIO_API
+size_t mmapio_rec_replay(void const* trace, size_t len,
+    struct mmapio_i* const* maps, char const* const* labels, size_t count,
+    size_t limit);
+/* END   access recorder */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Rec_H_*/
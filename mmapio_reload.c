@@ -0,0 +1,516 @@
+/*
+ * \file mmapio_reload.c
+ * \brief Read-only maps that follow atomic file replacement
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#define _POSIX_C_SOURCE 200809L
+#include "mmapio_reload.h"
+#include "mmapio_atomic.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if (defined __linux__)
+#  include <unistd.h>
+#  include <time.h>
+#  include <sys/inotify.h>
+#  define MMAPIO_RELOAD_INOTIFY 1
+#elif (defined _WIN32)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif /*WIN32_LEAN_AND_MEAN*/
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif /*__linux__*/
+
+/**
+ * \brief Version states.
+ */
+enum mmapio_reload_state {
+  /** \brief newest version */
+  mmapio_reload_live = 0,
+  /** \brief replaced, but possibly still pinned */
+  mmapio_reload_retired = 1,
+  /** \brief being unmapped by the thread that dropped the last pin */
+  mmapio_reload_closing = 2,
+  /** \brief unmapped, and free to hold a later version */
+  mmapio_reload_closed = 3
+};
+
+/**
+ * \brief One mapped version of a file.
+ */
+struct mmapio_reload_ver {
+  /** \brief map instance of this version */
+  struct mmapio_i* m;
+  /** \brief start of the mapped bytes; release looks at it unpinned */
+  void* volatile ptr;
+  /** \brief length of the mapped bytes */
+  size_t len;
+  /** \brief number of readers holding this version */
+  mmapio_u32 volatile refs;
+  /** \brief a \link mmapio_reload_state \endlink value */
+  mmapio_u32 volatile state;
+  /** \brief next older version */
+  struct mmapio_reload_ver* next;
+};
+
+/**
+ * \brief Reloadable map.
+ */
+struct mmapio_reload {
+  /** \brief base structure */
+  struct mmapio_i base;
+  /** \brief file name */
+  char* nm;
+  /** \brief mode text for each version */
+  char* mode;
+  /** \brief newest version */
+  void* volatile cur;
+  /**
+   * \brief all version nodes; nodes stay until close, so readers
+   *   racing with a reload never touch freed memory, and a reload
+   *   reuses a closed node before adding one
+   */
+  void* volatile list;
+  /** \brief lock held during checks */
+  mmapio_u32 volatile lock;
+  /** \brief time of the next check by acquire, in milliseconds */
+  mmapio_u64 volatile next_check;
+  /** \brief check interval in milliseconds */
+  long interval;
+  /** \brief device of the current version */
+  mmapio_u64 dev;
+  /** \brief inode of the current version */
+  mmapio_u64 ino;
+  /** \brief size of the current version */
+  mmapio_u64 size;
+  /** \brief modification time of the current version */
+  mmapio_u64 mtime;
+  /** \brief change notification descriptor, or -1 */
+  int notify_fd;
+};
+
+/**
+ * \brief Read a monotonic clock.
+ * \return a time in milliseconds
+ */
+static mmapio_u64 mmapio_reload_now(void);
+
+/**
+ * \brief Check the identity of a file.
+ * \param r reloadable map
+ * \param[out] id device, inode, size and modification time
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_reload_stat(struct mmapio_reload const* r, mmapio_u64* id);
+
+/**
+ * \brief Map the current file as a new version.
+ * \param r reloadable map
+ * \param v new or closed version node to fill
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_reload_map
+  (struct mmapio_reload* r, struct mmapio_reload_ver* v);
+
+/**
+ * \brief Find a closed version node to reuse.
+ * \param r reloadable map, with its check lock held
+ * \return a closed node, or NULL if none is closed
+ */
+static struct mmapio_reload_ver* mmapio_reload_spare
+  (struct mmapio_reload* r);
+
+/**
+ * \brief Drop a pin on a version, unmapping it if it was the last pin
+ *   on a replaced version.
+ * \param v version
+ */
+static void mmapio_reload_unpin(struct mmapio_reload_ver* v);
+
+/**
+ * \brief Unmap a replaced version unless a reader holds it.
+ * \param v version
+ */
+static void mmapio_reload_reap(struct mmapio_reload_ver* v);
+
+/**
+ * \brief Destructor; unmaps every version.
+ * \param m map instance
+ */
+static void mmapio_reload_dtor(struct mmapio_i* m);
+
+/**
+ * \brief Acquire the newest version.
+ * \param m map instance
+ * \return pointer to the version's bytes on success, NULL otherwise
+ */
+static void* mmapio_reload_acquire(struct mmapio_i* m);
+
+/**
+ * \brief Release a version.
+ * \param m map instance
+ * \param p pointer from acquire
+ */
+static void mmapio_reload_release(struct mmapio_i* m, void* p);
+
+/**
+ * \brief Check the length of the newest version.
+ * \param m map instance
+ * \return the length of the newest version
+ */
+static size_t mmapio_reload_length(struct mmapio_i const* m);
+
+/* BEGIN static functions */
+mmapio_u64 mmapio_reload_now(void) {
+#if (defined _WIN32)
+  return (mmapio_u64)GetTickCount();
+#else
+  struct timespec ts;
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0)
+    return 0u;
+  return ((mmapio_u64)ts.tv_sec)*1000u
+    +    (mmapio_u64)(ts.tv_nsec/1000000L);
+#endif /*_WIN32*/
+}
+
+int mmapio_reload_stat(struct mmapio_reload const* r, mmapio_u64* id) {
+  struct stat st;
+  if (stat(r->nm, &st) != 0)
+    return -1;
+  id[0] = (mmapio_u64)st.st_dev;
+  id[1] = (mmapio_u64)st.st_ino;
+  id[2] = (mmapio_u64)st.st_size;
+  id[3] = (mmapio_u64)st.st_mtime;
+  return 0;
+}
+
+int mmapio_reload_map(struct mmapio_reload* r, struct mmapio_reload_ver* v) {
+  struct mmapio_i* const m = mmapio_open(r->nm, r->mode, 0u, 0u);
+  unsigned char* ptr;
+  if (m == NULL)
+    return -1;
+  ptr = (unsigned char*)mmapio_acquire(m);
+  if (ptr == NULL) {
+    int const err = errno;
+    mmapio_close(m);
+    errno = err;
+    return -1;
+  }
+  /* a stale reader may still bump `refs`, so leave it be */
+  v->m = m;
+  mmapio_atomic_storep(&v->ptr, ptr);
+  v->len = mmapio_length(m);
+  mmapio_atomic_store32(&v->state, mmapio_reload_live);
+  return 0;
+}
+
+struct mmapio_reload_ver* mmapio_reload_spare(struct mmapio_reload* r) {
+  struct mmapio_reload_ver* v =
+    (struct mmapio_reload_ver*)mmapio_atomic_loadp(&r->list);
+  for (; v != NULL; v = v->next) {
+    if (mmapio_atomic_load32(&v->state) == mmapio_reload_closed)
+      return v;
+  }
+  return NULL;
+}
+
+void mmapio_reload_unpin(struct mmapio_reload_ver* v) {
+  if (mmapio_atomic_add32(&v->refs, (mmapio_u32)-1) == 1u) {
+    mmapio_atomic_fence();
+    mmapio_reload_reap(v);
+  }
+  return;
+}
+
+void mmapio_reload_reap(struct mmapio_reload_ver* v) {
+  for (;;) {
+    mmapio_u32 state = mmapio_reload_retired;
+    if (mmapio_atomic_load32(&v->refs) != 0u
+    ||  !mmapio_atomic_cas32(&v->state, &state, mmapio_reload_closing))
+    {
+      return;
+    }
+    /*
+     * A reader may have pinned the version while it was still live,
+     * after the first look at `refs`; such a pin shows up by now.
+     */
+    mmapio_atomic_fence();
+    if (mmapio_atomic_load32(&v->refs) == 0u)
+      break;
+    /* hand the version back, and look again in case the pin is gone */
+    mmapio_atomic_store32(&v->state, mmapio_reload_retired);
+    mmapio_atomic_fence();
+  }
+  mmapio_release(v->m, v->ptr);
+  mmapio_close(v->m);
+  /* only now may a reload take the node */
+  mmapio_atomic_store32(&v->state, mmapio_reload_closed);
+  return;
+}
+
+void mmapio_reload_dtor(struct mmapio_i* m) {
+  struct mmapio_reload* const r = (struct mmapio_reload*)m;
+  struct mmapio_reload_ver* v =
+    (struct mmapio_reload_ver*)mmapio_atomic_loadp(&r->list);
+  while (v != NULL) {
+    struct mmapio_reload_ver* const next = v->next;
+    if (v->state != mmapio_reload_closed) {
+      mmapio_release(v->m, v->ptr);
+      mmapio_close(v->m);
+    }
+    mmapio_pool_free(v, sizeof(*v));
+    v = next;
+  }
+#if (defined MMAPIO_RELOAD_INOTIFY)
+  if (r->notify_fd != -1)
+    close(r->notify_fd);
+#endif /*MMAPIO_RELOAD_INOTIFY*/
+  free(r->mode);
+  free(r->nm);
+  mmapio_pool_free(r, sizeof(*r));
+  return;
+}
+
+void* mmapio_reload_acquire(struct mmapio_i* m) {
+  return mmapio_reload_pin(m, NULL);
+}
+
+void mmapio_reload_release(struct mmapio_i* m, void* p) {
+  struct mmapio_reload* const r = (struct mmapio_reload*)m;
+  struct mmapio_reload_ver* v =
+    (struct mmapio_reload_ver*)mmapio_atomic_loadp(&r->list);
+  /*
+   * Live and retired versions never share an address. Read the state
+   * first: a node takes a new address only while closed, so a node
+   * seen open afterward shows the address of that open version.
+   */
+  for (; v != NULL; v = v->next) {
+    if (mmapio_atomic_load32(&v->state) <= mmapio_reload_retired
+    &&  mmapio_atomic_loadp(&v->ptr) == p)
+    {
+      mmapio_reload_unpin(v);
+      break;
+    }
+  }
+  return;
+}
+
+size_t mmapio_reload_length(struct mmapio_i const* m) {
+  struct mmapio_reload* const r = (struct mmapio_reload*)m;
+  struct mmapio_reload_ver const* const v =
+    (struct mmapio_reload_ver const*)mmapio_atomic_loadp(&r->cur);
+  return v->len;
+}
+/* END   static functions */
+
+/* BEGIN reloadable maps */
+struct mmapio_i* mmapio_reload_open
+  (char const* nm, char const* mode, long interval_ms)
+{
+  size_t const nmlen = strlen(nm);
+  size_t const modelen = strlen(mode);
+  struct mmapio_reload* const r = (struct mmapio_reload*)
+    mmapio_pool_alloc(sizeof(struct mmapio_reload));
+  struct mmapio_reload_ver* v;
+  mmapio_u64 id[4];
+  if (r == NULL)
+    return NULL;
+  r->notify_fd = -1;
+  r->nm = (char*)malloc(nmlen+1u);
+  r->mode = (char*)malloc(modelen+1u);
+  if (r->nm == NULL || r->mode == NULL) {
+    free(r->mode);
+    free(r->nm);
+    mmapio_pool_free(r, sizeof(*r));
+    return NULL;
+  }
+  memcpy(r->nm, nm, nmlen+1u);
+  memcpy(r->mode, mode, modelen+1u);
+  /* identify the file before mapping, so a swap in between shows up */
+  v = (struct mmapio_reload_ver*)
+    mmapio_pool_alloc(sizeof(struct mmapio_reload_ver));
+  if (v == NULL
+  ||  mmapio_reload_stat(r, id) != 0
+  ||  mmapio_reload_map(r, v) != 0)
+  {
+    int const err = errno;
+    mmapio_pool_free(v, sizeof(*v));
+    free(r->mode);
+    free(r->nm);
+    mmapio_pool_free(r, sizeof(*r));
+    errno = err;
+    return NULL;
+  }
+  r->dev = id[0];
+  r->ino = id[1];
+  r->size = id[2];
+  r->mtime = id[3];
+  r->cur = v;
+  r->list = v;
+  r->interval = interval_ms;
+  r->next_check = mmapio_reload_now() + (mmapio_u64)
+    (interval_ms > 0 ? interval_ms : 0);
+#if (defined MMAPIO_RELOAD_INOTIFY)
+  /* watch the directory, since a rename replaces the file's inode */{
+    char const* const slash = strrchr(nm, '/');
+    char* const dir = (char*)malloc(nmlen+2u);
+    r->notify_fd = inotify_init1(IN_NONBLOCK|IN_CLOEXEC);
+    if (r->notify_fd != -1 && dir != NULL) {
+      if (slash == NULL) {
+        dir[0] = '.';
+        dir[1] = 0;
+      } else {
+        size_t const dirlen = (slash == nm) ? 1u : (size_t)(slash-nm);
+        memcpy(dir, nm, dirlen);
+        dir[dirlen] = 0;
+      }
+      if (inotify_add_watch(r->notify_fd, dir,
+            IN_MOVED_TO|IN_CLOSE_WRITE|IN_CREATE|IN_DELETE) == -1)
+      {
+        close(r->notify_fd);
+        r->notify_fd = -1;
+      }
+    } else if (r->notify_fd != -1) {
+      close(r->notify_fd);
+      r->notify_fd = -1;
+    }
+    free(dir);
+  }
+#endif /*MMAPIO_RELOAD_INOTIFY*/
+  r->base.mmi_dtor = &mmapio_reload_dtor;
+  r->base.mmi_acquire = &mmapio_reload_acquire;
+  r->base.mmi_release = &mmapio_reload_release;
+  r->base.mmi_length = &mmapio_reload_length;
+  return (struct mmapio_i*)r;
+}
+
+void* mmapio_reload_pin(struct mmapio_i* m, size_t* len) {
+  struct mmapio_reload* const r = (struct mmapio_reload*)m;
+  struct mmapio_reload_ver* v;
+  if (m->mmi_dtor != &mmapio_reload_dtor) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return NULL;
+  }
+  if (r->interval > 0) {
+    mmapio_u64 const now = mmapio_reload_now();
+    mmapio_u64 next = mmapio_atomic_load64(&r->next_check);
+    /* one reader per interval pays for the check */
+    if (now >= next
+    &&  mmapio_atomic_cas64(&r->next_check, &next,
+          now + (mmapio_u64)r->interval))
+    {
+      mmapio_reload_check(m);
+    }
+  }
+  for (;;) {
+    v = (struct mmapio_reload_ver*)mmapio_atomic_loadp(&r->cur);
+    mmapio_atomic_add32(&v->refs, 1u);
+    mmapio_atomic_fence();
+    /* a reload may have retired the version before the pin landed */
+    if (mmapio_atomic_loadp(&r->cur) == (void*)v)
+      break;
+    mmapio_reload_unpin(v);
+  }
+  if (len != NULL)
+    *len = v->len;
+  return v->ptr;
+}
+
+int mmapio_reload_check(struct mmapio_i* m) {
+  struct mmapio_reload* const r = (struct mmapio_reload*)m;
+  struct mmapio_reload_ver* old;
+  struct mmapio_reload_ver* v;
+  int fresh;
+  mmapio_u64 id[4];
+  mmapio_u32 unlocked = 0u;
+  if (m->mmi_dtor != &mmapio_reload_dtor) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (!mmapio_atomic_cas32(&r->lock, &unlocked, 1u)) {
+    /* another thread is checking right now */
+    return 0;
+  }
+#if (defined MMAPIO_RELOAD_INOTIFY)
+  if (r->notify_fd != -1) {
+    char buf[4096];
+    while (read(r->notify_fd, buf, sizeof(buf)) > 0) {
+      continue;
+    }
+  }
+#endif /*MMAPIO_RELOAD_INOTIFY*/
+  if (mmapio_reload_stat(r, id) != 0) {
+    mmapio_atomic_store32(&r->lock, 0u);
+    return -1;
+  }
+  if (id[0] == r->dev && id[1] == r->ino
+  &&  id[2] == r->size && id[3] == r->mtime)
+  {
+    mmapio_atomic_store32(&r->lock, 0u);
+    return 0;
+  }
+  /* reuse a closed node, so the list only grows with pinned versions */
+  v = mmapio_reload_spare(r);
+  fresh = (v == NULL);
+  if (fresh) {
+    v = (struct mmapio_reload_ver*)
+      mmapio_pool_alloc(sizeof(struct mmapio_reload_ver));
+  }
+  if (v == NULL || mmapio_reload_map(r, v) != 0) {
+    if (fresh)
+      mmapio_pool_free(v, sizeof(*v));
+    mmapio_atomic_store32(&r->lock, 0u);
+    return -1;
+  }
+  r->dev = id[0];
+  r->ino = id[1];
+  r->size = id[2];
+  r->mtime = id[3];
+  /* publish the new version, then retire the old one */
+  old = (struct mmapio_reload_ver*)mmapio_atomic_loadp(&r->cur);
+  if (fresh) {
+    v->next = (struct mmapio_reload_ver*)mmapio_atomic_loadp(&r->list);
+    mmapio_atomic_storep(&r->list, v);
+  }
+  mmapio_atomic_storep(&r->cur, v);
+  mmapio_atomic_store32(&old->state, mmapio_reload_retired);
+  mmapio_atomic_fence();
+  mmapio_reload_reap(old);
+  mmapio_atomic_store32(&r->lock, 0u);
+  return 1;
+}
+
+int mmapio_reload_fd(struct mmapio_i* m) {
+  struct mmapio_reload* const r = (struct mmapio_reload*)m;
+  if (m->mmi_dtor != &mmapio_reload_dtor) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  if (r->notify_fd == -1) {
+#if (defined ENOSYS)
+    errno = ENOSYS;
+#else
+    errno = EDOM;
+#endif /*ENOSYS*/
+  }
+  return r->notify_fd;
+}
+/* END   reloadable maps */
@@ -0,0 +1,79 @@
+/*
+ * \file mmapio_reload.h
+ * \brief Read-only maps that follow atomic file replacement
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Reload_H_
+#define hg_MMapIO_mmapIo_Reload_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/* BEGIN reloadable maps */
+/**
+ * \brief Open a map that swaps to new versions of its file.
+ * \param nm name of file to map
+ * \param mode mode text for \link mmapio_open \endlink, such as "re";
+ *   each version maps the whole file
+ * \param interval_ms minimum time between file checks made by
+ *   \link mmapio_acquire \endlink, or zero to check only through
+ *   \link mmapio_reload_check \endlink
+ * \return an interface on success, NULL otherwise
+ * \note Each acquire returns the newest version seen so far and pins
+ *   it; the matching \link mmapio_release \endlink unpins it. A
+ *   version replaced by a newer one stays mapped until its last pin
+ *   is released. Acquire and release are safe to call from several
+ *   threads at once.
+ * \note Replace the file by renaming a new one over it, such as with
+ *   \link mmapio_publish_commit \endlink. A check compares the device,
+ *   inode, size and modification time of the file with the current
+ *   version's.
+ */
+MMAPIO_API
+struct mmapio_i* mmapio_reload_open
+  (char const* nm, char const* mode, long interval_ms);
+
+/**
+ * \brief Acquire the newest version together with its length.
+ * \param m interface from \link mmapio_reload_open \endlink
+ * \param[out] len length of the returned version
+ * \return a pointer to release with \link mmapio_release \endlink on
+ *   success, NULL otherwise
+ * \note \link mmapio_length \endlink reports the length of the newest
+ *   version, which may change between calls; readers running beside a
+ *   reload should take the length from this function instead.
+ */
+MMAPIO_API
+void* mmapio_reload_pin(struct mmapio_i* m, size_t* len);
+
+/**
+ * \brief Check the file now, and swap to a new version if it changed.
+ * \param m interface from \link mmapio_reload_open \endlink
+ * \return 1 if a new version is in place, 0 if the file did not
+ *   change, -1 if the check or the new mapping failed
+ * \note On failure, readers keep the current version.
+ */
+MMAPIO_API
+int mmapio_reload_check(struct mmapio_i* m);
+
+/**
+ * \brief Get a descriptor that becomes readable when the file's
+ *   directory changes.
+ * \param m interface from \link mmapio_reload_open \endlink
+ * \return an `inotify` descriptor on Linux, or -1 if unavailable
+ * \note Poll the descriptor in an event loop, and call
+ *   \link mmapio_reload_check \endlink when it becomes readable. The
+ *   check drains the descriptor.
+ */
+MMAPIO_API
+int mmapio_reload_fd(struct mmapio_i* m);
+/* END   reloadable maps */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Reload_H_*/
@@ -0,0 +1,285 @@
+/*
+ * \file mmapio_ring.c
+ * \brief Message rings in shared mappings
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+#include "mmapio_ring.h"
+#include "mmapio_atomic.h"
+#include <string.h>
+#include <errno.h>
+
+#if (defined __linux__)
+#  include <unistd.h>
+#  include <time.h>
+#  include <sys/syscall.h>
+#  include <linux/futex.h>
+#  define MMAPIO_RING_FUTEX 1
+#elif (defined _WIN32)
+#  ifndef WIN32_LEAN_AND_MEAN
+#    define WIN32_LEAN_AND_MEAN
+#  endif /*WIN32_LEAN_AND_MEAN*/
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif /*__linux__*/
+
+/**
+ * \brief Ring signature ("MMRQ" in little-endian order).
+ */
+#define MMAPIO_RING_MAGIC 0x51524D4Du
+
+/**
+ * \brief Size of a cache line, used to keep producer and consumer
+ *   counters apart.
+ */
+#define MMAPIO_RING_LINE 64u
+
+/**
+ * \brief Number of readiness checks before a consumer goes to sleep.
+ */
+#define MMAPIO_RING_SPIN 128
+
+/**
+ * \brief Header at the start of every message ring.
+ */
+struct mmapio_ring {
+  /** \brief ring signature */
+  mmapio_u32 magic;
+  /** \brief size in bytes of one message */
+  mmapio_u32 slot_size;
+  /** \brief distance in bytes between slots */
+  mmapio_u64 stride;
+  /** \brief number of slots minus one */
+  mmapio_u64 mask;
+  unsigned char pad0[MMAPIO_RING_LINE - 24];
+  /** \brief next ticket for producers to claim */
+  mmapio_u64 volatile tail;
+  unsigned char pad1[MMAPIO_RING_LINE - 8];
+  /** \brief next ticket for the consumer to take */
+  mmapio_u64 volatile head;
+  unsigned char pad2[MMAPIO_RING_LINE - 8];
+  /** \brief nonzero while the consumer sleeps */
+  mmapio_u32 volatile sleeping;
+  unsigned char pad3[MMAPIO_RING_LINE - 4];
+};
+
+/**
+ * \brief Compute the slot stride for a message size.
+ * \param slot_size size in bytes of one message
+ * \return a stride in bytes, or zero on overflow
+ */
+static size_t mmapio_ring_stride(size_t slot_size);
+
+/**
+ * \brief Find the sequence word of a slot.
+ * \param r message ring
+ * \param ticket ticket of the slot
+ * \return a pointer to the sequence word; the message follows it
+ */
+static mmapio_u64 volatile* mmapio_ring_slot
+  (struct mmapio_ring* r, mmapio_u64 ticket);
+
+/**
+ * \brief Check whether the next message is ready for the consumer.
+ * \param r message ring
+ * \return nonzero if ready, zero otherwise
+ */
+static int mmapio_ring_ready(struct mmapio_ring* r);
+
+/**
+ * \brief Sleep while the consumer's sleep flag remains set.
+ * \param r message ring
+ * \param timeout_ms maximum wait time in milliseconds, or negative
+ *   to wait without limit
+ */
+static void mmapio_ring_sleep(struct mmapio_ring* r, long timeout_ms);
+
+/**
+ * \brief Wake a sleeping consumer.
+ * \param r message ring
+ */
+static void mmapio_ring_wake(struct mmapio_ring* r);
+
+/* BEGIN static functions */
+size_t mmapio_ring_stride(size_t slot_size) {
+  size_t const room = (~(size_t)0u) - 16u;
+  if (slot_size == 0u || slot_size > room || slot_size > 0xFFFFFFFFu)
+    return 0u;
+  return sizeof(mmapio_u64) + ((slot_size + 7u) & ~(size_t)7u);
+}
+
+mmapio_u64 volatile* mmapio_ring_slot
+  (struct mmapio_ring* r, mmapio_u64 ticket)
+{
+  unsigned char* const slots = ((unsigned char*)r) + sizeof(*r);
+  return (mmapio_u64 volatile*)(
+      slots + (size_t)((ticket & r->mask) * r->stride));
+}
+
+int mmapio_ring_ready(struct mmapio_ring* r) {
+  mmapio_u64 const head = mmapio_atomic_load64(&r->head);
+  return mmapio_atomic_load64(mmapio_ring_slot(r, head)) == head+1u;
+}
+
+void mmapio_ring_sleep(struct mmapio_ring* r, long timeout_ms) {
+#if (defined MMAPIO_RING_FUTEX)
+  struct timespec ts;
+  struct timespec* tsp = NULL;
+  if (timeout_ms >= 0) {
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    tsp = &ts;
+  }
+  /* shared futex, since the ring may cross process boundaries */
+  syscall(SYS_futex, (mmapio_u32*)&r->sleeping, FUTEX_WAIT, 1u, tsp,
+      NULL, 0);
+#elif (defined _WIN32)
+  DWORD const step = (timeout_ms >= 0 && timeout_ms < 1) ? 0 : 1;
+  long waited = 0;
+  while (mmapio_atomic_load32(&r->sleeping) != 0u
+    &&   (timeout_ms < 0 || waited < timeout_ms))
+  {
+    Sleep(step);
+    waited += 1;
+  }
+#else
+  long waited = 0;
+  while (mmapio_atomic_load32(&r->sleeping) != 0u
+    &&   (timeout_ms < 0 || waited < timeout_ms*10))
+  {
+    struct timespec ts;
+    ts.tv_sec = 0;
+    ts.tv_nsec = 100000L;
+    nanosleep(&ts, NULL);
+    waited += 1;
+  }
+#endif /*MMAPIO_RING_FUTEX*/
+  return;
+}
+
+void mmapio_ring_wake(struct mmapio_ring* r) {
+  mmapio_atomic_store32(&r->sleeping, 0u);
+#if (defined MMAPIO_RING_FUTEX)
+  syscall(SYS_futex, (mmapio_u32*)&r->sleeping, FUTEX_WAKE, 1, NULL,
+      NULL, 0);
+#endif /*MMAPIO_RING_FUTEX*/
+  return;
+}
+/* END   static functions */
+
+/* BEGIN message ring */
+size_t mmapio_ring_size(size_t slot_size, size_t count) {
+  size_t const stride = mmapio_ring_stride(slot_size);
+  if (stride == 0u || count == 0u || (count & (count-1u)) != 0u
+  ||  count > ((~(size_t)0u) - sizeof(struct mmapio_ring))/stride)
+  {
+    return 0u;
+  }
+  return sizeof(struct mmapio_ring) + stride*count;
+}
+
+struct mmapio_ring* mmapio_ring_format
+  (void* p, size_t len, size_t slot_size, size_t count)
+{
+  struct mmapio_ring* const r = (struct mmapio_ring*)p;
+  size_t const sz = mmapio_ring_size(slot_size, count);
+  if (sz == 0u || len < sz) {
+    errno = ERANGE;
+    return NULL;
+  }
+  memset(p, 0, sz);
+  r->slot_size = (mmapio_u32)slot_size;
+  r->stride = mmapio_ring_stride(slot_size);
+  r->mask = count-1u;
+  mmapio_atomic_fence();
+  mmapio_atomic_store32(&r->magic, MMAPIO_RING_MAGIC);
+  return r;
+}
+
+struct mmapio_ring* mmapio_ring_attach(void* p, size_t len) {
+  struct mmapio_ring* const r = (struct mmapio_ring*)p;
+  if (len < sizeof(struct mmapio_ring)
+  ||  mmapio_atomic_load32(&r->magic) != MMAPIO_RING_MAGIC
+  ||  r->stride != mmapio_ring_stride(r->slot_size)
+  ||  (r->mask & (r->mask+1u)) != 0u
+  ||  r->mask >= (mmapio_u64)(~(size_t)0u)
+  ||  mmapio_ring_size(r->slot_size, (size_t)r->mask+1u) > len
+  ||  mmapio_ring_size(r->slot_size, (size_t)r->mask+1u) == 0u)
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return NULL;
+  }
+  return r;
+}
+
+size_t mmapio_ring_slot_size(struct mmapio_ring const* r) {
+  return r->slot_size;
+}
+
+size_t mmapio_ring_push(struct mmapio_ring* r, void const* msgs, size_t n) {
+  mmapio_u64 tail = mmapio_atomic_load64(&r->tail);
+  mmapio_u64 k;
+  /* claim a run of slots */
+  do {
+    mmapio_u64 const head = mmapio_atomic_load64(&r->head);
+    mmapio_u64 const space = r->mask+1u - (tail-head);
+    k = (n < space) ? n : space;
+    if (k == 0u)
+      return 0u;
+  } while (!mmapio_atomic_cas64(&r->tail, &tail, tail+k));
+  /* fill and publish the slots */{
+    mmapio_u64 i;
+    unsigned char const* src = (unsigned char const*)msgs;
+    for (i = 0u; i < k; ++i, src += r->slot_size) {
+      mmapio_u64 volatile* const seq = mmapio_ring_slot(r, tail+i);
+      memcpy((void*)(seq+1), src, r->slot_size);
+      mmapio_atomic_store64(seq, tail+i+1u);
+    }
+  }
+  /* wake the consumer only if it sleeps */
+  mmapio_atomic_fence();
+  if (mmapio_atomic_load32(&r->sleeping) != 0u) {
+    mmapio_ring_wake(r);
+  }
+  return (size_t)k;
+}
+
+size_t mmapio_ring_pop(struct mmapio_ring* r, void* msgs, size_t n) {
+  mmapio_u64 const head = mmapio_atomic_load64(&r->head);
+  size_t i;
+  unsigned char* dst = (unsigned char*)msgs;
+  for (i = 0u; i < n; ++i, dst += r->slot_size) {
+    mmapio_u64 volatile* const seq = mmapio_ring_slot(r, head+i);
+    if (mmapio_atomic_load64(seq) != head+i+1u)
+      break;
+    memcpy(dst, (void const*)(seq+1), r->slot_size);
+  }
+  if (i > 0u) {
+    /* give the whole batch back to producers at once */
+    mmapio_atomic_store64(&r->head, head+i);
+  }
+  return i;
+}
+
+int mmapio_ring_wait(struct mmapio_ring* r, long timeout_ms) {
+  int i;
+  for (i = 0; i < MMAPIO_RING_SPIN; ++i) {
+    if (mmapio_ring_ready(r))
+      return 1;
+  }
+  mmapio_atomic_store32(&r->sleeping, 1u);
+  mmapio_atomic_fence();
+  if (!mmapio_ring_ready(r)) {
+    mmapio_ring_sleep(r, timeout_ms);
+  }
+  mmapio_atomic_store32(&r->sleeping, 0u);
+  return mmapio_ring_ready(r);
+}
+/* END   message ring */
@@ -0,0 +1,108 @@
+/*
+ * \file mmapio_ring.h
+ * \brief Message rings in shared mappings
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Ring_H_
+#define hg_MMapIO_mmapIo_Ring_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Message ring living inside a mapped space.
+ * \note A ring accepts any number of producers and exactly one
+ *   consumer at a time. Producers and the consumer may live in different
+ *   processes, as long as each process maps the same shared space
+ *   (for example, with the 'w' mode or the 'q' bequeath mode).
+ */
+struct mmapio_ring;
+
+/* BEGIN message ring */
+/**
+ * \brief Compute the size of a message ring.
+ * \param slot_size size in bytes of one message
+ * \param count number of message slots; must be a power of two
+ * \return the size in bytes of the ring, or zero if the parameters
+ *   are invalid
+ */
+MMAPIO_API
+size_t mmapio_ring_size(size_t slot_size, size_t count);
+
+/**
+ * \brief Prepare an empty message ring.
+ * \param p start of shared space, aligned to at least 8 bytes
+ * \param len length of the space in bytes
+ * \param slot_size size in bytes of one message
+ * \param count number of message slots; must be a power of two
+ * \return a ring on success, NULL otherwise
+ * \note Only one process should format a ring, before any other
+ *   process attaches to it.
+ */
+MMAPIO_API
+struct mmapio_ring* mmapio_ring_format
+  (void* p, size_t len, size_t slot_size, size_t count);
+
+/**
+ * \brief Attach to a message ring prepared by another process.
+ * \param p start of shared space, aligned to at least 8 bytes
+ * \param len length of the space in bytes
+ * \return a ring on success, NULL otherwise
+ */
+MMAPIO_API
+struct mmapio_ring* mmapio_ring_attach(void* p, size_t len);
+
+/**
+ * \brief Check the message size of a ring.
+ * \param r message ring
+ * \return the size in bytes of one message
+ */
+MMAPIO_API
+size_t mmapio_ring_slot_size(struct mmapio_ring const* r);
+
+/**
+ * \brief Publish a batch of messages.
+ * \param r message ring
+ * \param msgs array of `n` messages of the ring's message size
+ * \param n number of messages to publish
+ * \return the number of messages published, which may be less than
+ *   `n` when the ring is nearly full
+ * \note Safe to call from several producers at once.
+ */
+MMAPIO_API
+size_t mmapio_ring_push(struct mmapio_ring* r, void const* msgs, size_t n);
+
+/**
+ * \brief Consume a batch of messages.
+ * \param r message ring
+ * \param[out] msgs array to receive up to `n` messages
+ * \param n maximum number of messages to consume
+ * \return the number of messages consumed
+ * \note Only one consumer may call this function at a time.
+ */
+MMAPIO_API
+size_t mmapio_ring_pop(struct mmapio_ring* r, void* msgs, size_t n);
+
+/**
+ * \brief Wait for the ring to hold a message.
+ * \param r message ring
+ * \param timeout_ms maximum wait time in milliseconds, or a negative
+ *   number to wait without limit
+ * \return nonzero if a message is ready, zero otherwise
+ * \note On Linux, the wait sleeps on a futex inside the ring, and
+ *   producers only make a system call when the consumer sleeps.
+ *   Elsewhere, the wait polls. The function may return early without
+ *   a message; callers should loop as needed.
+ */
+MMAPIO_API
+int mmapio_ring_wait(struct mmapio_ring* r, long timeout_ms);
+/* END   message ring */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Ring_H_*/
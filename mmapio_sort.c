@@ -0,0 +1,473 @@
+/*
+ * \file mmapio_sort.c
+ * \brief Out-of-core sorting of mapped record files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_sort.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/**
+ * \brief Default memory budget.
+ */
+#define MMAPIO_SORT_BUDGET ((size_t)64u<<20)
+
+/**
+ * \brief Smallest number of records worth a parallel task.
+ */
+#define MMAPIO_SORT_PIECE 4096u
+
+/**
+ * \brief Largest number of parallel parts per run.
+ */
+#define MMAPIO_SORT_PIECES 64u
+
+/**
+ * \brief Sort state shared by run tasks.
+ */
+struct mmapio_sort_ctx {
+  /** \brief size of each record in bytes */
+  size_t rec_size;
+  /** \brief offset of the key within each record */
+  size_t key_off;
+  /** \brief length of the key */
+  size_t key_len;
+  /** \brief comparison callback, or NULL for `memcmp` */
+  mmapio_sort_cmp cmp;
+  /** \brief comparison callback context */
+  void* arg;
+  /** \brief records of the current run */
+  unsigned char* a;
+  /** \brief scratch space as large as `a` */
+  unsigned char* b;
+  /** \brief number of records in the current run */
+  size_t n;
+  /** \brief records per part, or per group in a merge round */
+  size_t width;
+};
+
+/**
+ * \brief Read position in a spilled run.
+ */
+struct mmapio_sort_cursor {
+  /** \brief offset of the next record */
+  size_t pos;
+  /** \brief offset past the last record */
+  size_t end;
+  /** \brief offset up to which the run was evicted */
+  size_t evicted;
+};
+
+/* BEGIN static functions */
+/**
+ * \brief Compare two records.
+ * \param c sort state
+ * \param x first record
+ * \param y second record
+ * \return the comparison result
+ */
+static int mmapio_sort_compare(struct mmapio_sort_ctx const* c,
+    unsigned char const* x, unsigned char const* y);
+
+/**
+ * \brief Merge two sorted groups of records.
+ * \param c sort state
+ * \param dst output space for `nl+nr` records
+ * \param l left group
+ * \param nl number of records in the left group
+ * \param r right group
+ * \param nr number of records in the right group
+ * \note Ties take the left record first, keeping the merge stable.
+ */
+static void mmapio_sort_merge(struct mmapio_sort_ctx const* c,
+    unsigned char* dst, unsigned char const* l, size_t nl,
+    unsigned char const* r, size_t nr);
+
+/**
+ * \brief Sort one part of the current run.
+ * \param arg sort state
+ * \param i part index
+ * \note The sorted part ends up in `a`.
+ */
+static void mmapio_sort_piece_one(void* arg, size_t i);
+
+/**
+ * \brief Merge one pair of groups from `a` into `b`.
+ * \param arg sort state
+ * \param i pair index
+ */
+static void mmapio_sort_round_one(void* arg, size_t i);
+
+/**
+ * \brief Sort the current run.
+ * \param c sort state, with the run in `a`
+ * \param ex executor, or NULL
+ * \return the space that holds the sorted run, `a` or `b`
+ */
+static unsigned char* mmapio_sort_run
+  (struct mmapio_sort_ctx* c, struct mmapio_exec const* ex);
+
+/**
+ * \brief Restore heap order below a slot.
+ * \param c sort state
+ * \param base spilled runs
+ * \param cur run cursors
+ * \param heap run indices, ordered by each run's next record
+ * \param count number of runs in the heap
+ * \param i slot to sift down
+ */
+static void mmapio_sort_sift(struct mmapio_sort_ctx const* c,
+    unsigned char const* base, struct mmapio_sort_cursor const* cur,
+    size_t* heap, size_t count, size_t i);
+
+/**
+ * \brief Check heap order between two runs.
+ * \param c sort state
+ * \param base spilled runs
+ * \param cur run cursors
+ * \param x first run index
+ * \param y second run index
+ * \return nonzero if run `x` should leave the heap first
+ */
+static int mmapio_sort_before(struct mmapio_sort_ctx const* c,
+    unsigned char const* base, struct mmapio_sort_cursor const* cur,
+    size_t x, size_t y);
+
+/**
+ * \brief Evict whole pages behind a cursor.
+ * \param m map instance
+ * \param[in,out] evicted offset up to which pages are gone
+ * \param pos cursor offset
+ * \param window smallest span worth evicting
+ * \param psize page size
+ */
+static void mmapio_sort_evict(struct mmapio_i* m, size_t* evicted,
+    size_t pos, size_t window, size_t psize);
+
+/**
+ * \brief Merge spilled runs into the output.
+ * \param c sort state
+ * \param out output map instance
+ * \param tmp map instance holding the runs
+ * \param run_size size of each run in bytes, except the last
+ * \param budget memory budget
+ * \return zero on success, -1 otherwise
+ */
+static int mmapio_sort_kmerge(struct mmapio_sort_ctx const* c,
+    struct mmapio_i* out, struct mmapio_i* tmp, size_t run_size,
+    size_t budget);
+
+int mmapio_sort_compare(struct mmapio_sort_ctx const* c,
+    unsigned char const* x, unsigned char const* y)
+{
+  if (c->cmp != NULL)
+    return (*c->cmp)(c->arg, x, y);
+  else return memcmp(x + c->key_off, y + c->key_off, c->key_len);
+}
+
+void mmapio_sort_merge(struct mmapio_sort_ctx const* c,
+    unsigned char* dst, unsigned char const* l, size_t nl,
+    unsigned char const* r, size_t nr)
+{
+  size_t const rs = c->rec_size;
+  while (nl > 0u && nr > 0u) {
+    if (mmapio_sort_compare(c, r, l) < 0) {
+      memcpy(dst, r, rs);
+      r += rs;
+      nr -= 1u;
+    } else {
+      memcpy(dst, l, rs);
+      l += rs;
+      nl -= 1u;
+    }
+    dst += rs;
+  }
+  memcpy(dst, l, nl*rs);
+  memcpy(dst + nl*rs, r, nr*rs);
+  return;
+}
+
+void mmapio_sort_piece_one(void* arg, size_t i) {
+  struct mmapio_sort_ctx const* const c = (struct mmapio_sort_ctx const*)arg;
+  size_t const rs = c->rec_size;
+  size_t const first = i*c->width;
+  size_t const n = (c->n - first < c->width) ? c->n - first : c->width;
+  unsigned char* from = c->a + first*rs;
+  unsigned char* to = c->b + first*rs;
+  size_t w;
+  /* bottom-up passes between the two spaces */
+  for (w = 1u; w < n; w *= 2u) {
+    size_t j;
+    unsigned char* const swap = from;
+    for (j = 0u; j < n; j += 2u*w) {
+      size_t const nl = (n-j < w) ? n-j : w;
+      size_t const nr = (n-j-nl < w) ? n-j-nl : w;
+      mmapio_sort_merge(c, to + j*rs, from + j*rs, nl,
+          from + (j+nl)*rs, nr);
+    }
+    from = to;
+    to = swap;
+  }
+  if (from != c->a + first*rs)
+    memcpy(c->a + first*rs, from, n*rs);
+  return;
+}
+
+void mmapio_sort_round_one(void* arg, size_t i) {
+  struct mmapio_sort_ctx const* const c = (struct mmapio_sort_ctx const*)arg;
+  size_t const rs = c->rec_size;
+  size_t const first = i*2u*c->width;
+  size_t const nl = (c->n - first < c->width) ? c->n - first : c->width;
+  size_t const nr = (c->n - first - nl < c->width)
+    ? c->n - first - nl : c->width;
+  mmapio_sort_merge(c, c->b + first*rs, c->a + first*rs, nl,
+      c->a + (first+nl)*rs, nr);
+  return;
+}
+
+unsigned char* mmapio_sort_run
+  (struct mmapio_sort_ctx* c, struct mmapio_exec const* ex)
+{
+  size_t pieces = 1u;
+  if (ex != NULL) {
+    pieces = c->n / MMAPIO_SORT_PIECE;
+    if (pieces > MMAPIO_SORT_PIECES)
+      pieces = MMAPIO_SORT_PIECES;
+    else if (pieces < 1u)
+      pieces = 1u;
+  }
+  c->width = c->n/pieces + (c->n%pieces ? 1u : 0u);
+  mmapio_exec_run(ex, pieces, &mmapio_sort_piece_one, c);
+  /* merge the parts pairwise, one parallel round per level */
+  while (c->width < c->n) {
+    size_t const span = 2u*c->width;
+    unsigned char* const swap = c->a;
+    mmapio_exec_run(ex, c->n/span + (c->n%span ? 1u : 0u),
+        &mmapio_sort_round_one, c);
+    c->a = c->b;
+    c->b = swap;
+    c->width = span;
+  }
+  return c->a;
+}
+
+int mmapio_sort_before(struct mmapio_sort_ctx const* c,
+    unsigned char const* base, struct mmapio_sort_cursor const* cur,
+    size_t x, size_t y)
+{
+  int const cmp = mmapio_sort_compare(c, base + cur[x].pos,
+      base + cur[y].pos);
+  /* earlier runs win ties, which keeps the sort stable */
+  return cmp < 0 || (cmp == 0 && x < y);
+}
+
+void mmapio_sort_sift(struct mmapio_sort_ctx const* c,
+    unsigned char const* base, struct mmapio_sort_cursor const* cur,
+    size_t* heap, size_t count, size_t i)
+{
+  for (;;) {
+    size_t const l = 2u*i + 1u;
+    size_t best = i;
+    if (l < count && mmapio_sort_before(c, base, cur, heap[l], heap[best]))
+      best = l;
+    if (l+1u < count
+    &&  mmapio_sort_before(c, base, cur, heap[l+1u], heap[best]))
+    {
+      best = l+1u;
+    }
+    if (best == i)
+      break;
+    else {
+      size_t const swap = heap[i];
+      heap[i] = heap[best];
+      heap[best] = swap;
+      i = best;
+    }
+  }
+  return;
+}
+
+void mmapio_sort_evict(struct mmapio_i* m, size_t* evicted,
+    size_t pos, size_t window, size_t psize)
+{
+  size_t const upto = pos - pos%psize;
+  if (upto > *evicted && upto - *evicted >= window) {
+    /* failure only leaves the pages for the kernel to reclaim */
+    (void)mmapio_advise(m, *evicted, upto - *evicted, mmapio_advice_evict);
+    *evicted = upto;
+  }
+  return;
+}
+
+int mmapio_sort_kmerge(struct mmapio_sort_ctx const* c,
+    struct mmapio_i* out, struct mmapio_i* tmp, size_t run_size,
+    size_t budget)
+{
+  size_t const total = c->n * c->rec_size;
+  size_t const runs = total/run_size + (total%run_size ? 1u : 0u);
+  size_t const psize = mmapio_page_size() ? mmapio_page_size() : 4096u;
+  size_t window = budget / (runs+1u);
+  struct mmapio_sort_cursor* cur;
+  size_t* heap;
+  unsigned char* base;
+  unsigned char* dst;
+  size_t count = runs;
+  size_t wpos = 0u;
+  size_t wevicted = 0u;
+  size_t i;
+  int res = 0;
+  if (window < psize)
+    window = psize;
+  cur = (struct mmapio_sort_cursor*)calloc(
+      runs, sizeof(struct mmapio_sort_cursor));
+  heap = (size_t*)calloc(runs, sizeof(size_t));
+  base = (unsigned char*)mmapio_acquire(tmp);
+  dst = (unsigned char*)mmapio_acquire(out);
+  if (cur == NULL || heap == NULL || base == NULL || dst == NULL) {
+    int const err = errno;
+    res = -1;
+    count = 0u;
+    errno = (cur == NULL || heap == NULL) ? ENOMEM : err;
+  }
+  for (i = 0u; i < count; ++i) {
+    cur[i].pos = i*run_size;
+    cur[i].end = (total - cur[i].pos < run_size) ? total : cur[i].pos+run_size;
+    cur[i].evicted = cur[i].pos;
+    heap[i] = i;
+  }
+  if (count > 0u) {
+    (void)mmapio_advise(tmp, 0u, total, mmapio_advice_sequential);
+    (void)mmapio_advise(out, 0u, total, mmapio_advice_sequential);
+  }
+  for (i = count/2u; i > 0u; --i)
+    mmapio_sort_sift(c, base, cur, heap, count, i-1u);
+  while (count > 0u) {
+    struct mmapio_sort_cursor* const top = cur+heap[0];
+    memcpy(dst + wpos, base + top->pos, c->rec_size);
+    wpos += c->rec_size;
+    top->pos += c->rec_size;
+    mmapio_sort_evict(tmp, &top->evicted, top->pos, window, psize);
+    mmapio_sort_evict(out, &wevicted, wpos, window, psize);
+    if (top->pos >= top->end) {
+      count -= 1u;
+      heap[0] = heap[count];
+    }
+    mmapio_sort_sift(c, base, cur, heap, count, 0u);
+  }
+  if (dst != NULL)
+    mmapio_release(out, dst);
+  if (base != NULL)
+    mmapio_release(tmp, base);
+  free(heap);
+  free(cur);
+  return res;
+}
+/* END   static functions */
+
+/* BEGIN record sort */
+int mmapio_sort(char const* dst, struct mmapio_i* src,
+    struct mmapio_sort_spec const* spec)
+{
+  struct mmapio_sort_ctx c;
+  size_t const budget = (spec != NULL && spec->budget != 0u)
+    ? spec->budget : MMAPIO_SORT_BUDGET;
+  size_t len;
+  size_t run_size;
+  size_t off;
+  unsigned char* in;
+  struct mmapio_i* out;
+  struct mmapio_i* tmp = NULL;
+  int res = 0;
+  if (dst == NULL || src == NULL || spec == NULL || spec->rec_size == 0u
+  ||  (spec->cmp == NULL && spec->key_off + spec->key_len > spec->rec_size)
+  ||  budget/2u < spec->rec_size)
+  {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  }
+  len = mmapio_length(src);
+  if (len % spec->rec_size != 0u) {
+#if (defined EINVAL)
+    errno = EINVAL;
+#else
+    errno = EDOM;
+#endif /*EINVAL*/
+    return -1;
+  } else if (len == 0u) {
+    /* nothing to sort, so publish an empty file */
+    int err;
+    out = mmapio_publish_open(dst, 0u);
+    if (out == NULL)
+      return -1;
+    res = mmapio_publish_commit(out, 0u);
+    err = errno;
+    mmapio_close(out);
+    errno = err;
+    return res;
+  }
+  c.rec_size = spec->rec_size;
+  c.key_off = spec->key_off;
+  c.key_len = spec->key_len;
+  c.cmp = spec->cmp;
+  c.arg = spec->arg;
+  run_size = (budget/2u) / c.rec_size * c.rec_size;
+  if (run_size > len)
+    run_size = len;
+  c.a = (unsigned char*)malloc(run_size);
+  c.b = (unsigned char*)malloc(run_size);
+  if (c.a == NULL || c.b == NULL) {
+    free(c.b);
+    free(c.a);
+    errno = ENOMEM;
+    return -1;
+  }
+  in = (unsigned char*)mmapio_acquire(src);
+  out = mmapio_publish_open(dst, len);
+  if (out != NULL && run_size < len)
+    tmp = mmapio_publish_open(dst, len);
+  if (in == NULL || out == NULL || (run_size < len && tmp == NULL))
+    res = -1;
+  else (void)mmapio_advise(src, 0u, len, mmapio_advice_sequential);
+  /* sort each run in memory, then spill it */
+  for (off = 0u; res == 0 && off < len; off += run_size) {
+    struct mmapio_i* const spill = (tmp != NULL) ? tmp : out;
+    unsigned char* const p = (unsigned char*)mmapio_acquire(spill);
+    size_t const n = (len - off < run_size) ? len - off : run_size;
+    unsigned char* sorted;
+    if (p == NULL) {
+      res = -1;
+      break;
+    }
+    memcpy(c.a, in + off, n);
+    c.n = n / c.rec_size;
+    sorted = mmapio_sort_run(&c, spec->ex);
+    memcpy(p + off, sorted, n);
+    mmapio_release(spill, p);
+    (void)mmapio_advise(spill, off, n, mmapio_advice_evict);
+  }
+  free(c.b);
+  free(c.a);
+  if (in != NULL)
+    mmapio_release(src, in);
+  if (res == 0 && tmp != NULL) {
+    c.n = len / c.rec_size;
+    res = mmapio_sort_kmerge(&c, out, tmp, run_size, budget);
+  }
+  if (tmp != NULL)
+    mmapio_close(tmp);
+  if (res == 0)
+    res = mmapio_publish_commit(out, 0u);
+  if (out != NULL) {
+    int const err = errno;
+    mmapio_close(out);
+    errno = err;
+  }
+  return res;
+}
+/* END   record sort */
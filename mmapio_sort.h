@@ -0,0 +1,85 @@
+/*
+ * \file mmapio_sort.h
+ * \brief Out-of-core sorting of mapped record files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_Sort_H_
+#define hg_MMapIO_mmapIo_Sort_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Record comparison callback.
+ * \param arg callback context
+ * \param a first record
+ * \param b second record
+ * \return a negative value if `a` sorts first, a positive value if
+ *   `b` sorts first, zero if the records tie
+ * \note Parallel runs call this from several threads at once.
+ */
+typedef int (*mmapio_sort_cmp)(void* arg, void const* a, void const* b);
+
+/**
+ * \brief Description of a sort.
+ * \note To sort variable-length records, sort an index of fixed-size
+ *   pairs instead: for example, 16-byte records holding an 8-byte
+ *   big-endian key prefix and an 8-byte offset into the original
+ *   mapping. Compare the prefixes with `memcmp` (the default), or
+ *   pass a callback that breaks prefix ties by looking up the full
+ *   keys through the offsets.
+ */
+struct mmapio_sort_spec {
+  /** \brief size of each record in bytes */
+  size_t rec_size;
+  /** \brief offset of the key within each record */
+  size_t key_off;
+  /** \brief length of the key, for the default comparison */
+  size_t key_len;
+  /**
+   * \brief comparison callback, or NULL to compare keys with `memcmp`
+   */
+  mmapio_sort_cmp cmp;
+  /** \brief comparison callback context */
+  void* arg;
+  /**
+   * \brief memory budget in bytes, or zero for the default of 64 MiB
+   * \note Half of the budget holds a run while it sorts, and the other
+   *   half is scratch space. The merge keeps about as much of the
+   *   spilled runs and the output mapped at a time.
+   */
+  size_t budget;
+  /** \brief executor for sorting parts of each run in parallel */
+  struct mmapio_exec const* ex;
+};
+
+/* BEGIN record sort */
+/**
+ * \brief Sort the records of a map instance into a new file.
+ * \param dst name of the output file
+ * \param src map instance holding whole records
+ * \param spec description of the sort
+ * \return zero on success, -1 otherwise
+ * \note The sort is stable. Input too big for one run is cut into
+ *   runs that fit the budget; each run sorts in memory, in parallel
+ *   parts merged together, and spills to a temporary mapping beside
+ *   `dst`. A k-way merge then writes the output mapping, evicting the
+ *   spilled runs and the output from memory behind its cursors.
+ * \note The output replaces `dst` in one step, as with
+ *   \link mmapio_publish_commit \endlink, so readers never see a
+ *   partial file. On Windows, this function fails with `ENOSYS`
+ *   until the publish functions are available there.
+ */
+MMAPIO_API
+int mmapio_sort(char const* dst, struct mmapio_i* src,
+    struct mmapio_sort_spec const* spec);
+/* END   record sort */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_Sort_H_*/
@@ -0,0 +1,285 @@
+/*
+ * \file mmapio_stree.c
+ * \brief Static search trees over mapped key files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#define MMAPIO_WIN32_DLL_INTERNAL
+#include "mmapio_stree.h"
+#include <string.h>
+#include <errno.h>
+
+#if (defined __AVX2__)
+#  include <immintrin.h>
+#  define MMAPIO_STREE_AVX2 1
+#elif (defined __SSE2__) || (defined _M_X64) \
+  ||  ((defined _M_IX86_FP) && (_M_IX86_FP >= 2))
+#  include <emmintrin.h>
+#  define MMAPIO_STREE_SSE2 1
+#endif /*__AVX2__*/
+
+/**
+ * \brief Tree file signature ("MMST" in little-endian order).
+ */
+#define MMAPIO_STREE_MAGIC 0x54534D4Du
+
+/**
+ * \brief Header at the start of every search tree.
+ * \note Layers are stored leaves first. Layer offsets count keys
+ *   from the end of the header.
+ */
+struct mmapio_stree_head {
+  /** \brief tree signature */
+  mmapio_u32 magic;
+  /** \brief number of layers */
+  mmapio_u32 height;
+  /** \brief number of keys in the sorted key array */
+  mmapio_u64 count;
+  /** \brief starting key index of each layer, plus total key count */
+  mmapio_u64 offsets[mmapio_stree_max_height+1];
+};
+
+/**
+ * \brief Count the blocks needed for a layer.
+ * \param n number of keys in the layer
+ * \return a block count
+ */
+static size_t mmapio_stree_blocks(size_t n);
+
+/**
+ * \brief Count the keys of the layer above a given layer.
+ * \param n number of keys in the lower layer
+ * \return a key count
+ */
+static size_t mmapio_stree_prev_keys(size_t n);
+
+/**
+ * \brief Compute the layer offsets of a tree.
+ * \param n number of keys
+ * \param[out] offsets layer offset array
+ * \return the layer count on success, zero otherwise
+ */
+static unsigned int mmapio_stree_layers(size_t n, size_t* offsets);
+
+/**
+ * \brief Count the keys in a node less than a given key.
+ * \param node start of a node of \link mmapio_stree_node \endlink keys
+ * \param key the key to compare
+ * \return a number from zero to the node width
+ */
+static unsigned int mmapio_stree_rank
+  (mmapio_u32 const* node, mmapio_u32 key);
+
+/* BEGIN static functions */
+size_t mmapio_stree_blocks(size_t n) {
+  return (n + mmapio_stree_node - 1) / mmapio_stree_node;
+}
+
+size_t mmapio_stree_prev_keys(size_t n) {
+  return ((mmapio_stree_blocks(n) + mmapio_stree_node)
+      / (mmapio_stree_node + 1)) * mmapio_stree_node;
+}
+
+unsigned int mmapio_stree_layers(size_t n, size_t* offsets) {
+  unsigned int h = 0;
+  size_t k = 0;
+  size_t const max_keys = (~(size_t)0u)/sizeof(mmapio_u32)
+      - mmapio_stree_header;
+  do {
+    size_t const layer = n > 0u
+      ? mmapio_stree_blocks(n) * mmapio_stree_node
+      : mmapio_stree_node;
+    if (h >= mmapio_stree_max_height || layer > max_keys - k) {
+      return 0u;
+    }
+    offsets[h++] = k;
+    k += layer;
+    if (n <= mmapio_stree_node)
+      break;
+    n = mmapio_stree_prev_keys(n);
+  } while (1);
+  offsets[h] = k;
+  return h;
+}
+
+unsigned int mmapio_stree_rank(mmapio_u32 const* node, mmapio_u32 key) {
+#if (defined MMAPIO_STREE_AVX2)
+  __m256i const flip = _mm256_set1_epi32((int)0x80000000u);
+  __m256i const x = _mm256_xor_si256(_mm256_set1_epi32((int)key), flip);
+  __m256i const a = _mm256_xor_si256(
+      _mm256_loadu_si256((__m256i const*)node), flip);
+  __m256i const b = _mm256_xor_si256(
+      _mm256_loadu_si256((__m256i const*)(node+8)), flip);
+  __m256i const lt = _mm256_packs_epi32(
+      _mm256_cmpgt_epi32(x, a), _mm256_cmpgt_epi32(x, b));
+  unsigned int mask = (unsigned int)_mm256_movemask_epi8(lt);
+  unsigned int i = 0;
+  while (mask) {
+    mask &= mask-1u;
+    i += 1;
+  }
+  return i>>1;
+#elif (defined MMAPIO_STREE_SSE2)
+  __m128i const flip = _mm_set1_epi32((int)0x80000000u);
+  __m128i const x = _mm_xor_si128(_mm_set1_epi32((int)key), flip);
+  __m128i const a = _mm_cmpgt_epi32(x,
+      _mm_xor_si128(_mm_loadu_si128((__m128i const*)node), flip));
+  __m128i const b = _mm_cmpgt_epi32(x,
+      _mm_xor_si128(_mm_loadu_si128((__m128i const*)(node+4)), flip));
+  __m128i const c = _mm_cmpgt_epi32(x,
+      _mm_xor_si128(_mm_loadu_si128((__m128i const*)(node+8)), flip));
+  __m128i const d = _mm_cmpgt_epi32(x,
+      _mm_xor_si128(_mm_loadu_si128((__m128i const*)(node+12)), flip));
+  unsigned int mask = (unsigned int)_mm_movemask_epi8(
+      _mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+  /* keys in a node are sorted, so the mask is a run of low bits */
+  unsigned int i = 0;
+  while (mask & 1u) {
+    mask >>= 1;
+    i += 1;
+  }
+  return i;
+#else
+  unsigned int i;
+  unsigned int out = 0;
+  for (i = 0; i < mmapio_stree_node; ++i) {
+    out += (node[i] < key);
+  }
+  return out;
+#endif /*MMAPIO_STREE_AVX2*/
+}
+/* END   static functions */
+
+/* BEGIN static search tree */
+size_t mmapio_stree_size(size_t n) {
+  size_t offsets[mmapio_stree_max_height+1];
+  unsigned int const h = mmapio_stree_layers(n, offsets);
+  if (h == 0u)
+    return 0u;
+  else return mmapio_stree_header + offsets[h]*sizeof(mmapio_u32);
+}
+
+int mmapio_stree_build
+  (void* dst, size_t dstlen, mmapio_u32 const* keys, size_t n)
+{
+  size_t offsets[mmapio_stree_max_height+1];
+  unsigned int const height = mmapio_stree_layers(n, offsets);
+  struct mmapio_stree_head head;
+  mmapio_u32* const tree = (mmapio_u32*)(
+      ((unsigned char*)dst) + mmapio_stree_header);
+  if (height == 0u
+  ||  dstlen < mmapio_stree_header + offsets[height]*sizeof(mmapio_u32))
+  {
+    errno = ERANGE;
+    return -1;
+  }
+  /* leaves hold the keys themselves */{
+    size_t i;
+    memcpy(tree, keys, n*sizeof(mmapio_u32));
+    for (i = n; i < offsets[1]; ++i) {
+      tree[i] = 0xFFFFFFFFu;
+    }
+  }
+  /* each inner key is the smallest key of the subtree to its right */{
+    unsigned int h;
+    size_t const leaf_blocks = mmapio_stree_blocks(n);
+    for (h = 1; h < height; ++h) {
+      size_t i;
+      size_t const layer = offsets[h+1] - offsets[h];
+      for (i = 0; i < layer; ++i) {
+        unsigned int l;
+        size_t k = i / mmapio_stree_node;
+        size_t const j = i - k*mmapio_stree_node;
+        k = k*(mmapio_stree_node+1) + j + 1;
+        for (l = 1; l < h; ++l) {
+          k *= (mmapio_stree_node+1);
+        }
+        tree[offsets[h]+i] = (k < leaf_blocks)
+          ? tree[k*mmapio_stree_node]
+          : 0xFFFFFFFFu;
+      }
+    }
+  }
+  /* write the header */{
+    unsigned int h;
+    memset(&head, 0, sizeof(head));
+    head.magic = MMAPIO_STREE_MAGIC;
+    head.height = height;
+    head.count = n;
+    for (h = 0; h <= height; ++h) {
+      head.offsets[h] = offsets[h];
+    }
+    memset(dst, 0, mmapio_stree_header);
+    memcpy(dst, &head, sizeof(head));
+  }
+  return 0;
+}
+
+int mmapio_stree_build_map(struct mmapio_i* dst, struct mmapio_i* keys) {
+  int res;
+  void* const p = mmapio_acquire(dst);
+  void* const k = mmapio_acquire(keys);
+  if (p == NULL || k == NULL) {
+    res = -1;
+  } else {
+    res = mmapio_stree_build(p, mmapio_length(dst), (mmapio_u32 const*)k,
+        mmapio_length(keys)/sizeof(mmapio_u32));
+  }
+  if (k != NULL)
+    mmapio_release(keys, k);
+  if (p != NULL)
+    mmapio_release(dst, p);
+  return res;
+}
+
+size_t mmapio_stree_check(void const* tree, size_t len) {
+  struct mmapio_stree_head head;
+  if (len < mmapio_stree_header) {
+    return (size_t)-1;
+  }
+  memcpy(&head, tree, sizeof(head));
+  if (head.magic != MMAPIO_STREE_MAGIC
+  ||  head.height == 0u || head.height > mmapio_stree_max_height
+  ||  head.count > (mmapio_u64)((~(size_t)0u)/sizeof(mmapio_u32)))
+  {
+    return (size_t)-1;
+  }
+  /* recompute the layout to reject damaged headers */{
+    size_t offsets[mmapio_stree_max_height+1];
+    unsigned int const height = mmapio_stree_layers(
+        (size_t)head.count, offsets);
+    unsigned int h;
+    if (height != head.height) {
+      return (size_t)-1;
+    }
+    for (h = 0; h <= height; ++h) {
+      if (head.offsets[h] != offsets[h])
+        return (size_t)-1;
+    }
+    if ((len - mmapio_stree_header)/sizeof(mmapio_u32) < offsets[height])
+      return (size_t)-1;
+  }
+  return (size_t)head.count;
+}
+
+size_t mmapio_stree_lower_bound(void const* tree, mmapio_u32 key) {
+  struct mmapio_stree_head const* const head =
+    (struct mmapio_stree_head const*)tree;
+  mmapio_u32 const* const keys = (mmapio_u32 const*)(
+      ((unsigned char const*)tree) + mmapio_stree_header);
+  size_t k = 0;
+  unsigned int h;
+  for (h = head->height - 1; h > 0; --h) {
+    unsigned int const i = mmapio_stree_rank(
+        keys + (size_t)head->offsets[h] + k, key);
+    k = k*(mmapio_stree_node+1) + i*mmapio_stree_node;
+  }
+  k += mmapio_stree_rank(keys + k, key);
+  return k < head->count ? k : (size_t)head->count;
+}
+
+mmapio_u32 mmapio_stree_key(void const* tree, size_t i) {
+  mmapio_u32 const* const keys = (mmapio_u32 const*)(
+      ((unsigned char const*)tree) + mmapio_stree_header);
+  return keys[i];
+}
+/* END   static search tree */
@@ -0,0 +1,105 @@
+/*
+ * \file mmapio_stree.h
+ * \brief Static search trees over mapped key files
+ * \author Cody Licorish (svgmovement@gmail.com)
+ */
+#ifndef hg_MMapIO_mmapIo_sTree_H_
+#define hg_MMapIO_mmapIo_sTree_H_
+
+#include "mmapio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /*__cplusplus*/
+
+/**
+ * \brief Static search tree layout parameters.
+ */
+enum mmapio_stree_layout {
+  /**
+   * \brief Number of keys per tree node. One node fills one
+   *   64-byte cache line.
+   */
+  mmapio_stree_node = 16,
+  /**
+   * \brief Size in bytes of the tree header.
+   */
+  mmapio_stree_header = 256,
+  /**
+   * \brief Maximum number of tree layers.
+   */
+  mmapio_stree_max_height = 24
+};
+
+/* BEGIN static search tree */
+/**
+ * \brief Compute the size of a search tree.
+ * \param n number of keys in the sorted key array
+ * \return the size in bytes of a tree for `n` keys, or zero if
+ *   such a tree is too large to describe
+ */
+MMAPIO_API
+size_t mmapio_stree_size(size_t n);
+
+/**
+ * \brief Build a search tree from a sorted key array.
+ * \param dst output space of at least \link mmapio_stree_size \endlink
+ *   bytes
+ * \param dstlen length of the output space in bytes
+ * \param keys array of keys, sorted in ascending order
+ * \param n number of keys
+ * \return zero on success, nonzero otherwise
+ * \note Keys use the native byte order. A tree built on one
+ *   machine can only be searched on machines of the same byte order.
+ */
+MMAPIO_API
+int mmapio_stree_build
+  (void* dst, size_t dstlen, mmapio_u32 const* keys, size_t n);
+
+/**
+ * \brief Build a search tree from a mapped sorted key file.
+ * \param dst writable map instance for the tree
+ * \param keys map instance holding a sorted array of native-order
+ *   32-bit keys
+ * \return zero on success, nonzero otherwise
+ */
+MMAPIO_API
+int mmapio_stree_build_map(struct mmapio_i* dst, struct mmapio_i* keys);
+
+/**
+ * \brief Check whether a space holds a search tree.
+ * \param tree start of the tree
+ * \param len length of the space in bytes
+ * \return the number of keys in the tree on success,
+ *   `(size_t)-1` otherwise
+ */
+MMAPIO_API
+size_t mmapio_stree_check(void const* tree, size_t len);
+
+/**
+ * \brief Find the first key not less than a given key.
+ * \param tree start of a tree accepted by \link mmapio_stree_check \endlink
+ * \param key the key to find
+ * \return the index in the original sorted key array of the first
+ *   key not less than `key`, or the key count if no such key exists
+ * \note The tree must start on an 8-byte boundary. Trees mapped from
+ *   the start of a file satisfy this.
+ */
+MMAPIO_API
+size_t mmapio_stree_lower_bound(void const* tree, mmapio_u32 key);
+
+/**
+ * \brief Read a key by its index in the original sorted key array.
+ * \param tree start of a tree accepted by \link mmapio_stree_check \endlink
+ * \param i index less than the key count
+ * \return the key at that index
+ */
+MMAPIO_API
+mmapio_u32 mmapio_stree_key(void const* tree, size_t i);
+/* END   static search tree */
+
+#ifdef __cplusplus
+};
+#endif /*__cplusplus*/
+
+#endif /*hg_MMapIO_mmapIo_sTree_H_*/
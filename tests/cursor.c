@@ -0,0 +1,78 @@
+
+#include "../mmapio_cursor.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+static int cursor_failures = 0;
+
+static void cursor_check(int ok, char const* what) {
+  if (!ok) {
+    fprintf(stderr, "failed: %s\n", what);
+    cursor_failures += 1;
+  }
+  return;
+}
+
+static void cursor_test_reads(void) {
+  unsigned char const buf[12] = {
+    1, 2, 3, 4, 5, 6, 7, 8, 0x96, 0x01, 9, 10
+  };
+  struct mmapio_cursor c;
+  size_t got;
+  mmapio_cursor_init(&c, buf, sizeof(buf));
+  cursor_check(mmapio_cursor_reserve(&c, 10), "reserve in range");
+  cursor_check(mmapio_cursor_u32le(&c) == 0x04030201u, "u32le");
+  cursor_check(mmapio_cursor_u32be(&c) == 0x05060708u, "u32be");
+  cursor_check(mmapio_cursor_varint(&c) == 150u, "varint");
+  cursor_check(mmapio_cursor_left(&c) == 2u, "left");
+  (void)mmapio_cursor_slice(&c, 5u, &got);
+  cursor_check(got == 2u && !mmapio_cursor_ok(&c), "short slice");
+  return;
+}
+
+static void cursor_test_sink(void) {
+  unsigned char const buf[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+  struct mmapio_cursor c;
+  size_t got;
+  unsigned long int n;
+  mmapio_u64 sum = 0u;
+  /* a reserve larger than the sink */
+  mmapio_cursor_init(&c, buf, sizeof(buf));
+  cursor_check(!mmapio_cursor_reserve(&c, 64u), "reserve past end");
+  cursor_check(!mmapio_cursor_ok(&c), "error flag");
+  cursor_check(mmapio_cursor_left(&c) == 0u, "no bytes left");
+  cursor_check(!mmapio_cursor_reserve(&c, 1u), "later reserve fails");
+  /* clamped reads must not move past the sink */
+  mmapio_cursor_skip(&c, 40u);
+  (void)mmapio_cursor_slice(&c, 16u, &got);
+  cursor_check(got == 0u, "empty slice");
+  mmapio_cursor_align(&c, 16u);
+  for (n = 0u; n < 100u; ++n) {
+    sum += mmapio_cursor_u64le(&c);
+    sum += mmapio_cursor_varint(&c);
+    sum += mmapio_cursor_u8(&c);
+    mmapio_cursor_skip(&c, 31u);
+  }
+  cursor_check(sum == 0u, "sink reads zeros");
+  cursor_check(c.pos <= c.len, "position in bounds");
+  /* a loop driven by the cursor ends on truncated input */
+  mmapio_cursor_init(&c, buf, 5u);
+  for (n = 0u; n < 1000u && mmapio_cursor_left(&c) > 0u; ++n) {
+    (void)mmapio_cursor_reserve(&c, 4u);
+    (void)mmapio_cursor_u32le(&c);
+  }
+  cursor_check(n == 2u, "loop ends");
+  cursor_check(!mmapio_cursor_ok(&c), "loop error flag");
+  return;
+}
+
+int main(int argc, char **argv) {
+  (void)argc;
+  (void)argv;
+  cursor_test_reads();
+  cursor_test_sink();
+  if (cursor_failures != 0)
+    return EXIT_FAILURE;
+  fputs("cursor: ok\n", stdout);
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,128 @@
+
+#define _POSIX_C_SOURCE 200809L
+#include "../mmapio.h"
+#include "../mmapio_prof.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if (defined _WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <time.h>
+#endif /*_WIN32*/
+
+static char* prof_getline(FILE* f) {
+  size_t cap = 256;
+  size_t n = 0;
+  char* out = (char*)malloc(cap);
+  int ch;
+  if (out == NULL)
+    return NULL;
+  while ((ch = fgetc(f)) != EOF && ch != '\n') {
+    if (n+1 >= cap) {
+      char* const next = (char*)realloc(out, cap*2);
+      if (next == NULL) {
+        free(out);
+        return NULL;
+      }
+      out = next;
+      cap *= 2;
+    }
+    out[n++] = (char)ch;
+  }
+  if (ch == EOF && n == 0) {
+    free(out);
+    return NULL;
+  }
+  if (n > 0 && out[n-1] == '\r')
+    n -= 1;
+  out[n] = 0;
+  return out;
+}
+
+static void prof_sleep(unsigned long ms) {
+#if (defined _WIN32)
+  Sleep((DWORD)ms);
+#else
+  struct timespec ts;
+  ts.tv_sec = (time_t)(ms/1000);
+  ts.tv_nsec = (long)(ms%1000)*1000000L;
+  nanosleep(&ts, NULL);
+#endif /*_WIN32*/
+  return;
+}
+
+int main(int argc, char **argv) {
+  struct mmapio_prof* prof;
+  struct mmapio_i** maps = NULL;
+  size_t count = 0;
+  size_t cap = 0;
+  size_t i;
+  unsigned long interval;
+  unsigned long samples;
+  unsigned long s;
+  if (argc < 4) {
+    fputs("usage: prof (interval ms) (samples) (bucket size) "
+      "< (file list)\n", stderr);
+    return EXIT_FAILURE;
+  }
+  interval = strtoul(argv[1], NULL, 0);
+  samples = strtoul(argv[2], NULL, 0);
+  mmapio_set_errno(0);
+  prof = mmapio_prof_open((size_t)strtoul(argv[3], NULL, 0));
+  if (prof == NULL) {
+    fprintf(stderr, "failed to start profiler\n\t%s\n",
+      strerror(mmapio_get_errno()));
+    return EXIT_FAILURE;
+  }
+  /* map and register every listed file */for (;;) {
+    char* const name = prof_getline(stdin);
+    struct mmapio_i* mi;
+    if (name == NULL)
+      break;
+    if (name[0] == 0) {
+      free(name);
+      continue;
+    }
+    mmapio_set_errno(0);
+    mi = mmapio_open(name, "rf", 0, 0);
+    if (mi == NULL) {
+      fprintf(stderr, "failed to map file '%s'\n\t%s\n", name,
+        strerror(mmapio_get_errno()));
+    } else if (count >= cap) {
+      size_t const next_cap = cap ? cap*2 : 16;
+      struct mmapio_i** const next = (struct mmapio_i**)realloc(
+          maps, next_cap*sizeof(struct mmapio_i*));
+      if (next == NULL) {
+        mmapio_close(mi);
+        mi = NULL;
+      } else {
+        maps = next;
+        cap = next_cap;
+      }
+    }
+    if (mi != NULL) {
+      maps[count++] = mi;
+      if (mmapio_prof_add(prof, mi, name) != 0)
+        fprintf(stderr, "failed to register file '%s'\n", name);
+    }
+    free(name);
+  }
+  /* sample the page cache while other processes use the files */
+  for (s = 0; s < samples; ++s) {
+    if (s > 0)
+      prof_sleep(interval);
+    if (mmapio_prof_sample(prof, stdout) != 0) {
+      fprintf(stderr, "sample %lu incomplete\n\t%s\n", s,
+        strerror(mmapio_get_errno()));
+    }
+    fflush(stdout);
+  }
+  mmapio_prof_close(prof);
+  for (i = 0; i < count; ++i) {
+    mmapio_close(maps[i]);
+  }
+  free(maps);
+  return EXIT_SUCCESS;
+}
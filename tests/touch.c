@@ -0,0 +1,256 @@
+
+#include "../mmapio.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#if (defined _WIN32)
+#  define WIN32_LEAN_AND_MEAN
+#  include <windows.h>
+#else
+#  include <unistd.h>
+#  include <sys/resource.h>
+#endif /*_WIN32*/
+
+/* files mapped at a time, to bound open descriptors */
+#define TOUCH_BATCH 64
+
+/* descriptors left for standard streams and the library */
+#define TOUCH_SPARE 16
+
+struct touch_file {
+  char* name;
+  struct mmapio_i* mi;
+  int err;
+};
+
+static int touch_is_empty(char const* name) {
+  FILE* const f = fopen(name, "rb");
+  int res;
+  if (f == NULL)
+    return 0;
+  res = (fgetc(f) == EOF && !ferror(f));
+  fclose(f);
+  return res;
+}
+
+static size_t touch_lock_limit(void) {
+#if (defined _WIN32)
+  return (size_t)-1;
+#else
+  /* each locked file keeps its descriptor until the process ends */
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur == RLIM_INFINITY)
+    return (size_t)-1;
+  return (rl.rlim_cur > TOUCH_SPARE)
+    ? (size_t)(rl.rlim_cur - TOUCH_SPARE) : 0;
+#endif /*_WIN32*/
+}
+
+static char* touch_getline(FILE* f) {
+  size_t cap = 256;
+  size_t n = 0;
+  char* out = (char*)malloc(cap);
+  int ch;
+  if (out == NULL)
+    return NULL;
+  while ((ch = fgetc(f)) != EOF && ch != '\n') {
+    if (n+1 >= cap) {
+      char* const next = (char*)realloc(out, cap*2);
+      if (next == NULL) {
+        free(out);
+        return NULL;
+      }
+      out = next;
+      cap *= 2;
+    }
+    out[n++] = (char)ch;
+  }
+  if (ch == EOF && n == 0) {
+    free(out);
+    return NULL;
+  }
+  if (n > 0 && out[n-1] == '\r')
+    n -= 1;
+  out[n] = 0;
+  return out;
+}
+
+static void touch_report(struct touch_file const* tf) {
+  size_t const psize = mmapio_page_size();
+  size_t len = 0;
+  size_t resident = (size_t)-1;
+  int err = tf->err;
+  if (tf->mi == NULL && err == 0)
+    resident = 0;
+  else if (tf->mi != NULL) {
+    len = mmapio_length(tf->mi);
+    mmapio_set_errno(0);
+    resident = mmapio_residency(tf->mi, 0, 0, NULL);
+    if (resident == (size_t)-1 && err == 0)
+      err = mmapio_get_errno();
+  }
+  fprintf(stdout, "%s\t%lu\t%lu\t", tf->name, (long unsigned int)len,
+    (long unsigned int)(psize ? (len+psize-1)/psize : 0));
+  if (resident == (size_t)-1)
+    fputs("-\t", stdout);
+  else fprintf(stdout, "%lu\t", (long unsigned int)resident);
+  fprintf(stdout, "%s\n", err ? strerror(err) : "ok");
+  return;
+}
+
+static void touch_pages(struct mmapio_i* mi) {
+  size_t const psize = mmapio_page_size();
+  size_t const len = mmapio_length(mi);
+  unsigned char const volatile* bytes =
+    (unsigned char const volatile*)mmapio_acquire(mi);
+  size_t i;
+  unsigned int sum = 0;
+  if (bytes == NULL || psize == 0)
+    return;
+  /* wait for readahead by reading one byte per page */
+  for (i = 0; i < len; i += psize) {
+    sum += bytes[i];
+  }
+  mmapio_release(mi, (void*)bytes);
+  (void)sum;
+  return;
+}
+
+static void touch_batch(struct touch_file* files, size_t count,
+    int advice)
+{
+  size_t i;
+  /* give advice to all files first, so the reads overlap */
+  if (advice >= 0) {
+    for (i = 0; i < count; ++i) {
+      if (files[i].mi == NULL)
+        continue;
+      mmapio_set_errno(0);
+      if (mmapio_advise(files[i].mi, 0, 0, advice) != 0)
+        files[i].err = mmapio_get_errno();
+    }
+  }
+  if (advice == mmapio_advice_willneed) {
+    for (i = 0; i < count; ++i) {
+      if (files[i].mi != NULL)
+        touch_pages(files[i].mi);
+    }
+  }
+  for (i = 0; i < count; ++i)
+    touch_report(files + i);
+  return;
+}
+
+static void touch_close(struct touch_file* files, size_t count) {
+  size_t i;
+  for (i = 0; i < count; ++i) {
+    if (files[i].mi != NULL)
+      mmapio_close(files[i].mi);
+    free(files[i].name);
+  }
+  return;
+}
+
+int main(int argc, char **argv) {
+  struct touch_file* files = NULL;
+  size_t count = 0;
+  size_t cap = 0;
+  size_t done = 0;
+  size_t held = 0;
+  size_t limit = (size_t)-1;
+  char const* cmd;
+  int advice;
+  int status = EXIT_SUCCESS;
+  int eof = 0;
+  if (argc < 2) {
+    fputs("usage: touch (residency|warm|evict|lock) < (file list)\n"
+      "  prints: (file) (bytes) (pages) (resident pages) (status)\n"
+      "  lock keeps every file open, so it stops at the open file\n"
+      "  limit (see `ulimit -n`)\n",
+      stderr);
+    return EXIT_FAILURE;
+  }
+  cmd = argv[1];
+  if (strcmp(cmd, "residency") == 0)
+    advice = -1;
+  else if (strcmp(cmd, "warm") == 0)
+    advice = mmapio_advice_willneed;
+  else if (strcmp(cmd, "evict") == 0)
+    advice = mmapio_advice_evict;
+  else if (strcmp(cmd, "lock") == 0) {
+    advice = mmapio_advice_lock;
+    limit = touch_lock_limit();
+  } else {
+    fprintf(stderr, "unknown command '%s'\n", cmd);
+    return EXIT_FAILURE;
+  }
+  while (!eof) {
+    /* map the next batch of listed files */
+    while (count - done < TOUCH_BATCH) {
+      char* const name = touch_getline(stdin);
+      if (name == NULL) {
+        eof = 1;
+        break;
+      }
+      if (name[0] == 0) {
+        free(name);
+        continue;
+      }
+      if (held >= limit) {
+        fprintf(stderr, "open file limit reached; not locking '%s' "
+          "or later files\n", name);
+        free(name);
+        status = EXIT_FAILURE;
+        eof = 1;
+        break;
+      }
+      if (count >= cap) {
+        size_t const next_cap = cap ? cap*2 : 16;
+        struct touch_file* const next = (struct touch_file*)realloc(
+            files, next_cap*sizeof(struct touch_file));
+        if (next == NULL) {
+          free(name);
+          fputs("out of memory\n", stderr);
+          status = EXIT_FAILURE;
+          eof = 1;
+          break;
+        }
+        files = next;
+        cap = next_cap;
+      }
+      mmapio_set_errno(0);
+      files[count].name = name;
+      files[count].mi = mmapio_open(name, "re", 0, 0);
+      files[count].err = files[count].mi ? 0 : mmapio_get_errno();
+      /* an empty file has nothing to map, and no pages to report */
+      if (files[count].mi == NULL && touch_is_empty(name))
+        files[count].err = 0;
+      if (files[count].mi != NULL)
+        held += 1;
+      count += 1;
+    }
+    touch_batch(files + done, count - done, advice);
+    for (; done < count; ++done) {
+      if (files[done].err != 0)
+        status = EXIT_FAILURE;
+    }
+    if (advice != mmapio_advice_lock) {
+      /* reuse the slots for the next batch */
+      touch_close(files, count);
+      count = 0;
+      done = 0;
+    }
+  }
+  fflush(stdout);
+  if (advice == mmapio_advice_lock) {
+    /* hold the locks until the process ends */
+#if (defined _WIN32)
+    for (;;) Sleep(INFINITE);
+#else
+    for (;;) pause();
+#endif /*_WIN32*/
+  }
+  touch_close(files, count);
+  free(files);
+  return status;
+}